@@ -0,0 +1,517 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Benchmark of the runtimes running many charge points: the gateway in one
+ * thread, or the worker pool when built with OCPP_BENCH_POOL.
+ *
+ * Each charge point talks over a socket pair to a CSMS thread answering every
+ * CALL with a CALLRESULT. Requests are pushed at a steady rate spread over
+ * the charge points. The result is printed as one JSON object:
+ *
+ *   {"bench":"gateway","cps":1000,"seconds":10,"rate":1.0,"steps":..,
+ *    "responses":..,"responses_per_sec":..,"dropped":..,"cpu_percent":..,
+ *    "loop_mean_us":..,"loop_max_us":..}
+ *
+ * where `loop_*_us` is the time spent in a call of `ocpp_gw_run()` apart
+ * from waiting, and `cpu_percent` is the CPU time of the gateway thread over
+ * the wall time. The pool reports `"workers"` and the `"utilization"` of
+ * each worker in percent instead of the loop and CPU figures.
+ *
+ * Usage: ocpp_gateway_bench [-n charge points] [-t seconds]
+ *                           [-r requests per second per charge point]
+ *                           [-o output file to append]
+ *        ocpp_pool_bench [-w workers] and the same options as above
+ */
+
+#include "ocpp/ocpp.h"
+#include "ocpp/runtime/gateway.h"
+#include "ocpp/runtime/pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_CPS				1000
+#define DEFAULT_SECONDS				10
+#define DEFAULT_RATE				1.0
+#define PUSH_INTERVAL_MS			10
+#define DEFAULT_WORKERS				4
+#define LOCK_STRIPES				64
+
+#if defined(OCPP_BENCH_POOL)
+typedef struct ocpp_pool runtime_t;
+typedef struct ocpp_pool_conn conn_t;
+#define runtime_add				ocpp_pool_add
+#define runtime_kick				ocpp_pool_kick
+#define runtime_remove				ocpp_pool_remove
+#else
+typedef struct ocpp_gw runtime_t;
+typedef struct ocpp_gw_conn conn_t;
+#define runtime_add				ocpp_gw_add
+#define runtime_kick				ocpp_gw_kick
+#define runtime_remove				ocpp_gw_remove
+#endif
+
+struct wire {
+	char id[OCPP_MESSAGE_ID_MAXLEN];
+	uint8_t role;
+	uint8_t type;
+};
+
+struct cp {
+	conn_t conn;
+	struct ocpp_context *ctx;
+	int fd;
+	int peer;
+	struct wire rx;
+	bool has_rx;
+};
+
+static struct {
+	struct cp *cps;
+	int n;
+	unsigned long msgid;
+	unsigned long responses;
+	pthread_mutex_t locks[LOCK_STRIPES];
+	volatile bool stop;
+	FILE *out;
+} m;
+
+static const struct ocpp_BootNotification_conf boot_conf = {
+	.interval = 60,
+	.status = OCPP_BOOT_STATUS_ACCEPTED,
+};
+static const struct ocpp_DataTransfer_conf data_conf;
+static struct ocpp_DataTransfer data_req;
+static struct ocpp_BootNotification boot_req;
+
+/* the contexts are stepped on many threads with the pool, so the engine lock
+ * is striped by context instead of one lock for all */
+static pthread_mutex_t *get_lock(void)
+{
+	const uintptr_t key = (uintptr_t)ocpp_get_context() >> 4;
+	return &m.locks[key % LOCK_STRIPES];
+}
+
+int ocpp_lock(void)
+{
+	return pthread_mutex_lock(get_lock());
+}
+
+int ocpp_unlock(void)
+{
+	return pthread_mutex_unlock(get_lock());
+}
+
+int ocpp_configuration_lock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_unlock(void)
+{
+	return 0;
+}
+
+void ocpp_generate_message_id(void *buf, size_t bufsize)
+{
+	snprintf((char *)buf, bufsize, "%lu",
+			__atomic_add_fetch(&m.msgid, 1, __ATOMIC_RELAXED));
+}
+
+static uint64_t get_ns(clockid_t clk)
+{
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int get_fd(const void *transport)
+{
+	return ((const struct cp *)transport)->fd;
+}
+
+static short get_events(const void *transport)
+{
+	(void)transport;
+	return POLLIN;
+}
+
+static int process(void *transport, short revents)
+{
+	struct cp *cp = (struct cp *)transport;
+
+	if ((revents & POLLIN) && !cp->has_rx) {
+		cp->has_rx = read(cp->fd, &cp->rx, sizeof(cp->rx)) ==
+				sizeof(cp->rx);
+	}
+
+	return 0;
+}
+
+static int send_message(void *transport, const struct ocpp_message *msg)
+{
+	const struct cp *cp = (const struct cp *)transport;
+	struct wire w = {
+		.role = (uint8_t)msg->role,
+		.type = (uint8_t)msg->type,
+	};
+
+	memcpy(w.id, msg->id, sizeof(w.id));
+
+	if (write(cp->fd, &w, sizeof(w)) != sizeof(w)) {
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int recv_message(void *transport, struct ocpp_message *msg)
+{
+	struct cp *cp = (struct cp *)transport;
+
+	if (!cp->has_rx) {
+		process(cp, POLLIN);
+	}
+	if (!cp->has_rx) {
+		return -ENOMSG;
+	}
+
+	cp->has_rx = false;
+	memcpy(msg->id, cp->rx.id, sizeof(msg->id));
+	msg->role = (ocpp_message_role_t)cp->rx.role;
+	msg->type = (ocpp_message_t)cp->rx.type;
+	msg->payload.fmt.response = msg->type == OCPP_MSG_BOOTNOTIFICATION?
+		(const void *)&boot_conf : (const void *)&data_conf;
+
+	return 0;
+}
+
+static const struct ocpp_gw_transport transport = {
+	.get_fd = get_fd,
+	.get_events = get_events,
+	.process = process,
+	.send = send_message,
+	.recv = recv_message,
+};
+
+static void on_event(ocpp_event_t event_type,
+		const struct ocpp_message *msg, void *ctx)
+{
+	(void)ctx;
+
+	if (event_type == OCPP_EVENT_MESSAGE_INCOMING &&
+			msg->role == OCPP_MSG_ROLE_CALLRESULT) {
+		__atomic_fetch_add(&m.responses, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void *run_csms(void *arg)
+{
+	struct epoll_event events[OCPP_GW_MAX_EVENTS];
+	const int epfd = *(const int *)arg;
+
+	while (!m.stop) {
+		const int n = epoll_wait(epfd, events, OCPP_GW_MAX_EVENTS, 100);
+
+		for (int i = 0; i < n; i++) {
+			const int fd = events[i].data.fd;
+			struct wire w;
+
+			while (read(fd, &w, sizeof(w)) == sizeof(w)) {
+				w.role = OCPP_MSG_ROLE_CALLRESULT;
+				if (write(fd, &w, sizeof(w)) != sizeof(w)) {
+					break;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static int raise_fd_limit(int n)
+{
+	struct rlimit lim;
+	const rlim_t needed = (rlim_t)n * 2 + 64;
+
+	if (getrlimit(RLIMIT_NOFILE, &lim) != 0) {
+		return -errno;
+	}
+	if (lim.rlim_cur >= needed) {
+		return 0;
+	}
+	if (lim.rlim_max < needed) {
+		return -EMFILE;
+	}
+
+	lim.rlim_cur = needed;
+
+	return setrlimit(RLIMIT_NOFILE, &lim) == 0? 0 : -errno;
+}
+
+static int setup(runtime_t *rt, int csms_epfd)
+{
+	for (int i = 0; i < m.n; i++) {
+		struct cp *cp = &m.cps[i];
+		int sv[2];
+
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, sv)) {
+			return -errno;
+		}
+
+		cp->fd = sv[0];
+		cp->peer = sv[1];
+
+		struct epoll_event ev = { .events = EPOLLIN, .data.fd = sv[1] };
+		if (epoll_ctl(csms_epfd, EPOLL_CTL_ADD, sv[1], &ev) != 0) {
+			return -errno;
+		}
+
+		if ((cp->ctx = malloc(ocpp_compute_context_size())) == NULL) {
+			return -ENOMEM;
+		}
+
+		ocpp_switch_context(cp->ctx);
+		ocpp_init(on_event, cp);
+		ocpp_push_request(OCPP_MSG_BOOTNOTIFICATION,
+				&boot_req, sizeof(boot_req), false);
+		ocpp_switch_context(NULL);
+
+		int err = runtime_add(rt, &cp->conn, cp->ctx, &transport, cp);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static unsigned long push(runtime_t *rt, unsigned long count,
+		unsigned long *dropped)
+{
+	static int next;
+
+	for (unsigned long i = 0; i < count; i++) {
+		struct cp *cp = &m.cps[next];
+		next = (next + 1) % m.n;
+
+		ocpp_switch_context(cp->ctx);
+		if (ocpp_push_request(OCPP_MSG_DATA_TRANSFER,
+				&data_req, sizeof(data_req), false) != 0) {
+			(*dropped)++;
+		}
+		ocpp_switch_context(NULL);
+
+		runtime_kick(rt, &cp->conn);
+	}
+
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *outfile = NULL;
+	int seconds = DEFAULT_SECONDS;
+	int workers = DEFAULT_WORKERS;
+	double rate = DEFAULT_RATE;
+	runtime_t rt;
+	pthread_t csms;
+	int opt;
+	int err;
+
+	m.n = DEFAULT_CPS;
+	m.out = stdout;
+
+	while ((opt = getopt(argc, argv, "n:t:r:w:o:")) != -1) {
+		switch (opt) {
+		case 'n':
+			m.n = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'w':
+			workers = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n charge points] "
+					"[-t seconds] [-r rate] [-w workers] "
+					"[-o file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (m.n <= 0 || seconds <= 0 || rate < 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	if ((err = raise_fd_limit(m.n)) != 0) {
+		fprintf(stderr, "too many charge points for the fd limit: %s\n",
+				strerror(-err));
+		return 1;
+	}
+
+	if (outfile && (m.out = fopen(outfile, "a")) == NULL) {
+		perror(outfile);
+		return 1;
+	}
+
+	strcpy(data_req.vendorId, "bench");
+	strcpy(boot_req.chargePointModel, "bench");
+	strcpy(boot_req.chargePointVendor, "bench");
+
+	for (int i = 0; i < LOCK_STRIPES; i++) {
+		pthread_mutex_init(&m.locks[i], NULL);
+	}
+
+	int csms_epfd = epoll_create1(EPOLL_CLOEXEC);
+	m.cps = (struct cp *)calloc((size_t)m.n, sizeof(*m.cps));
+
+#if defined(OCPP_BENCH_POOL)
+	err = ocpp_pool_init(&rt, workers);
+#else
+	(void)workers;
+	err = ocpp_gw_init(&rt);
+#endif
+	if (csms_epfd < 0 || m.cps == NULL || err != 0) {
+		fprintf(stderr, "out of resources\n");
+		return 1;
+	}
+
+	if ((err = setup(&rt, csms_epfd)) != 0) {
+		fprintf(stderr, "setup failed: %s\n", strerror(-err));
+		return 1;
+	}
+
+	pthread_create(&csms, NULL, run_csms, &csms_epfd);
+#if defined(OCPP_BENCH_POOL)
+	ocpp_pool_start(&rt);
+#endif
+
+	const uint64_t start = get_ns(CLOCK_MONOTONIC);
+	const uint64_t cpu_start = get_ns(CLOCK_THREAD_CPUTIME_ID);
+	const uint64_t end = start + (uint64_t)seconds * 1000000000u;
+	unsigned long pushed = 0;
+	unsigned long dropped = 0;
+	unsigned long steps = 0;
+	unsigned long loops = 0;
+	uint64_t busy = 0;
+	uint64_t busy_max = 0;
+	uint64_t now;
+
+	while ((now = get_ns(CLOCK_MONOTONIC)) < end) {
+		const double elapsed = (double)(now - start) / 1e9;
+		const unsigned long due = (unsigned long)
+			(elapsed * rate * (double)m.n);
+
+		if (due > pushed) {
+			pushed += push(&rt, due - pushed, &dropped);
+		}
+
+#if defined(OCPP_BENCH_POOL)
+		const struct timespec interval = {
+			.tv_nsec = PUSH_INTERVAL_MS * 1000000L,
+		};
+		nanosleep(&interval, NULL);
+#else
+		const uint64_t t0 = get_ns(CLOCK_THREAD_CPUTIME_ID);
+		const int stepped = ocpp_gw_run(&rt, PUSH_INTERVAL_MS);
+		const uint64_t t = get_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+
+		if (stepped > 0) {
+			steps += (unsigned long)stepped;
+			loops++;
+			busy += t;
+			busy_max = t > busy_max? t : busy_max;
+		}
+#endif
+	}
+
+#if defined(OCPP_BENCH_POOL)
+	ocpp_pool_stop(&rt);
+#endif
+
+	const double wall = (double)(get_ns(CLOCK_MONOTONIC) - start) / 1e9;
+	const double cpu =
+		(double)(get_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start) / 1e9;
+
+	m.stop = true;
+	pthread_join(csms, NULL);
+
+#if defined(OCPP_BENCH_POOL)
+	(void)cpu;
+	(void)loops;
+	(void)busy;
+	(void)busy_max;
+
+	for (int i = 0; i < workers; i++) {
+		struct ocpp_pool_stats stats;
+		ocpp_pool_get_stats(&rt, i, &stats);
+		steps += stats.steps;
+	}
+
+	fprintf(m.out, "{\"bench\":\"pool\",\"cps\":%d,\"seconds\":%d,"
+			"\"rate\":%.2f,\"workers\":%d,\"steps\":%lu,"
+			"\"responses\":%lu,\"responses_per_sec\":%.1f,"
+			"\"dropped\":%lu,\"utilization\":[",
+			m.n, seconds, rate, workers, steps, m.responses,
+			(double)m.responses / wall, dropped);
+	for (int i = 0; i < workers; i++) {
+		struct ocpp_pool_stats stats;
+		ocpp_pool_get_stats(&rt, i, &stats);
+		fprintf(m.out, "%s%u", i? "," : "", stats.utilization);
+	}
+	fprintf(m.out, "]}\n");
+#else
+	fprintf(m.out, "{\"bench\":\"gateway\",\"cps\":%d,\"seconds\":%d,"
+			"\"rate\":%.2f,\"steps\":%lu,\"responses\":%lu,"
+			"\"responses_per_sec\":%.1f,\"dropped\":%lu,"
+			"\"cpu_percent\":%.1f,\"loop_mean_us\":%.1f,"
+			"\"loop_max_us\":%.1f}\n",
+			m.n, seconds, rate, steps, m.responses,
+			(double)m.responses / wall, dropped,
+			cpu / wall * 100.0,
+			loops? (double)busy / (double)loops / 1e3 : 0.0,
+			(double)busy_max / 1e3);
+#endif
+
+	for (int i = 0; i < m.n; i++) {
+		runtime_remove(&rt, &m.cps[i].conn);
+		close(m.cps[i].fd);
+		close(m.cps[i].peer);
+		free(m.cps[i].ctx);
+	}
+#if defined(OCPP_BENCH_POOL)
+	ocpp_pool_deinit(&rt);
+#else
+	ocpp_gw_deinit(&rt);
+#endif
+	close(csms_epfd);
+	free(m.cps);
+
+	if (m.out != stdout) {
+		fclose(m.out);
+	}
+
+	return 0;
+}
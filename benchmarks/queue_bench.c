@@ -0,0 +1,274 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Microbenchmarks for the hot paths of the message queue engine.
+ *
+ * The pool size is fixed at compile time with OCPP_TX_POOL_LEN, so one binary
+ * is built per pool size. Each benchmark prints one JSON object per line:
+ *
+ *   {"bench":"push","pool":8,"runs":5,"ops":8,"min_ns":..,"mean_ns":..}
+ *
+ * where `min_ns` and `mean_ns` are nanoseconds per operation over the runs.
+ *
+ * Usage: ocpp_bench_<pool> [-r runs] [-o output file to append]
+ */
+
+#include "ocpp/ocpp.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !defined(OCPP_TX_POOL_LEN)
+#define OCPP_TX_POOL_LEN			8
+#endif
+
+#define DEFAULT_RUNS				5
+#define MIN_OPS_PER_RUN				4096
+
+typedef uint64_t (*bench_func_t)(size_t ops);
+
+static struct {
+	char last_sent_id[OCPP_MESSAGE_ID_MAXLEN];
+	ocpp_message_t last_sent_type;
+	bool respond;
+	unsigned long msgid;
+	FILE *out;
+	int runs;
+} m;
+
+static struct ocpp_DataTransfer payload;
+
+int ocpp_send(const struct ocpp_message *msg)
+{
+	memcpy(m.last_sent_id, msg->id, sizeof(m.last_sent_id));
+	m.last_sent_type = msg->type;
+	return 0;
+}
+
+int ocpp_recv(struct ocpp_message *msg)
+{
+	if (!m.respond) {
+		return -ENOMSG;
+	}
+
+	m.respond = false;
+	memcpy(msg->id, m.last_sent_id, sizeof(msg->id));
+	msg->role = OCPP_MSG_ROLE_CALLRESULT;
+	msg->type = m.last_sent_type;
+
+	return 0;
+}
+
+int ocpp_lock(void)
+{
+	return 0;
+}
+
+int ocpp_unlock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_lock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_unlock(void)
+{
+	return 0;
+}
+
+void ocpp_generate_message_id(void *buf, size_t bufsize)
+{
+	snprintf((char *)buf, bufsize, "%lu", ++m.msgid);
+}
+
+static uint64_t get_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void reset(void)
+{
+	m.respond = false;
+	ocpp_init(NULL, NULL);
+}
+
+static void fill(size_t n, ocpp_message_t type)
+{
+	for (size_t i = 0; i < n; i++) {
+		ocpp_push_request(type, &payload, sizeof(payload), false);
+	}
+}
+
+/* pushing into the pool from empty to full */
+static uint64_t bench_push(size_t ops)
+{
+	uint64_t elapsed = 0;
+
+	for (size_t done = 0; done < ops; done += OCPP_TX_POOL_LEN) {
+		reset();
+		const uint64_t t0 = get_ns();
+		fill(OCPP_TX_POOL_LEN, OCPP_MSG_DATA_TRANSFER);
+		elapsed += get_ns() - t0;
+	}
+
+	return elapsed;
+}
+
+/* a step with nothing to receive while the pool is full and a request is
+ * waiting for its response */
+static uint64_t bench_step_idle(size_t ops)
+{
+	reset();
+	fill(OCPP_TX_POOL_LEN, OCPP_MSG_DATA_TRANSFER);
+	ocpp_step();
+
+	const uint64_t t0 = get_ns();
+	for (size_t i = 0; i < ops; i++) {
+		ocpp_step();
+	}
+
+	return get_ns() - t0;
+}
+
+/* a step sending a request followed by a step receiving its response, until
+ * the full pool drains */
+static uint64_t bench_correlation(size_t ops)
+{
+	uint64_t elapsed = 0;
+
+	for (size_t done = 0; done < ops; done += OCPP_TX_POOL_LEN) {
+		reset();
+		fill(OCPP_TX_POOL_LEN, OCPP_MSG_DATA_TRANSFER);
+
+		const uint64_t t0 = get_ns();
+		for (size_t i = 0; i < OCPP_TX_POOL_LEN; i++) {
+			ocpp_step();
+			m.respond = true;
+			ocpp_step();
+		}
+		elapsed += get_ns() - t0;
+	}
+
+	return elapsed;
+}
+
+/* dropping half of the full pool */
+static uint64_t bench_drop(size_t ops)
+{
+	uint64_t elapsed = 0;
+
+	for (size_t done = 0; done < ops; done += OCPP_TX_POOL_LEN / 2) {
+		reset();
+		for (size_t i = 0; i < OCPP_TX_POOL_LEN; i++) {
+			fill(1, (i & 1)? OCPP_MSG_HEARTBEAT :
+					OCPP_MSG_STATUS_NOTIFICATION);
+		}
+
+		const uint64_t t0 = get_ns();
+		ocpp_drop_pending_type(OCPP_MSG_HEARTBEAT);
+		elapsed += get_ns() - t0;
+	}
+
+	return elapsed;
+}
+
+/* counting pending requests with the full pool */
+static uint64_t bench_count(size_t ops)
+{
+	volatile size_t sink = 0;
+
+	reset();
+	fill(OCPP_TX_POOL_LEN, OCPP_MSG_DATA_TRANSFER);
+
+	const uint64_t t0 = get_ns();
+	for (size_t i = 0; i < ops; i++) {
+		sink += ocpp_count_pending_requests();
+	}
+	(void)sink;
+
+	return get_ns() - t0;
+}
+
+static size_t round_up_ops(size_t ops, size_t unit)
+{
+	return (ops + unit - 1) / unit * unit;
+}
+
+static void run(const char *name, bench_func_t f, size_t unit)
+{
+	const size_t ops = round_up_ops(MIN_OPS_PER_RUN, unit);
+	uint64_t min = UINT64_MAX;
+	uint64_t sum = 0;
+
+	for (int i = 0; i < m.runs; i++) {
+		const uint64_t elapsed = (*f)(ops);
+		min = elapsed < min? elapsed : min;
+		sum += elapsed;
+	}
+
+	fprintf(m.out, "{\"bench\":\"%s\",\"pool\":%d,\"runs\":%d,"
+			"\"ops\":%zu,\"min_ns\":%.1f,\"mean_ns\":%.1f}\n",
+			name, OCPP_TX_POOL_LEN, m.runs, ops,
+			(double)min / (double)ops,
+			(double)sum / (double)m.runs / (double)ops);
+	fflush(m.out);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *outfile = NULL;
+	int opt;
+
+	m.runs = DEFAULT_RUNS;
+	m.out = stdout;
+
+	while ((opt = getopt(argc, argv, "r:o:")) != -1) {
+		switch (opt) {
+		case 'r':
+			m.runs = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-r runs] [-o file]\n",
+					argv[0]);
+			return 1;
+		}
+	}
+
+	if (m.runs <= 0) {
+		m.runs = DEFAULT_RUNS;
+	}
+
+	if (outfile && (m.out = fopen(outfile, "a")) == NULL) {
+		perror(outfile);
+		return 1;
+	}
+
+	strcpy(payload.vendorId, "bench");
+
+	run("push", bench_push, OCPP_TX_POOL_LEN);
+	run("step_idle", bench_step_idle, 1);
+	run("correlation", bench_correlation, OCPP_TX_POOL_LEN);
+	run("drop_pending_type", bench_drop, OCPP_TX_POOL_LEN / 2);
+	run("count_pending_requests", bench_count, 1);
+
+	if (m.out != stdout) {
+		fclose(m.out);
+	}
+
+	return 0;
+}
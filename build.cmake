@@ -4,5 +4,30 @@ list(APPEND OCPP_SRCS
 	${CMAKE_CURRENT_LIST_DIR}/src/ocpp.c
 	${CMAKE_CURRENT_LIST_DIR}/src/core/configuration.c
 	${CMAKE_CURRENT_LIST_DIR}/src/stringify.c
+	${CMAKE_CURRENT_LIST_DIR}/src/trace.c
+	${CMAKE_CURRENT_LIST_DIR}/src/capture.c
+	${CMAKE_CURRENT_LIST_DIR}/src/overrides.c
 )
 list(APPEND OCPP_INCS ${CMAKE_CURRENT_LIST_DIR}/include)
+
+# Optional reference WebSocket transport. Add `OCPP_WS_SRCS` to the sources
+# to use it, leaving out `ws_overrides.c` to implement `ocpp_send()` and
+# `ocpp_recv()` yourself.
+list(APPEND OCPP_WS_SRCS
+	${CMAKE_CURRENT_LIST_DIR}/src/transport/ws.c
+	${CMAKE_CURRENT_LIST_DIR}/src/transport/ws_overrides.c
+)
+
+# Optional runtime running many charge points over one epoll set on Linux. It
+# defines `ocpp_send()` and `ocpp_recv()`, so leave out `ws_overrides.c` when
+# used together with `OCPP_WS_SRCS`, adding `src/runtime/gateway_ws.c` for the
+# WebSocket transport of connections.
+list(APPEND OCPP_GW_SRCS
+	${CMAKE_CURRENT_LIST_DIR}/src/runtime/gateway.c
+)
+
+# Optional multi-threaded alternative to `OCPP_GW_SRCS`. Build the library with
+# `OCPP_CONTEXT_STORAGE=__thread` for it.
+list(APPEND OCPP_POOL_SRCS
+	${CMAKE_CURRENT_LIST_DIR}/src/runtime/pool.c
+)
@@ -8,5 +8,27 @@ OCPP_SRCS := \
 	$(ocpp-basedir)src/ocpp.c \
 	$(ocpp-basedir)src/core/configuration.c \
 	$(ocpp-basedir)src/stringify.c \
+	$(ocpp-basedir)src/trace.c \
+	$(ocpp-basedir)src/capture.c \
+	$(ocpp-basedir)src/overrides.c \
 
 OCPP_INCS := $(ocpp-basedir)include
+
+# Optional reference WebSocket transport. Add `OCPP_WS_SRCS` to the sources
+# to use it, leaving out `ws_overrides.c` to implement `ocpp_send()` and
+# `ocpp_recv()` yourself.
+OCPP_WS_SRCS := \
+	$(ocpp-basedir)src/transport/ws.c \
+	$(ocpp-basedir)src/transport/ws_overrides.c \
+
+# Optional runtime running many charge points over one epoll set on Linux. It
+# defines `ocpp_send()` and `ocpp_recv()`, so leave out `ws_overrides.c` when
+# used together with `OCPP_WS_SRCS`, adding `src/runtime/gateway_ws.c` for the
+# WebSocket transport of connections.
+OCPP_GW_SRCS := \
+	$(ocpp-basedir)src/runtime/gateway.c \
+
+# Optional multi-threaded alternative to `OCPP_GW_SRCS`. Build the library with
+# `OCPP_CONTEXT_STORAGE=__thread` for it.
+OCPP_POOL_SRCS := \
+	$(ocpp-basedir)src/runtime/pool.c \
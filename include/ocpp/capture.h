@@ -0,0 +1,132 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_CAPTURE_H
+#define LIBMCU_OCPP_CAPTURE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ocpp/ocpp.h"
+
+/* Traffic capture is compiled out when it is 0. */
+#if !defined(OCPP_CAPTURE)
+#define OCPP_CAPTURE				0
+#endif
+
+#define OCPP_CAPTURE_MAGIC			0x4350434fu /* "OCPC" */
+#define OCPP_CAPTURE_VERSION			1
+
+#define OCPP_CAPTURE_FLAG_FORCE			(1u << 0)
+#define OCPP_CAPTURE_FLAG_ERR			(1u << 1)
+
+typedef enum {
+	OCPP_CAPTURE_INIT,		/**< `ocpp_init()` */
+	OCPP_CAPTURE_STEP,		/**< `ocpp_step()` */
+	OCPP_CAPTURE_TIME,		/**< `time()` read by the engine */
+	OCPP_CAPTURE_PUSH_REQUEST,	/**< `ocpp_push_request()` */
+	OCPP_CAPTURE_PUSH_DEFER,	/**< `ocpp_push_request_defer()` */
+	OCPP_CAPTURE_PUSH_RESPONSE,	/**< `ocpp_push_response()` */
+	OCPP_CAPTURE_SEND,		/**< `ocpp_send()` */
+	OCPP_CAPTURE_RECV,		/**< `ocpp_recv()` giving a message */
+	OCPP_CAPTURE_CONFIG,		/**< `ocpp_set_configuration()` */
+	OCPP_CAPTURE_STEP_TX,		/**< `ocpp_step_tx()` */
+	OCPP_CAPTURE_STEP_RX,		/**< `ocpp_step_rx()` */
+	OCPP_CAPTURE_KIND_MAX,
+} ocpp_capture_kind_t;
+
+/**
+ * A capture is this header followed by records. All fields are in the native
+ * byte order of the target.
+ */
+struct ocpp_capture_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint16_t id_maxlen;	/**< `OCPP_MESSAGE_ID_MAXLEN` of the target */
+	uint16_t reserved;
+};
+
+/**
+ * Each record is followed by `idlen` bytes of the message id and `size` bytes
+ * of the payload. The payload of @ref OCPP_CAPTURE_TIME is an `int64_t` of
+ * seconds, written only when the time changes. @ref OCPP_CAPTURE_CONFIG
+ * carries the configuration key in place of the id and the value as the
+ * payload.
+ */
+struct ocpp_capture_record {
+	uint32_t timestamp;	/**< in microseconds, wraps around */
+	int32_t rc;		/**< return value of the call */
+	uint32_t arg;		/**< timer of deferred requests */
+	uint16_t size;		/**< bytes of payload, truncated at 65535 */
+	uint8_t kind;		/**< @ref ocpp_capture_kind_t */
+	uint8_t role;		/**< @ref ocpp_message_role_t */
+	uint8_t type;		/**< @ref ocpp_message_t */
+	uint8_t flags;		/**< OCPP_CAPTURE_FLAG_* */
+	uint8_t idlen;
+	uint8_t reserved;
+};
+
+/**
+ * @brief Output function for capture data.
+ *
+ * @return 0 for success, otherwise an error.
+ */
+typedef int (*ocpp_capture_writer_t)(const void *data, size_t datasize,
+		void *ctx);
+
+/**
+ * @brief Start capturing traffic.
+ *
+ * The header is written right away. The writer is called with the engine
+ * lock held, so it should not call back into the engine. Configuration
+ * changes are written from the caller of `ocpp_set_configuration()`, so the
+ * writer should serialize itself if that is another thread.
+ *
+ * @param[in] writer output function
+ * @param[in] ctx context passed to the writer
+ *
+ * @return 0 for success, -ENOTSUP if compiled out, otherwise an error.
+ */
+int ocpp_capture_start(ocpp_capture_writer_t writer, void *ctx);
+void ocpp_capture_stop(void);
+
+/**
+ * @brief Append a record. Used by the engine.
+ *
+ * @param[in] msg message the record is about. NULL if none
+ */
+void ocpp_capture_write(ocpp_capture_kind_t kind,
+		const struct ocpp_message *msg, int rc, uint32_t arg,
+		uint8_t flags);
+/**
+ * @brief Record the time read by the engine. Used by the engine.
+ */
+void ocpp_capture_time(time_t now);
+/**
+ * @brief Record a configuration change. Used by the configuration.
+ */
+void ocpp_capture_config(const char *keystr,
+		const void *value, size_t value_size);
+
+/**
+ * @brief Get a timestamp for capture records in microseconds.
+ *
+ * A monotonic clock is used by default. Override it on targets without one.
+ * No default is provided when `OCPP_CAPTURE` is 0, as it is not called then.
+ */
+uint32_t ocpp_capture_get_timestamp(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* LIBMCU_OCPP_CAPTURE_H */
@@ -25,6 +25,37 @@ typedef enum {
 	OCPP_CONF_TYPE_BOOL,
 } ocpp_configuration_data_t;
 
+/** Returned when a change takes effect only after reboot */
+#define OCPP_CONFIGURATION_REBOOT_REQUIRED	1
+
+/**
+ * @brief Called after a configuration changed.
+ *
+ * @param[in] keystr key string of the configuration changed
+ * @param[in] old_value value before the change
+ * @param[in] new_value value after the change
+ * @param[in] value_size size of the values
+ * @param[in] ctx context given to @ref ocpp_subscribe_configuration
+ *
+ * @return @ref OCPP_CONFIGURATION_REBOOT_REQUIRED if the change cannot be
+ *         applied until reboot, otherwise 0.
+ */
+typedef int (*ocpp_configuration_observer_t)(const char *keystr,
+		const void *old_value, const void *new_value,
+		size_t value_size, void *ctx);
+
+/**
+ * @brief Writes a chunk of the configuration log to the storage.
+ *
+ * @param[in] data records to be appended
+ * @param[in] datasize size of @p data
+ * @param[in] ctx context given to @ref ocpp_save_configuration
+ *
+ * @return 0 on success, otherwise a negative error number.
+ */
+typedef int (*ocpp_configuration_writer_t)(const void *data, size_t datasize,
+		void *ctx);
+
 bool ocpp_has_configuration(const char * const keystr);
 /**
  * @brief Count the number of configurations.
@@ -38,14 +69,150 @@ size_t ocpp_count_configurations(void);
  * @return the total configuration size.
  */
 size_t ocpp_compute_configuration_size(void);
+/**
+ * @brief Copy the raw configuration in.
+ *
+ * @note The layout depends on the configuration definitions, so it gets
+ *       broken when a firmware with different definitions copies it in. Use
+ *       @ref ocpp_deserialize_configuration for the data kept over updates.
+ */
 int ocpp_copy_configuration_from(const void *data, size_t datasize);
 int ocpp_copy_configuration_to(void *buf, size_t bufsize);
+/**
+ * @brief Get the hash of the configuration definitions.
+ *
+ * @return the hash of the key strings, the types and the sizes.
+ */
+uint32_t ocpp_get_configuration_schema(void);
+/**
+ * @brief Compute the size of the serialized configuration.
+ *
+ * @return the buffer size needed by @ref ocpp_serialize_configuration.
+ */
+size_t ocpp_compute_configuration_blob_size(void);
+/**
+ * @brief Serialize the configuration in a self-describing format.
+ *
+ * The data begins with the schema hash followed by a record of the key
+ * string, the type and the value of each configuration.
+ *
+ * @param[out] buf buffer to write to
+ * @param[in] bufsize size of @p buf
+ *
+ * @return the number of bytes written on success, otherwise -EINVAL.
+ */
+int ocpp_serialize_configuration(void *buf, size_t bufsize);
+/**
+ * @brief Load the configuration serialized by any version of firmware.
+ *
+ * The values of the keys still existing are kept and the others get the
+ * default values. Keys removed or changed in type are ignored. Strings are
+ * truncated if the size got smaller.
+ *
+ * @param[in] data data written by @ref ocpp_serialize_configuration
+ * @param[in] datasize size of @p data
+ *
+ * @return 0 on success, -EINVAL if @p data is not a serialized configuration,
+ *         or -ENOTSUP if the format version is not supported.
+ */
+int ocpp_deserialize_configuration(const void *data, size_t datasize);
+/**
+ * @brief Reset the configurations to the default values.
+ *
+ * @note The changes not saved yet are forgotten. A log saved before is still
+ *       to be loaded unless erased.
+ */
 void ocpp_reset_configuration(void);
+/**
+ * @brief Append the configurations changed since saved last time to the log.
+ *
+ * A record of a key and its value is written for each key changed, so the
+ * cost is in proportion to the changes rather than the whole configuration.
+ * The keys failed to be written are kept to be saved next time.
+ *
+ * @param[in] writer function appending records to the log in the storage
+ * @param[in] ctx context passed to @p writer
+ *
+ * @return the number of bytes written on success, otherwise the error from
+ *         @p writer or -EINVAL.
+ */
+int ocpp_save_configuration(ocpp_configuration_writer_t writer, void *ctx);
+/**
+ * @brief Write every configuration as a new log.
+ *
+ * A log grows as it is appended. When it is about to be full, write a fresh
+ * one in another place with this and erase the old one.
+ *
+ * @param[in] writer function writing records to the new log
+ * @param[in] ctx context passed to @p writer
+ *
+ * @return the number of bytes written on success, otherwise the error from
+ *         @p writer or -EINVAL.
+ */
+int ocpp_compact_configuration(ocpp_configuration_writer_t writer, void *ctx);
+/**
+ * @brief Load the configurations replaying a log over the default values.
+ *
+ * Replaying stops at the first invalid record like the erased area or a
+ * record torn by power loss, so the later records win.
+ *
+ * @param[in] log log written by @ref ocpp_save_configuration and
+ *            @ref ocpp_compact_configuration
+ * @param[in] logsize size of @p log
+ *
+ * @return the length of the valid records, where to append next, on success,
+ *         otherwise -EINVAL.
+ */
+int ocpp_load_configuration(const void *log, size_t logsize);
+/**
+ * @brief Set the configuration for the key string.
+ *
+ * The observers of the key get called after the change committed, without
+ * the lock held, with the old and new values. Nothing is called if the value
+ * is the same. Keys defined with REBOOT are notified too, as an observer may
+ * keep the value on its own, though the change takes effect after reboot.
+ *
+ * @param[in] keystr key string
+ * @param[in] value new value
+ * @param[in] value_size size of @p value
+ *
+ * @return 0 on success, @ref OCPP_CONFIGURATION_REBOOT_REQUIRED if the key is
+ *         defined with REBOOT or any observer cannot apply the change until
+ *         reboot, -EINVAL if the key is unknown or @p value_size is too big,
+ *         -EPERM if read-only, or -ERANGE if the value violates RANGE or ONEOF
+ *         of the definition.
+ */
 int ocpp_set_configuration(const char * const keystr,
 		const void *value, size_t value_size);
+/**
+ * @brief Get called whenever the configuration changes.
+ *
+ * The changes by @ref ocpp_set_configuration are notified, not the ones made
+ * by loading or resetting the whole configuration.
+ *
+ * @param[in] keystr key string to observe, or NULL for all keys
+ * @param[in] cb observer to be called
+ * @param[in] ctx context passed to @p cb
+ *
+ * @return 0 on success, -EINVAL if the key is unknown, or -ENOMEM if no room
+ *         left for another observer.
+ */
+int ocpp_subscribe_configuration(const char * const keystr,
+		ocpp_configuration_observer_t cb, void *ctx);
+/**
+ * @brief Stop getting called for the changes.
+ *
+ * @return 0 on success, -EINVAL if the key is unknown, or -ENOENT if not
+ *         subscribed.
+ */
+int ocpp_unsubscribe_configuration(const char * const keystr,
+		ocpp_configuration_observer_t cb, void *ctx);
 /**
  * @brief Get the configuration for the key string.
  *
+ * It does not take the configuration lock unless a write keeps getting in the
+ * way, so it is cheap enough to be called in loops on any thread.
+ *
  * @param[in] keystr key string
  * @param[in] buf buffer
  * @param[in] bufsize size of buffer
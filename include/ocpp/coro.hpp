@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_CORO_HPP
+#define LIBMCU_OCPP_CORO_HPP
+
+#include <coroutine>
+#include <exception>
+#include <errno.h>
+
+#include "ocpp/traits.hpp"
+
+namespace ocpp {
+
+template <typename Conf>
+struct response {
+	/** 0 on CALLRESULT, -EPROTO on CALLERROR, or the reason given up as
+	 * `ocpp_request_callback_t` gets */
+	int err;
+	Conf conf; /**< valid only when @ref err is 0 */
+
+	explicit operator bool() const noexcept { return err == 0; }
+};
+
+/**
+ * Coroutine run right away until awaiting a response, and then resumed in
+ * `ocpp_step()` when the response is received. The frame is freed when it
+ * returns.
+ */
+struct task {
+	struct promise_type {
+		task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+template <typename Request>
+class call_awaiter {
+public:
+	using conf_type = typename request_traits<Request>::conf_type;
+
+	explicit call_awaiter(const Request &request) noexcept : req(request) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> h) noexcept {
+		handle = h;
+
+		/* may be resumed on another thread even before this returns, so
+		 * no touching the awaiter once pushed */
+		const int err = ocpp_push_request_cb(
+				request_traits<Request>::type,
+				&req, sizeof(req), on_done, this);
+
+		if (err != 0) {
+			result.err = err;
+			return false;
+		}
+
+		return true;
+	}
+
+	response<conf_type> await_resume() const noexcept { return result; }
+
+private:
+	static void on_done(int err, const struct ocpp_message *resp,
+			void *ctx) {
+		call_awaiter *self = static_cast<call_awaiter *>(ctx);
+
+		self->result.err = err;
+
+		if (err == 0 && resp->role == OCPP_MSG_ROLE_CALLERROR) {
+			self->result.err = -EPROTO;
+		} else if (err == 0 && resp->payload.fmt.response) {
+			self->result.conf = *static_cast<const conf_type *>
+				(resp->payload.fmt.response);
+		}
+
+		self->handle.resume();
+	}
+
+	const Request &req;
+	std::coroutine_handle<> handle;
+	response<conf_type> result {};
+};
+
+/**
+ * @brief Awaits the response of a request.
+ *
+ * `auto resp = co_await ocpp::call<ocpp::StartTransaction>(req);` pushes the
+ * request with @ref ocpp_push_request_cb and gets the coroutine resumed with
+ * a copy of the response. Nothing is allocated but the coroutine frame.
+ *
+ * @note @p req is referenced until the coroutine is resumed, so it should
+ *       live in the coroutine frame or be a temporary in the co_await
+ *       expression. It may be gone by the time the FREE event of the
+ *       request is delivered.
+ *
+ * @param[in] req request to be sent
+ *
+ * @return awaitable giving `ocpp::response` of the request
+ */
+template <typename Request>
+call_awaiter<Request> call(const Request &req) noexcept
+{
+	return call_awaiter<Request>(req);
+}
+
+} /* namespace ocpp */
+
+#endif /* LIBMCU_OCPP_CORO_HPP */
@@ -26,6 +26,9 @@ extern "C" {
 #if !defined(OCPP_DEFAULT_TX_TIMEOUT_SEC)
 #define OCPP_DEFAULT_TX_TIMEOUT_SEC		10
 #endif
+#if !defined(OCPP_STATS_HISTOGRAM_LEN)
+#define OCPP_STATS_HISTOGRAM_LEN		8
+#endif
 
 enum ocpp_event {
 	OCPP_EVENT_MESSAGE_INCOMING,
@@ -34,10 +37,50 @@ enum ocpp_event {
 	/* negative for errors */
 };
 
+#define OCPP_EVENT_MASK_INCOMING		(1u << OCPP_EVENT_MESSAGE_INCOMING)
+#define OCPP_EVENT_MASK_OUTGOING		(1u << OCPP_EVENT_MESSAGE_OUTGOING)
+#define OCPP_EVENT_MASK_FREE			(1u << OCPP_EVENT_MESSAGE_FREE)
+/** negative events, the errors in receiving */
+#define OCPP_EVENT_MASK_ERROR			(1u << 31)
+#define OCPP_EVENT_MASK_ALL			0xffffffffu
+
 typedef int ocpp_event_t;
 typedef void (*ocpp_event_callback_t)(ocpp_event_t event_type,
 		const struct ocpp_message *message, void *ctx);
 
+typedef enum {
+	OCPP_QUEUE_READY,
+	OCPP_QUEUE_WAIT,
+	OCPP_QUEUE_TIMER,
+	OCPP_QUEUE_MAX,
+} ocpp_queue_t;
+
+/**
+ * Histograms are log2-bucketed in seconds. Bucket 0 holds 0 second, bucket n
+ * holds [2^(n-1), 2^n) seconds and the last bucket holds everything above.
+ */
+struct ocpp_message_stats {
+	uint32_t pushed;	/**< accepted into a queue */
+	uint32_t sent;		/**< handed over to `ocpp_send()` successfully */
+	uint32_t retried;	/**< sent again after the first attempt */
+	uint32_t dropped;	/**< given up after running out of attempts */
+	uint32_t errored;	/**< `ocpp_send()` failures and CALLERROR received */
+	uint32_t evicted;	/**< removed to make room or dropped on demand */
+	uint32_t queued[OCPP_STATS_HISTOGRAM_LEN]; /**< ready to first send */
+	uint32_t rtt[OCPP_STATS_HISTOGRAM_LEN]; /**< last send to response */
+	uint32_t late;		/**< requests received not responded in time */
+	/** request received to response pushed by the application */
+	uint32_t handling[OCPP_STATS_HISTOGRAM_LEN];
+};
+
+struct ocpp_stats {
+	struct ocpp_message_stats msg[OCPP_MSG_MAX];
+	struct {
+		uint32_t len;
+		uint32_t high;	/**< high watermark */
+	} queue[OCPP_QUEUE_MAX];
+};
+
 struct ocpp_message {
 	char id[OCPP_MESSAGE_ID_MAXLEN];
 	ocpp_message_role_t role;
@@ -53,6 +96,24 @@ struct ocpp_message {
 	} payload;
 };
 
+/** Predicate selecting messages, e.g. pending ones to drop */
+typedef bool (*ocpp_message_pred_t)(const struct ocpp_message *msg, void *ctx);
+
+/**
+ * @brief Completion of a request pushed by @ref ocpp_push_request_cb.
+ *
+ * @param[in] result 0 when the response is received, -ETIMEDOUT when no
+ *            response after all attempts, -ECANCELED when evicted or dropped
+ *            on demand, or the error from `ocpp_send()` when given up sending
+ * @param[in] response the CALLRESULT or CALLERROR received. NULL if @p result
+ *            is not 0
+ * @param[in] ctx the context given to @ref ocpp_push_request_cb
+ */
+typedef void (*ocpp_request_callback_t)(int result,
+		const struct ocpp_message *response, void *ctx);
+
+struct ocpp_context;
+
 /**
  * @brief Initializes the OCPP module.
  *
@@ -60,6 +121,10 @@ struct ocpp_message {
  * sets up the event callback function that will be called for various OCPP
  * events.
  *
+ * The configuration is reset to the defaults only on the built-in context.
+ * It is shared by all contexts, so it is left as it is when a context
+ * switched to with @ref ocpp_switch_context is initialized.
+ *
  * @param[in] cb The callback function to handle OCPP events.
  * @param[in] cb_ctx A user-defined context that will be passed to the callback
  *            function.
@@ -78,6 +143,33 @@ int ocpp_init(ocpp_event_callback_t cb, void *cb_ctx);
  * @return 0 on success, or a negative error code on failure.
  */
 int ocpp_step(void);
+/**
+ * @brief Run the sending half of @ref ocpp_step.
+ *
+ * It sends the next queued message and handles timeouts, retries, heartbeats
+ * and deferred requests. Together with @ref ocpp_step_rx on another thread, a
+ * slow `ocpp_send()` does not hold back receiving and vice versa. The engine
+ * lock is not held while in `ocpp_send()`.
+ *
+ * @note Call it from one thread at a time. Run it again when
+ *       @ref ocpp_step_rx gets a response, as the next message may be sent
+ *       then.
+ *
+ * @return 0 on success, or a negative error code on failure.
+ */
+int ocpp_step_tx(void);
+/**
+ * @brief Run the receiving half of @ref ocpp_step.
+ *
+ * It calls `ocpp_recv()` without the engine lock held, so `ocpp_recv()` may
+ * block until a message arrives, and then processes the message.
+ *
+ * @note Call it from one thread at a time.
+ *
+ * @return 0 when a message is received, -ENOMSG when nothing to receive,
+ *         otherwise the error from `ocpp_recv()`.
+ */
+int ocpp_step_rx(void);
 
 /**
  * @bref Function to push a request to the OCPP server.
@@ -98,6 +190,28 @@ int ocpp_step(void);
 int ocpp_push_request(ocpp_message_t type, const void *data, size_t datasize,
 		bool force);
 
+/**
+ * @brief Pushes a request to be completed through its own callback.
+ *
+ * It works as @ref ocpp_push_request without `force`, and @p on_done is
+ * called once when the request is done with, before
+ * @ref OCPP_EVENT_MESSAGE_FREE. The event callback still gets the response as
+ * well.
+ *
+ * @note @p on_done is called without the engine lock held, so it may push
+ *       the next request.
+ *
+ * @param[in] type The type of the OCPP message.
+ * @param[in] data Pointer to the data to be sent.
+ * @param[in] datasize The size of the data to be sent.
+ * @param[in] on_done callback to be called on completion. May be NULL
+ * @param[in] ctx context passed to @p on_done
+ *
+ * @return 0 on success, -ENOMEM if the queue is full.
+ */
+int ocpp_push_request_cb(ocpp_message_t type, const void *data,
+		size_t datasize, ocpp_request_callback_t on_done, void *ctx);
+
 /**
  * @brief Pushes a deferred OCPP request.
  *
@@ -127,11 +241,35 @@ int ocpp_push_request_defer(ocpp_message_t type,
  * @param[in] err Boolean flag indicating if the response is an error (true) or
  *            not (false).
  *
- * @return 0 on success, or a negative error code on failure.
+ * @return 0 on success, -ETIMEDOUT if answered by the engine already as
+ *         @ref ocpp_set_response_deadline, or a negative error code on
+ *         failure.
  */
 int ocpp_push_response(const struct ocpp_message *req,
 		const void *data, size_t datasize, bool err);
 
+/**
+ * @brief Set the time for the application to respond to a request received.
+ *
+ * A request of @p type not responded with @ref ocpp_push_response in @p sec
+ * seconds gets answered by the engine: with @p conf if given, otherwise with
+ * a CALLERROR carrying `OCPP_ERROR_INTERNAL` of `ocpp_error_t` as the payload
+ * for the codec to encode as InternalError. A response pushed later than
+ * that is rejected with -ETIMEDOUT. The setting is of the current context
+ * and cleared by `ocpp_init()`.
+ *
+ * @param[in] type The type of the OCPP message.
+ * @param[in] sec time to respond in seconds. 0 to wait indefinitely, the
+ *            default
+ * @param[in] conf default response. NULL to answer with CALLERROR. It should
+ *            stay valid as long as set
+ * @param[in] confsize size of @p conf
+ *
+ * @return 0 on success, -EINVAL if @p type is invalid.
+ */
+int ocpp_set_response_deadline(ocpp_message_t type, uint32_t sec,
+		const void *conf, size_t confsize);
+
 /**
  * @brief Counts the number of pending OCPP requests.
  *
@@ -142,12 +280,30 @@ int ocpp_push_response(const struct ocpp_message *req,
  */
 size_t ocpp_count_pending_requests(void);
 
+/**
+ * @brief Counts the pending messages of a specific type.
+ *
+ * Every message of @p type in the queues is counted, the CALLRESULT and
+ * CALLERROR queued to answer the server as well as the CALLs. A CALL being
+ * sent is counted too, as it is on the wait queue while in `ocpp_send()`.
+ * The count is kept up to date as messages are queued and dequeued, so it is
+ * read without the lock and walking the queues, cheap enough to poll before
+ * pushing.
+ *
+ * @param[in] type The type of OCPP messages to count.
+ *
+ * @return The number of pending messages of @p type, 0 if @p type is invalid.
+ */
+size_t ocpp_count_pending_type(ocpp_message_t type);
+
 /**
  * @brief Drops all pending messages of a specific type from all queues.
  *
  * This function removes and frees all pending OCPP messages of the specified
  * type from the ready, wait, and timer queues. Useful for clearing stale
  * messages (e.g., StatusNotification) after network reconnection.
+ * Requests of the type received and not responded yet are forgotten too, so
+ * that they are no longer answered on the response deadline.
  *
  * @param[in] type The type of OCPP messages to drop.
  *
@@ -155,6 +311,99 @@ size_t ocpp_count_pending_requests(void);
  */
 size_t ocpp_drop_pending_type(ocpp_message_t type);
 
+/**
+ * @brief Drops all pending messages for which a predicate returns true.
+ *
+ * The queues are walked once however many messages are dropped. Messages
+ * being sent are kept as in @ref ocpp_drop_pending_type. Requests received
+ * and not responded yet are given to @p pred as well, as a CALL without
+ * payload, and forgotten if it returns true. They are not counted.
+ *
+ * @param[in] pred predicate called with each pending message. It is called
+ *            with the lock held, so it should not call any `ocpp_*` API.
+ * @param[in] ctx context passed to @p pred
+ *
+ * @return The number of messages dropped.
+ */
+size_t ocpp_drop_pending_if(ocpp_message_pred_t pred, void *ctx);
+
+/**
+ * @brief Get the time at which `ocpp_step()` has work to do next.
+ *
+ * The deadline is the earliest of a message ready to be sent, a response
+ * timeout, a deferred request and the next heartbeat. It may be in the past,
+ * which means `ocpp_step()` should be called right away. Messages from the
+ * server are not taken into account as they are up to the transport.
+ *
+ * @param[out] deadline absolute time in seconds as `time()` gives
+ *
+ * @return 0 for success, -ENOENT if nothing is scheduled.
+ */
+int ocpp_get_next_deadline(time_t *deadline);
+
+/**
+ * @brief Set the kinds of events to be generated.
+ *
+ * Events not in the mask are never generated, not even queued when built
+ * with `OCPP_EVENT_BATCH_LEN`. All events are generated by default.
+ *
+ * @param[in] mask OR of `OCPP_EVENT_MASK_*`
+ */
+void ocpp_set_event_mask(uint32_t mask);
+
+/**
+ * @brief Get a copy of the message and queue statistics.
+ *
+ * Statistics are updated on every queue transition and kept from
+ * `ocpp_init()` or the last `ocpp_reset_stats()`.
+ *
+ * @param[out] stats buffer for the statistics to be copied to
+ *
+ * @return 0 for success, otherwise an error.
+ */
+int ocpp_get_stats(struct ocpp_stats *stats);
+/**
+ * @brief Clear the statistics.
+ *
+ * @note Queue lengths are kept as they are and high watermarks restart from
+ *       the current lengths.
+ */
+void ocpp_reset_stats(void);
+
+/**
+ * @brief Get the size of memory for a context.
+ *
+ * A context holds the whole state of the engine for a charge point. The
+ * engine works on a built-in context unless switched to another with
+ * @ref ocpp_switch_context, so that many charge points are run by one
+ * engine.
+ *
+ * @note The configuration, the trace ring and the capture writer are not in
+ *       a context. They are shared by all the charge points, so a key
+ *       changed for one applies to all of them, and their records are
+ *       mixed in one trace and one capture.
+ *
+ * @return the size in bytes
+ */
+size_t ocpp_compute_context_size(void);
+/**
+ * @brief Switch the context the engine works on.
+ *
+ * A new context should be initialized with `ocpp_init()` after switching to
+ * it. Every other function works on the current context.
+ *
+ * @param[in] ctx memory of @ref ocpp_compute_context_size bytes, suitably
+ *            aligned as from malloc(). NULL for the built-in context
+ *
+ * @note Switching is not synchronized with the engine lock. Do it from the
+ *       thread running the engine. The current context is per thread only
+ *       when built with a thread-local `OCPP_CONTEXT_STORAGE`.
+ *
+ * @return the previous context. NULL for the built-in context.
+ */
+struct ocpp_context *ocpp_switch_context(struct ocpp_context *ctx);
+struct ocpp_context *ocpp_get_context(void);
+
 /**
  * @brief Save the current OCPP context as a snapshot.
  *
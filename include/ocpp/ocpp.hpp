@@ -0,0 +1,130 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_HPP
+#define LIBMCU_OCPP_HPP
+
+#include <type_traits>
+#include <errno.h>
+
+#include "ocpp/traits.hpp"
+
+namespace ocpp {
+
+/**
+ * @brief @ref ocpp_push_request with the type and the size deduced.
+ *
+ * @note @p req should live until the FREE event of it as in the C API.
+ */
+template <typename Request>
+inline int push(const Request &req, bool force = false) noexcept
+{
+	return ocpp_push_request(request_traits<Request>::type,
+			&req, sizeof(req), force);
+}
+
+/** @brief @ref ocpp_push_request_defer with the type and the size deduced. */
+template <typename Request>
+inline int push_defer(const Request &req, uint32_t timer_sec) noexcept
+{
+	return ocpp_push_request_defer(request_traits<Request>::type,
+			&req, sizeof(req), timer_sec);
+}
+
+/** @brief @ref ocpp_push_request_cb with the type and the size deduced. */
+template <typename Request>
+inline int push(const Request &req,
+		ocpp_request_callback_t on_done, void *ctx) noexcept
+{
+	return ocpp_push_request_cb(request_traits<Request>::type,
+			&req, sizeof(req), on_done, ctx);
+}
+
+/**
+ * @brief @ref ocpp_push_response with the size deduced.
+ *
+ * @return -EINVAL if @p conf is not the response of @p req
+ */
+template <typename Conf>
+inline int push_response(const struct ocpp_message &req, const Conf &conf,
+		bool err = false) noexcept
+{
+	if (req.type != conf_traits<Conf>::type) {
+		return -EINVAL;
+	}
+
+	return ocpp_push_response(&req, &conf, sizeof(conf), err);
+}
+
+template <typename Payload, typename Handler>
+inline void call_handler(const struct ocpp_message &msg, Handler &handler)
+{
+	/* no code for the payloads the handler does not take */
+	if constexpr (std::is_invocable_v<Handler &, const Payload &,
+			const struct ocpp_message &>) {
+		if (msg.payload.fmt.data != nullptr) {
+			handler(*static_cast<const Payload *>
+					(msg.payload.fmt.data), msg);
+		}
+	}
+}
+
+template <ocpp_message_t Type, typename Handler>
+inline void visit_message(const struct ocpp_message &msg, Handler &handler)
+{
+	if (msg.role == OCPP_MSG_ROLE_CALL) {
+		call_handler<typename message_traits<Type>::request_type>
+			(msg, handler);
+	} else if (msg.role == OCPP_MSG_ROLE_CALLRESULT) {
+		call_handler<typename message_traits<Type>::conf_type>
+			(msg, handler);
+	}
+}
+
+/**
+ * @brief Calls the overload of @p handler taking the payload of @p msg.
+ *
+ * @p handler is called as `handler(const ocpp::Reset &, msg)` for a Reset
+ * request or `handler(const ocpp::Heartbeat_conf &, msg)` for a Heartbeat
+ * response. Messages without a matching overload are ignored, and CALLERROR
+ * is not visited as it has no typed payload.
+ */
+template <typename Handler>
+inline void visit(const struct ocpp_message &msg, Handler &&handler)
+{
+#define OCPP_VISIT_CASE(name, msgtype)					\
+	case msgtype:							\
+		visit_message<msgtype>(msg, handler);			\
+		break;
+
+	switch (msg.type) {
+	OCPP_MESSAGES(OCPP_VISIT_CASE)
+	case OCPP_MSG_MAX: /* fall through */
+	default:
+		break;
+	}
+
+#undef OCPP_VISIT_CASE
+}
+
+/**
+ * @brief Event callback visiting incoming messages with the handler given as
+ *        the callback context.
+ *
+ * `ocpp_init(ocpp::on_event<MyHandler>, &handler);`
+ */
+template <typename Handler>
+void on_event(ocpp_event_t event_type,
+		const struct ocpp_message *msg, void *ctx)
+{
+	if (event_type == OCPP_EVENT_MESSAGE_INCOMING) {
+		visit(*msg, *static_cast<Handler *>(ctx));
+	}
+}
+
+} /* namespace ocpp */
+
+#endif /* LIBMCU_OCPP_HPP */
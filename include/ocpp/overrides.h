@@ -12,6 +12,7 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct ocpp_message;
 
@@ -41,6 +42,19 @@ int ocpp_send(const struct ocpp_message *msg);
  */
 int ocpp_recv(struct ocpp_message *msg);
 
+/**
+ * @brief Tells if an incoming message is ready to be received.
+ *
+ * A step keeps calling `ocpp_recv()` while this returns positive, up to
+ * `OCPP_RX_BUDGET` messages, and does not call it at all when this returns 0.
+ * Optional. The default returns -ENOTSUP, getting `ocpp_recv()` called once
+ * per step.
+ *
+ * @return positive if a message is ready, 0 if none, or a negative error if
+ *         unknown.
+ */
+int ocpp_recv_ready(void);
+
 /**
  * @brief Generates a unique message ID.
  *
@@ -52,6 +66,18 @@ int ocpp_recv(struct ocpp_message *msg);
  */
 void ocpp_generate_message_id(void *buf, size_t bufsize);
 
+/**
+ * @brief Get a seed of the session prefix of message IDs.
+ *
+ * Called once by the default @ref ocpp_generate_message_id. The weak default
+ * mixes the time and an address, which may be the same on every boot of a
+ * target without a real-time clock. Override it with a hardware random number
+ * generator or a counter kept across boots then.
+ *
+ * @return a value differing from boot to boot
+ */
+uint64_t ocpp_get_random_seed(void);
+
 /**
  * @brief Acquires a lock for OCPP operations.
  *
@@ -65,6 +91,9 @@ int ocpp_unlock(void);
 /**
  * @brief Acquires a lock for OCPP configuration operations.
  *
+ * Writers hold it. Readers take it only when failed to read lock-free
+ * several times in a row.
+ *
  * @return An integer indicating the status of the operation. A return value
  *         of 0 indicates that the lock was successfully acquired, while any
  *         other value indicates an error.
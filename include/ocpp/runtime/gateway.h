@@ -0,0 +1,137 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_RUNTIME_GATEWAY_H
+#define LIBMCU_OCPP_RUNTIME_GATEWAY_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "ocpp/ocpp.h"
+
+/* The number of one-second slots in the timer wheel. It should be a power of
+ * two. Timers further away than that go around the wheel. */
+#if !defined(OCPP_GW_WHEEL_SLOTS)
+#define OCPP_GW_WHEEL_SLOTS			64
+#endif
+/* The most steps in a row for a connection with frames buffered. */
+#if !defined(OCPP_GW_STEP_BUDGET)
+#define OCPP_GW_STEP_BUDGET			8
+#endif
+#if !defined(OCPP_GW_MAX_EVENTS)
+#define OCPP_GW_MAX_EVENTS			64
+#endif
+/* How often a connection is visited without any deadline of the engine, for
+ * the transport to keep the connection alive. */
+#if !defined(OCPP_GW_IDLE_INTERVAL_SEC)
+#define OCPP_GW_IDLE_INTERVAL_SEC		30
+#endif
+
+/**
+ * Transport of a connection. The functions are called from the thread running
+ * @ref ocpp_gw_run.
+ */
+struct ocpp_gw_transport {
+	/** @return the file descriptor to poll. Negative if none. */
+	int (*get_fd)(const void *transport);
+	/** @return POLLIN, POLLOUT or both */
+	short (*get_events)(const void *transport);
+	/** @return 0 for success, otherwise an error */
+	int (*process)(void *transport, short revents);
+	int (*send)(void *transport, const struct ocpp_message *msg);
+	int (*recv)(void *transport, struct ocpp_message *msg);
+	/**
+	 * @return true if messages are buffered already. Optional. When
+	 *         given, `ocpp_recv()` is not called while it returns false.
+	 */
+	bool (*has_pending)(const void *transport);
+};
+
+struct ocpp_gw_conn {
+	struct ocpp_context *ctx;
+	const struct ocpp_gw_transport *api;
+	void *transport;
+
+	int fd; /**< registered in the epoll set */
+	uint32_t events;
+
+	/* in a wheel slot or the due list, unlinked in O(1) on rearming */
+	struct ocpp_gw_conn *next;
+	struct ocpp_gw_conn **pprev; /**< NULL if not armed */
+	time_t expiry;
+};
+
+struct ocpp_gw {
+	int epfd;
+	struct ocpp_gw_conn *wheel[OCPP_GW_WHEEL_SLOTS];
+	struct ocpp_gw_conn *due;
+	time_t tick; /**< the latest second processed */
+	size_t armed;
+};
+
+/**
+ * @brief Transport for @ref ocpp_ws instances.
+ *
+ * Only when `src/runtime/gateway_ws.c` is linked.
+ */
+extern const struct ocpp_gw_transport ocpp_gw_ws_transport;
+
+int ocpp_gw_init(struct ocpp_gw *gw);
+void ocpp_gw_deinit(struct ocpp_gw *gw);
+
+/**
+ * @brief Add a connection of a charge point.
+ *
+ * The context should be initialized already with `ocpp_init()`. It is
+ * stepped right away on the next run.
+ *
+ * @note All the charge points share one configuration, as the engine keeps
+ *       it out of the contexts. Run charge points needing configurations of
+ *       their own in separate processes.
+ *
+ * @param[in] ctx context of the charge point
+ * @param[in] api functions of the transport
+ * @param[in] transport transport instance passed to @p api
+ *
+ * @return 0 for success, otherwise an error.
+ */
+int ocpp_gw_add(struct ocpp_gw *gw, struct ocpp_gw_conn *conn,
+		struct ocpp_context *ctx, const struct ocpp_gw_transport *api,
+		void *transport);
+void ocpp_gw_remove(struct ocpp_gw *gw, struct ocpp_gw_conn *conn);
+
+/**
+ * @brief Get the connection to be stepped as soon as possible.
+ *
+ * Call it after working on the context from outside the runtime, e.g.
+ * pushing a request, or after the transport fd changed on reconnection.
+ */
+void ocpp_gw_kick(struct ocpp_gw *gw, struct ocpp_gw_conn *conn);
+
+/**
+ * @brief Wait for I/O or timers and step the connections ready.
+ *
+ * The context of each connection is switched in for its transport and its
+ * steps, and switched back afterward. `ocpp_send()` and `ocpp_recv()` go
+ * through the transport of the connection being stepped.
+ *
+ * @param[in] timeout_ms the longest time to wait. -1 for no limit
+ *
+ * @return the number of connections stepped, otherwise a negative error.
+ */
+int ocpp_gw_run(struct ocpp_gw *gw, int timeout_ms);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* LIBMCU_OCPP_RUNTIME_GATEWAY_H */
@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_RUNTIME_POOL_H
+#define LIBMCU_OCPP_RUNTIME_POOL_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include "ocpp/runtime/gateway.h"
+
+#if !defined(OCPP_POOL_MAX_WORKERS)
+#define OCPP_POOL_MAX_WORKERS			16
+#endif
+/* The longest a worker sleeps with nothing to do, to notice stopping. */
+#if !defined(OCPP_POOL_POLL_INTERVAL_MS)
+#define OCPP_POOL_POLL_INTERVAL_MS		100
+#endif
+
+struct ocpp_pool_conn {
+	struct ocpp_gw_conn base;
+	struct ocpp_pool_conn *qnext; /**< in a run queue */
+	int state;
+	short revents; /**< events gathered until it runs */
+	uint8_t worker; /**< the worker that ran it last */
+};
+
+struct ocpp_pool_stats {
+	uint64_t busy_ns; /**< time spent on stepping contexts */
+	uint64_t idle_ns; /**< time spent on waiting for work */
+	unsigned long steps;
+	unsigned long steals; /**< contexts taken from other workers */
+	/** busy time over busy and idle time in percent */
+	uint8_t utilization;
+};
+
+struct ocpp_pool_worker {
+	struct ocpp_pool *pool;
+	pthread_t thread;
+	uint8_t id;
+
+	pthread_mutex_t lock; /**< of the run queue */
+	struct ocpp_pool_conn *head;
+	struct ocpp_pool_conn *tail;
+	size_t len;
+	unsigned int polls; /**< odd while handling the events of a poll */
+
+	struct ocpp_pool_stats stats;
+};
+
+struct ocpp_pool {
+	struct ocpp_gw gw; /**< the epoll set and the timer wheel */
+	pthread_mutex_t wheel_lock;
+	int wakeup; /**< eventfd waking up idle workers */
+	bool stop;
+	bool running;
+
+	struct ocpp_pool_worker workers[OCPP_POOL_MAX_WORKERS];
+	uint8_t nworkers;
+	uint8_t next_worker;
+};
+
+/**
+ * @brief Initialize a pool of worker threads stepping charge point contexts.
+ *
+ * Each worker owns a run queue of contexts with work to do, filled with the
+ * ones it finds ready on the shared epoll set and timer wheel, and steals
+ * from the others when out of work. A context is stepped by one worker at a
+ * time and may be stepped by another one next time.
+ *
+ * @note The engine should be built with a thread-local
+ *       `OCPP_CONTEXT_STORAGE` and `ocpp_lock()` should lock per context,
+ *       e.g. a lock looked up with `ocpp_get_context()`. `ocpp_send()` and
+ *       `ocpp_recv()` are defined by the pool, so it does not go together
+ *       with the single-threaded gateway runtime.
+ *
+ * @param[in] nworkers the number of worker threads
+ *
+ * @return 0 for success, otherwise an error.
+ */
+int ocpp_pool_init(struct ocpp_pool *pool, int nworkers);
+void ocpp_pool_deinit(struct ocpp_pool *pool);
+
+int ocpp_pool_start(struct ocpp_pool *pool);
+/**
+ * @brief Stop the workers and wait for them to exit.
+ */
+void ocpp_pool_stop(struct ocpp_pool *pool);
+
+/**
+ * @brief Add a connection of a charge point.
+ *
+ * Same as @ref ocpp_gw_add, sharing one configuration among the charge
+ * points. It can be called while running.
+ */
+int ocpp_pool_add(struct ocpp_pool *pool, struct ocpp_pool_conn *conn,
+		struct ocpp_context *ctx, const struct ocpp_gw_transport *api,
+		void *transport);
+/**
+ * @brief Remove a connection, waiting for its step in progress if any.
+ *
+ * Nothing of the connection is touched by the pool once returned, so it can
+ * be freed right after. It may wait for a worker polling for events up to
+ * @ref OCPP_POOL_POLL_INTERVAL_MS.
+ */
+void ocpp_pool_remove(struct ocpp_pool *pool, struct ocpp_pool_conn *conn);
+/**
+ * @brief Get the connection to be stepped as soon as possible.
+ */
+void ocpp_pool_kick(struct ocpp_pool *pool, struct ocpp_pool_conn *conn);
+
+/**
+ * @brief Get the statistics of a worker.
+ *
+ * @return 0 for success, -EINVAL if no such worker.
+ */
+int ocpp_pool_get_stats(struct ocpp_pool *pool, int worker,
+		struct ocpp_pool_stats *stats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* LIBMCU_OCPP_RUNTIME_POOL_H */
@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_TRACE_H
+#define LIBMCU_OCPP_TRACE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ocpp/type.h"
+
+/* The number of trace records kept in the ring. It should be a power of two.
+ * Tracing is compiled out when it is 0. */
+#if !defined(OCPP_TRACE_LEN)
+#define OCPP_TRACE_LEN				0
+#endif
+
+#define OCPP_TRACE_MAGIC			0x5254434fu /* "OCTR" */
+#define OCPP_TRACE_VERSION			1
+#define OCPP_TRACE_NO_SLOT			0xffffu
+
+typedef enum {
+	OCPP_TRACE_PUT_READY,
+	OCPP_TRACE_PUT_READY_INFRONT,
+	OCPP_TRACE_PUT_WAIT,
+	OCPP_TRACE_PUT_TIMER,
+	OCPP_TRACE_DEL_READY,
+	OCPP_TRACE_DEL_WAIT,
+	OCPP_TRACE_DEL_TIMER,
+	OCPP_TRACE_SEND,
+	OCPP_TRACE_SEND_FAIL,
+	OCPP_TRACE_RETRY,
+	OCPP_TRACE_DROP,
+	OCPP_TRACE_EVICT,
+	OCPP_TRACE_FREE,
+	OCPP_TRACE_RECV_CALL,
+	OCPP_TRACE_RECV_RESULT,
+	OCPP_TRACE_RECV_ERROR,
+	OCPP_TRACE_EVENT_MAX,
+} ocpp_trace_event_t;
+
+struct ocpp_trace_record {
+	uint32_t timestamp;	/**< in microseconds, wraps around */
+	uint16_t slot;		/**< index in the message pool */
+	uint8_t event;		/**< @ref ocpp_trace_event_t */
+	uint8_t type;		/**< @ref ocpp_message_t */
+	uint8_t attempts;	/**< saturated at 255 */
+	uint8_t reserved[3];
+};
+
+/**
+ * A dump is this header followed by `count` records, oldest first. All fields
+ * are in the native byte order of the target.
+ */
+struct ocpp_trace_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t count;
+	uint32_t overwritten;	/**< records lost by wrapping around */
+};
+
+/**
+ * @brief Append a record to the trace ring.
+ *
+ * This function is lock-free. Concurrent writers never block each other. The
+ * oldest record gets overwritten when the ring is full.
+ */
+void ocpp_trace_write(ocpp_trace_event_t event, ocpp_message_t type,
+		uint16_t slot, uint32_t attempts);
+/**
+ * @brief Copy the trace ring out as a dump.
+ *
+ * @param[out] buf buffer for the dump
+ * @param[in] bufsize size of the buffer
+ *
+ * @note The newest records are kept when the buffer is not big enough.
+ *
+ * @return the number of bytes written. 0 if the header does not fit.
+ */
+size_t ocpp_trace_dump(void *buf, size_t bufsize);
+size_t ocpp_compute_trace_dump_size(void);
+void ocpp_trace_clear(void);
+
+/**
+ * @brief Get a timestamp for trace records in microseconds.
+ *
+ * A monotonic clock is used by default. Override it on targets without one.
+ * No default is provided when `OCPP_TRACE_LEN` is 0, as it is not called then.
+ */
+uint32_t ocpp_trace_get_timestamp(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* LIBMCU_OCPP_TRACE_H */
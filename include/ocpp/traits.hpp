@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_TRAITS_HPP
+#define LIBMCU_OCPP_TRAITS_HPP
+
+#include "ocpp/ocpp.h"
+
+/* X(name, type) for every message, `ocpp_<name>` and `ocpp_<name>_conf` being
+ * its request and response */
+#define OCPP_MESSAGES(X)						\
+	X(Authorize, OCPP_MSG_AUTHORIZE)				\
+	X(BootNotification, OCPP_MSG_BOOTNOTIFICATION)			\
+	X(ChangeAvailability, OCPP_MSG_CHANGE_AVAILABILITY)		\
+	X(ChangeConfiguration, OCPP_MSG_CHANGE_CONFIGURATION)		\
+	X(ClearCache, OCPP_MSG_CLEAR_CACHE)				\
+	X(DataTransfer, OCPP_MSG_DATA_TRANSFER)				\
+	X(GetConfiguration, OCPP_MSG_GET_CONFIGURATION)			\
+	X(Heartbeat, OCPP_MSG_HEARTBEAT)				\
+	X(MeterValues, OCPP_MSG_METER_VALUES)				\
+	X(RemoteStartTransaction, OCPP_MSG_REMOTE_START_TRANSACTION)	\
+	X(RemoteStopTransaction, OCPP_MSG_REMOTE_STOP_TRANSACTION)	\
+	X(Reset, OCPP_MSG_RESET)					\
+	X(StartTransaction, OCPP_MSG_START_TRANSACTION)			\
+	X(StatusNotification, OCPP_MSG_STATUS_NOTIFICATION)		\
+	X(StopTransaction, OCPP_MSG_STOP_TRANSACTION)			\
+	X(UnlockConnector, OCPP_MSG_UNLOCK_CONNECTOR)			\
+	X(DiagnosticsStatusNotification, OCPP_MSG_DIAGNOSTICS_NOTIFICATION) \
+	X(FirmwareStatusNotification, OCPP_MSG_FIRMWARE_NOTIFICATION)	\
+	X(GetDiagnostics, OCPP_MSG_GET_DIAGNOSTICS)			\
+	X(UpdateFirmware, OCPP_MSG_UPDATE_FIRMWARE)			\
+	X(GetLocalListVersion, OCPP_MSG_GET_LOCAL_LIST_VERSION)		\
+	X(SendLocalList, OCPP_MSG_SEND_LOCAL_LIST)			\
+	X(CancelReservation, OCPP_MSG_CANCEL_RESERVATION)		\
+	X(ReserveNow, OCPP_MSG_RESERVE_NOW)				\
+	X(ClearChargingProfile, OCPP_MSG_CLEAR_CHARGING_PROFILE)	\
+	X(GetCompositeSchedule, OCPP_MSG_GET_COMPOSITE_SCHEDULE)	\
+	X(SetChargingProfile, OCPP_MSG_SET_CHARGING_PROFILE)		\
+	X(TriggerMessage, OCPP_MSG_TRIGGER_MESSAGE)			\
+	X(CertificateSigned, OCPP_MSG_CERTIFICATE_SIGNED)		\
+	X(DeleteCertificate, OCPP_MSG_DELETE_CERTIFICATE)		\
+	X(ExtendedTriggerMessage, OCPP_MSG_EXTENDED_TRIGGER_MESSAGE)	\
+	X(GetInstalledCertificateIds, OCPP_MSG_GET_INSTALLED_CERTIFICATE_IDS) \
+	X(GetLog, OCPP_MSG_GET_LOG)					\
+	X(InstallCertificate, OCPP_MSG_INSTALL_CERTIFICATE)		\
+	X(LogStatusNotification, OCPP_MSG_LOG_STATUS_NOTIFICATION)	\
+	X(SecurityEventNotification, OCPP_MSG_SECURITY_EVENT_NOTIFICATION) \
+	X(SignCertificate, OCPP_MSG_SIGN_CERTIFICATE)			\
+	X(SignedFirmwareStatusNotification, OCPP_MSG_SIGNED_FIRMWARE_STATUS_NOTIFICATION) \
+	X(SignedUpdateFirmware, OCPP_MSG_SIGNED_UPDATE_FIRMWARE)
+
+namespace ocpp {
+
+/** The message type and the response of a request */
+template <typename Request>
+struct request_traits;
+
+/** The message type of a response */
+template <typename Conf>
+struct conf_traits;
+
+/** The request and the response of a message type */
+template <ocpp_message_t Type>
+struct message_traits;
+
+#define OCPP_DEFINE_TRAITS(name, msgtype)				\
+	using name = ::ocpp_##name;					\
+	using name##_conf = ::ocpp_##name##_conf;			\
+	template <>							\
+	struct request_traits<name> {					\
+		static constexpr ocpp_message_t type = msgtype;		\
+		using conf_type = name##_conf;				\
+	};								\
+	template <>							\
+	struct conf_traits<name##_conf> {				\
+		static constexpr ocpp_message_t type = msgtype;		\
+	};								\
+	template <>							\
+	struct message_traits<msgtype> {				\
+		using request_type = name;				\
+		using conf_type = name##_conf;				\
+	};
+
+OCPP_MESSAGES(OCPP_DEFINE_TRAITS)
+
+#undef OCPP_DEFINE_TRAITS
+
+} /* namespace ocpp */
+
+#endif /* LIBMCU_OCPP_TRAITS_HPP */
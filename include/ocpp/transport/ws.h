@@ -0,0 +1,231 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LIBMCU_OCPP_TRANSPORT_WS_H
+#define LIBMCU_OCPP_TRANSPORT_WS_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "ocpp/ocpp.h"
+
+#if !defined(OCPP_WS_RX_BUFSIZE)
+#define OCPP_WS_RX_BUFSIZE			4096
+#endif
+#if !defined(OCPP_WS_TX_BUFSIZE)
+#define OCPP_WS_TX_BUFSIZE			4096
+#endif
+#if !defined(OCPP_WS_HOST_MAXLEN)
+#define OCPP_WS_HOST_MAXLEN			64
+#endif
+#if !defined(OCPP_WS_PATH_MAXLEN)
+#define OCPP_WS_PATH_MAXLEN			128
+#endif
+#if !defined(OCPP_WS_PROTOCOL)
+#define OCPP_WS_PROTOCOL			"ocpp1.6"
+#endif
+
+typedef enum {
+	OCPP_WS_STATE_CLOSED,
+	OCPP_WS_STATE_CONNECTING,	/**< TCP connection in progress */
+	OCPP_WS_STATE_TLS_HANDSHAKE,
+	OCPP_WS_STATE_HANDSHAKE,	/**< HTTP upgrade in progress */
+	OCPP_WS_STATE_OPEN,
+	OCPP_WS_STATE_CLOSING,		/**< close frame sent */
+} ocpp_ws_state_t;
+
+/**
+ * Converts between `struct ocpp_message` and OCPP-J text. The library has no
+ * JSON codec of its own, so it is up to the application.
+ */
+struct ocpp_ws_codec {
+	/**
+	 * @return the length of the text written into @p buf, otherwise a
+	 *         negative error.
+	 */
+	int (*encode)(const struct ocpp_message *msg,
+			char *buf, size_t bufsize, void *ctx);
+	/**
+	 * @param[in] text null-terminated text of @p len bytes
+	 * @param[out] msg the message. The payload is owned by the codec and
+	 *             should stay valid until the next decode.
+	 *
+	 * @return 0 for success, otherwise an error. -ENOTSUP for requests
+	 *         not supported, to be answered with CALLERROR by the engine.
+	 */
+	int (*decode)(const char *text, size_t len,
+			struct ocpp_message *msg, void *ctx);
+	void *ctx;
+};
+
+/**
+ * TLS hook for wss://. The functions work on the connected socket, which is
+ * non-blocking, and return -EAGAIN when they would block.
+ */
+struct ocpp_ws_tls {
+	/** @return 0 when done, -EAGAIN in progress, otherwise an error. */
+	int (*handshake)(int fd, void *ctx);
+	ssize_t (*read)(int fd, void *buf, size_t bufsize, void *ctx);
+	ssize_t (*write)(int fd, const void *data, size_t datasize, void *ctx);
+	void (*close)(int fd, void *ctx);
+	void *ctx;
+};
+
+struct ocpp_ws_param {
+	const char *host;	/**< numeric address or host name */
+	uint16_t port;
+	const char *path;	/**< e.g. "/ocpp/CP001" */
+	const char *protocol;	/**< NULL for @ref OCPP_WS_PROTOCOL */
+	const char *authorization; /**< value of the header. NULL if none */
+	uint32_t ping_interval_sec; /**< 0 to disable */
+};
+
+struct ocpp_ws {
+	ocpp_ws_state_t state;
+	int fd;
+
+	struct ocpp_ws_param param;
+	char host[OCPP_WS_HOST_MAXLEN];
+	char path[OCPP_WS_PATH_MAXLEN];
+	struct ocpp_ws_codec codec;
+	struct ocpp_ws_tls tls;
+	bool has_tls;
+
+	char key[25]; /**< Sec-WebSocket-Key */
+	uint64_t last_ping_ms;
+
+	uint8_t rx[OCPP_WS_RX_BUFSIZE + 1];
+	size_t rx_len;
+	bool eof; /**< closed by the peer with frames still buffered */
+	size_t frag_len; /**< of a fragmented message at the start of rx */
+	uint8_t frag_opcode; /**< of a fragmented message. 0 if none */
+	uint8_t tx[OCPP_WS_TX_BUFSIZE];
+	size_t tx_len;
+};
+
+/**
+ * @brief Initialize a WebSocket transport instance.
+ *
+ * @param[in] tls TLS hook. NULL for plain ws://
+ *
+ * @return 0 for success, otherwise an error.
+ */
+int ocpp_ws_init(struct ocpp_ws *ws, const struct ocpp_ws_param *param,
+		const struct ocpp_ws_codec *codec, const struct ocpp_ws_tls *tls);
+/**
+ * @brief Start connecting to the server without blocking.
+ *
+ * The connection and the handshakes proceed in @ref ocpp_ws_process.
+ *
+ * @note Name resolution blocks. Give a numeric address not to block at all.
+ *
+ * @return 0 for success, otherwise an error.
+ */
+int ocpp_ws_connect(struct ocpp_ws *ws);
+/**
+ * @brief Close the connection, with a close frame if open.
+ */
+void ocpp_ws_close(struct ocpp_ws *ws);
+
+int ocpp_ws_get_fd(const struct ocpp_ws *ws);
+/**
+ * @brief Get the poll events the transport is waiting for.
+ *
+ * @return POLLIN, POLLOUT or both. 0 if closed.
+ */
+short ocpp_ws_get_events(const struct ocpp_ws *ws);
+ocpp_ws_state_t ocpp_ws_get_state(const struct ocpp_ws *ws);
+bool ocpp_ws_is_connected(const struct ocpp_ws *ws);
+/**
+ * @brief Tell if a whole frame is in the receive buffer already.
+ *
+ * @return true if @ref ocpp_ws_recv gets to a frame without reading more
+ */
+bool ocpp_ws_has_frame(const struct ocpp_ws *ws);
+
+/**
+ * @brief Drive the connection with the events returned from poll().
+ *
+ * It connects, runs the handshakes, reads into the receive buffer, flushes
+ * the transmit buffer and sends pings. It never blocks.
+ *
+ * @param[in] revents events from poll(). 0 to just try
+ *
+ * @return 0 for success, otherwise an error. The connection is closed on
+ *         errors.
+ */
+int ocpp_ws_process(struct ocpp_ws *ws, short revents);
+/**
+ * @brief Wait for I/O or the next engine deadline and process the I/O.
+ *
+ * The timeout is cut down to the deadline from `ocpp_get_next_deadline()` and
+ * to the next ping, so a loop of this and `ocpp_step()` drives both I/O and
+ * timers.
+ *
+ * @param[in] timeout_ms the longest time to wait. -1 for no limit
+ *
+ * @return 0 for success, otherwise an error.
+ */
+int ocpp_ws_poll(struct ocpp_ws *ws, int timeout_ms);
+
+/**
+ * @brief Encode a message and queue it as a text frame.
+ *
+ * @return 0 for success, -ENOTCONN if not open, -ENOBUFS if the transmit
+ *         buffer is full, otherwise an error.
+ */
+int ocpp_ws_send(struct ocpp_ws *ws, const struct ocpp_message *msg);
+/**
+ * @brief Decode the next text message received.
+ *
+ * Control frames are handled internally on the way. A fragmented message is
+ * put together in the receive buffer, so it is closed with 1009 only when the
+ * whole message does not fit in @ref OCPP_WS_RX_BUFSIZE.
+ *
+ * @return 0 for success, -ENOMSG if no complete frame, -ENOTCONN if not open,
+ *         otherwise an error from the codec.
+ */
+int ocpp_ws_recv(struct ocpp_ws *ws, struct ocpp_message *msg);
+
+/**
+ * @brief Set the instance that `ocpp_send()` and `ocpp_recv()` go through.
+ *
+ * Only when the overrides in `src/transport/ws_overrides.c` are linked.
+ */
+void ocpp_ws_bind(struct ocpp_ws *ws);
+struct ocpp_ws *ocpp_ws_get_bound(void);
+
+/**
+ * @brief Lock an instance for the time of a call to it.
+ *
+ * The receive and transmit buffers are shared by the calls, e.g. a pong is
+ * queued in @ref ocpp_ws_recv. The weak defaults do nothing, which is fine
+ * when all the calls are made from one thread. Override them with a lock of
+ * the instance when not, e.g. with `ocpp_step_tx()` and `ocpp_step_rx()` on
+ * different threads.
+ */
+void ocpp_ws_lock(struct ocpp_ws *ws);
+void ocpp_ws_unlock(struct ocpp_ws *ws);
+
+/**
+ * @brief Get random bytes for masking keys and handshake keys.
+ *
+ * A weak default based on the monotonic clock is provided. Override it with a
+ * proper source of randomness on the target.
+ */
+uint32_t ocpp_ws_get_random(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* LIBMCU_OCPP_TRANSPORT_WS_H */
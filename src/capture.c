@@ -0,0 +1,160 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ocpp/capture.h"
+#include <errno.h>
+#include <string.h>
+
+#if OCPP_CAPTURE
+#include "timestamp.h"
+#endif
+
+static struct {
+	ocpp_capture_writer_t writer;
+	void *ctx;
+	int64_t time;
+	bool time_written;
+} m;
+
+#if OCPP_CAPTURE
+uint32_t __attribute__((weak)) ocpp_capture_get_timestamp(void)
+{
+	return get_monotonic_us();
+}
+#endif
+
+/* never called with the capture disabled as no writer is set */
+static uint32_t get_timestamp(void)
+{
+#if OCPP_CAPTURE
+	return ocpp_capture_get_timestamp();
+#else
+	return 0;
+#endif
+}
+
+static void write_record(const struct ocpp_capture_record *rec,
+		const void *id, const void *data)
+{
+	(*m.writer)(rec, sizeof(*rec), m.ctx);
+
+	if (rec->idlen) {
+		(*m.writer)(id, rec->idlen, m.ctx);
+	}
+	if (rec->size) {
+		(*m.writer)(data, rec->size, m.ctx);
+	}
+}
+
+int ocpp_capture_start(ocpp_capture_writer_t writer, void *ctx)
+{
+#if OCPP_CAPTURE
+	const struct ocpp_capture_header hdr = {
+		.magic = OCPP_CAPTURE_MAGIC,
+		.version = OCPP_CAPTURE_VERSION,
+		.record_size = sizeof(struct ocpp_capture_record),
+		.id_maxlen = OCPP_MESSAGE_ID_MAXLEN,
+	};
+
+	if (writer == NULL) {
+		return -EINVAL;
+	}
+
+	int err = (*writer)(&hdr, sizeof(hdr), ctx);
+
+	if (err == 0) {
+		m.writer = writer;
+		m.ctx = ctx;
+		m.time_written = false;
+	}
+
+	return err;
+#else
+	(void)writer;
+	(void)ctx;
+	return -ENOTSUP;
+#endif
+}
+
+void ocpp_capture_stop(void)
+{
+	m.writer = NULL;
+}
+
+void ocpp_capture_write(ocpp_capture_kind_t kind,
+		const struct ocpp_message *msg, int rc, uint32_t arg,
+		uint8_t flags)
+{
+	struct ocpp_capture_record rec = {
+		.timestamp = 0,
+		.rc = rc,
+		.arg = arg,
+		.kind = (uint8_t)kind,
+		.flags = flags,
+	};
+
+	if (m.writer == NULL) {
+		return;
+	}
+
+	rec.timestamp = get_timestamp();
+
+	if (msg == NULL) {
+		write_record(&rec, NULL, NULL);
+		return;
+	}
+
+	rec.role = (uint8_t)msg->role;
+	rec.type = (uint8_t)msg->type;
+	rec.idlen = (uint8_t)strnlen(msg->id, sizeof(msg->id));
+	rec.size = (uint16_t)(msg->payload.size > UINT16_MAX?
+			UINT16_MAX : msg->payload.size);
+
+	if (msg->payload.fmt.data == NULL) {
+		rec.size = 0;
+	}
+
+	write_record(&rec, msg->id, msg->payload.fmt.data);
+}
+
+void ocpp_capture_time(time_t now)
+{
+	const int64_t t = (int64_t)now;
+	struct ocpp_capture_record rec = {
+		.kind = OCPP_CAPTURE_TIME,
+		.size = sizeof(t),
+	};
+
+	if (m.writer == NULL || (m.time_written && m.time == t)) {
+		return;
+	}
+
+	m.time = t;
+	m.time_written = true;
+	rec.timestamp = get_timestamp();
+
+	write_record(&rec, NULL, &t);
+}
+
+void ocpp_capture_config(const char *keystr,
+		const void *value, size_t value_size)
+{
+	const size_t keylen = strlen(keystr);
+	struct ocpp_capture_record rec = {
+		.kind = OCPP_CAPTURE_CONFIG,
+		.idlen = (uint8_t)(keylen > UINT8_MAX? UINT8_MAX : keylen),
+		.size = (uint16_t)(value_size > UINT16_MAX?
+				UINT16_MAX : value_size),
+	};
+
+	if (m.writer == NULL) {
+		return;
+	}
+
+	rec.timestamp = get_timestamp();
+
+	write_record(&rec, keystr, value);
+}
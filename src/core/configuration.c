@@ -6,6 +6,8 @@
 
 #include "ocpp/core/configuration.h"
 #include "ocpp/overrides.h"
+#include "ocpp/capture.h"
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 
@@ -17,6 +19,17 @@
 #define OCPP_CONFIGURATION_DEFINES	"ocpp_configuration.def.template"
 #endif
 
+/* lock-free reads retried before taking the lock, as a writer preempted by
+ * the reader would never get to finish on a single core */
+#if !defined(OCPP_CONFIGURATION_READ_RETRIES)
+#define OCPP_CONFIGURATION_READ_RETRIES	8
+#endif
+
+/* the number of configuration change subscriptions */
+#if !defined(OCPP_CONFIGURATION_OBSERVERS_MAX)
+#define OCPP_CONFIGURATION_OBSERVERS_MAX	8
+#endif
+
 #if !defined(MIN)
 #define MIN(a, b)			(((a) > (b))? (b) : (a))
 #endif
@@ -28,14 +41,14 @@
 #define STR				CONF_SIZE
 
 typedef enum {
-#define OCPP_CONFIG(key, accessbility, type, default_value)	key,
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	key,
 #include OCPP_CONFIGURATION_DEFINES
 #undef OCPP_CONFIG
 	CONFIGURATION_MAX,
 	UnknownConfiguration,
 } configuration_t;
 
-#define OCPP_CONFIG(key, accessbility, type, default_value)	+ type
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	+ type
 static uint8_t configurations_pool[0
 #include OCPP_CONFIGURATION_DEFINES
 ];
@@ -45,11 +58,90 @@ static struct ocpp_configuration {
 	uint8_t *value;
 } configurations[CONFIGURATION_MAX];
 
+/* odd while being written. Readers retry if it has changed while reading. */
+static uint32_t seqcount;
+
+/* keys changed since saved last time */
+static uint8_t dirty[(CONFIGURATION_MAX + 7) / 8];
+
+/* the largest value in size */
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	\
+	uint8_t key[type];
+union configuration_value {
+#include OCPP_CONFIGURATION_DEFINES
+};
+#undef OCPP_CONFIG
+
+struct subscription {
+	configuration_t key; /**< CONFIGURATION_MAX for all keys */
+	ocpp_configuration_observer_t cb;
+	void *ctx;
+};
+
+static struct subscription subscriptions[OCPP_CONFIGURATION_OBSERVERS_MAX];
+
+/* the longest key string in size */
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	\
+	char key[sizeof(#key)];
+union configuration_keystr {
+#include OCPP_CONFIGURATION_DEFINES
+};
+#undef OCPP_CONFIG
+
+/* A record describes itself with the key string, the type and the value
+ * length, so it is still loaded after keys are added or removed. The index of
+ * the key is a hint to find the key without searching. The check byte tells a
+ * record torn by power loss. Erased flash of 0xff reads as an invalid record,
+ * ending the log.
+ *
+ * | check | index(2) | type | keystr length | value length | keystr | value |
+ */
+#define RECORD_HEADER_SIZE		6
+
+struct record {
+	uint8_t buf[RECORD_HEADER_SIZE + sizeof(union configuration_keystr)
+		+ sizeof(union configuration_value)];
+	size_t len;
+};
+
+/* | magic(4) | version | reserved | count(2) | schema(4) | records... | */
+#define BLOB_HEADER_SIZE		12
+#define BLOB_VERSION			1
+
+static const uint8_t blob_magic[4] = { 'O', 'C', 'P', 'C' };
+
 static const char * const confstr[] = {
-#define OCPP_CONFIG(key, accessbility, type, default_value)	[key] = #key,
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	[key] = #key,
+#include OCPP_CONFIGURATION_DEFINES
+#undef OCPP_CONFIG
+};
+
+/* Constraints given after the default value in the definitions. A value in
+ * ONEOF is allowed even out of RANGE, e.g. 0 to disable. */
+struct constraint {
+	configuration_t id; /**< keeping the initializer not empty */
+	bool ranged;
+	bool reboot; /**< takes effect after reboot */
+	uint8_t oneof_len;
+	int min;
+	int max;
+	const int *oneof;
+};
+
+#define RANGE(from, to)			.ranged = true, .min = (from), .max = (to)
+#define ONEOF(...)			.oneof = (const int []) { __VA_ARGS__ }, \
+	.oneof_len = (uint8_t)(sizeof((const int []) { __VA_ARGS__ }) \
+			/ sizeof(int))
+#define REBOOT				.reboot = true
+static const struct constraint constraints[CONFIGURATION_MAX] = {
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	\
+	[key] = { .id = key, __VA_ARGS__ },
 #include OCPP_CONFIGURATION_DEFINES
 #undef OCPP_CONFIG
 };
+#undef REBOOT
+#undef ONEOF
+#undef RANGE
 
 static ocpp_configuration_data_t get_value_type(configuration_t key)
 {
@@ -63,7 +155,7 @@ static ocpp_configuration_data_t get_value_type(configuration_t key)
 #define INT CONF_SIZE(OCPP_CONF_TYPE_INT)
 #define CSL CONF_SIZE(OCPP_CONF_TYPE_CSL)
 #define STR STR_TYPE
-#define OCPP_CONFIG(key, accessbility, type, default_value)	\
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	\
 	[key] = type,
 #include OCPP_CONFIGURATION_DEFINES
 #undef OCPP_CONFIG
@@ -82,7 +174,7 @@ static size_t get_value_cap(configuration_t key)
 #define INT CONF_SIZE(sizeof(int))
 #define CSL CONF_SIZE(sizeof(int))
 #define STR CONF_SIZE
-#define OCPP_CONFIG(key, accessbility, type, default_value)	\
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	\
 	[key] = type,
 #include OCPP_CONFIGURATION_DEFINES
 #undef OCPP_CONFIG
@@ -117,7 +209,7 @@ static void set_default_value(void)
 #define INT CONF_SIZE(sizeof(int))
 #define CSL CONF_SIZE(sizeof(int))
 #define STR CONF_SIZE
-#define OCPP_CONFIG(key, accessbility, type, default_value)	\
+#define OCPP_CONFIG(key, accessbility, type, default_value, ...)	\
 	switch (get_value_type(key)) { \
 	case OCPP_CONF_TYPE_STR: \
 		v.v_STR = (const char *)(default_value); \
@@ -155,7 +247,7 @@ static bool is_readable(configuration_t key)
 #define R					true
 #define W					false
 #define RW					true
-#define OCPP_CONFIG(key, accessbility, type, value)	\
+#define OCPP_CONFIG(key, accessbility, type, value, ...)	\
 	case key: return accessbility;
 #include OCPP_CONFIGURATION_DEFINES
 #undef OCPP_CONFIG
@@ -175,7 +267,7 @@ static bool is_writable(configuration_t key)
 #define R					false
 #define W					true
 #define RW					true
-#define OCPP_CONFIG(key, accessbility, type, value)	\
+#define OCPP_CONFIG(key, accessbility, type, value, ...)	\
 	case key: return accessbility;
 #include OCPP_CONFIGURATION_DEFINES
 #undef OCPP_CONFIG
@@ -200,6 +292,48 @@ static configuration_t get_key_from_keystr(const char * const keystr)
 	return UnknownConfiguration;
 }
 
+/* Called with the lock held as writers still exclude one another with it. */
+static void begin_write(void)
+{
+	__atomic_store_n(&seqcount, seqcount + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(void)
+{
+	__atomic_store_n(&seqcount, seqcount + 1, __ATOMIC_RELEASE);
+}
+
+static void store_value(uint8_t *dst, const void *src, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		__atomic_store_n(&dst[i], ((const uint8_t *)src)[i],
+				__ATOMIC_RELAXED);
+	}
+}
+
+static void load_value_bytes(void *dst, const uint8_t *src, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		((uint8_t *)dst)[i] = __atomic_load_n(&src[i],
+				__ATOMIC_RELAXED);
+	}
+}
+
+static bool try_read_value(configuration_t key, void *buf, size_t len)
+{
+	const uint32_t seq = __atomic_load_n(&seqcount, __ATOMIC_ACQUIRE);
+
+	if (seq & 1) {
+		return false;
+	}
+
+	load_value_bytes(buf, configurations[key].value, len);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&seqcount, __ATOMIC_RELAXED) == seq;
+}
+
 static int get_configuration(configuration_t key,
 		void *buf, size_t bufsize, bool *readonly)
 {
@@ -211,12 +345,274 @@ static int get_configuration(configuration_t key,
 		*readonly = !is_writable(key) && is_readable(key);
 	}
 
-	memcpy(buf, configurations[key].value,
-			MIN(get_value_cap(key), bufsize));
+	const size_t len = MIN(get_value_cap(key), bufsize);
+
+	for (int i = 0; i < OCPP_CONFIGURATION_READ_RETRIES; i++) {
+		if (try_read_value(key, buf, len)) {
+			return 0;
+		}
+	}
+
+	ocpp_configuration_lock();
+	memcpy(buf, configurations[key].value, len);
+	ocpp_configuration_unlock();
 
 	return 0;
 }
 
+static void set_dirty(configuration_t key, bool set)
+{
+	const uint8_t bit = (uint8_t)(1u << (key % 8));
+
+	if (set) {
+		dirty[key / 8] |= bit;
+	} else {
+		dirty[key / 8] &= (uint8_t)~bit;
+	}
+}
+
+static bool is_dirty(configuration_t key)
+{
+	return (dirty[key / 8] & (1u << (key % 8))) != 0;
+}
+
+static uint8_t compute_record_check(const uint8_t *rec, size_t len)
+{
+	uint8_t sum = 0xa5;
+
+	for (size_t i = 1; i < len; i++) {
+		sum = (uint8_t)((sum << 1 | sum >> 7) ^ rec[i]);
+	}
+
+	return sum;
+}
+
+static void make_record(struct record *rec, configuration_t key)
+{
+	const size_t keylen = strlen(confstr[key]);
+	const size_t len = get_value_cap(key);
+	const ocpp_configuration_data_t type = get_value_type(key);
+	uint8_t *p = rec->buf;
+
+	p[1] = (uint8_t)key;
+	p[2] = (uint8_t)(key >> 8);
+	p[3] = (uint8_t)type;
+	p[4] = (uint8_t)keylen;
+	p[5] = (uint8_t)len;
+	memcpy(&p[RECORD_HEADER_SIZE], confstr[key], keylen);
+	memcpy(&p[RECORD_HEADER_SIZE + keylen], configurations[key].value, len);
+	rec->len = RECORD_HEADER_SIZE + keylen + len;
+	p[0] = compute_record_check(p, rec->len);
+}
+
+static bool is_key(configuration_t key, const uint8_t *keystr, size_t keylen)
+{
+	return strncmp(confstr[key], (const char *)keystr, keylen) == 0 &&
+		confstr[key][keylen] == '\0';
+}
+
+/* Keys are likely in the same order even after some added or removed, so the
+ * search starts from the index hint and then the one next to the last found,
+ * keeping the whole load linear. */
+static configuration_t find_key(uint16_t hint, const uint8_t *keystr,
+		size_t keylen, configuration_t *next, bool same_schema)
+{
+	if (hint < CONFIGURATION_MAX &&
+			(same_schema || is_key(hint, keystr, keylen))) {
+		*next = (configuration_t)(hint + 1);
+		return hint;
+	}
+
+	for (size_t i = 0; i < CONFIGURATION_MAX; i++) {
+		const configuration_t key = (configuration_t)
+			(((size_t)*next + i) % CONFIGURATION_MAX);
+
+		if (is_key(key, keystr, keylen)) {
+			*next = (configuration_t)(key + 1);
+			return key;
+		}
+	}
+
+	return UnknownConfiguration;
+}
+
+static void load_value(configuration_t key, ocpp_configuration_data_t type,
+		const uint8_t *value, size_t len)
+{
+	const size_t cap = get_value_cap(key);
+
+	if (type != get_value_type(key)) {
+		return; /* the default kept */
+	}
+
+	if (type == OCPP_CONF_TYPE_STR) {
+		memset(configurations[key].value, 0, cap);
+		memcpy(configurations[key].value, value, MIN(len, cap - 1));
+	} else if (len == cap) {
+		memcpy(configurations[key].value, value, len);
+	}
+}
+
+/* Returns the record length, or 0 if not a valid record. A record of a key no
+ * longer exists is skipped. */
+static size_t apply_record(const uint8_t *p, size_t len,
+		configuration_t *next, bool same_schema)
+{
+	if (len < RECORD_HEADER_SIZE) {
+		return 0;
+	}
+
+	const uint16_t hint = (uint16_t)(p[1] | p[2] << 8);
+	const ocpp_configuration_data_t type = (ocpp_configuration_data_t)p[3];
+	const size_t keylen = p[4];
+	const size_t vlen = p[5];
+	const size_t reclen = RECORD_HEADER_SIZE + keylen + vlen;
+
+	if (keylen == 0 || len < reclen ||
+			p[0] != compute_record_check(p, reclen)) {
+		return 0;
+	}
+
+	const configuration_t key = find_key(hint,
+			&p[RECORD_HEADER_SIZE], keylen, next, same_schema);
+
+	if (key != UnknownConfiguration) {
+		load_value(key, type, &p[RECORD_HEADER_SIZE + keylen], vlen);
+	}
+
+	return reclen;
+}
+
+/* Returns the number of bytes of the valid records. */
+static size_t apply_records(const uint8_t *p, size_t len, size_t maxcount,
+		bool same_schema)
+{
+	configuration_t next = 0;
+	size_t offset = 0;
+
+	for (size_t i = 0; i < maxcount && offset < len; i++) {
+		const size_t reclen = apply_record(&p[offset],
+				len - offset, &next, same_schema);
+
+		if (reclen == 0) {
+			break;
+		}
+
+		offset += reclen;
+	}
+
+	return offset;
+}
+
+static void load_defaults(void)
+{
+	memset(&configurations_pool, 0, sizeof(configurations_pool));
+	link_configuration_pool();
+	set_default_value();
+	memset(dirty, 0, sizeof(dirty));
+}
+
+/* FNV-1a of the keys with their types and sizes */
+static uint32_t compute_schema(void)
+{
+	uint32_t hash = 0x811c9dc5u;
+
+	for (configuration_t i = 0; i < CONFIGURATION_MAX; i++) {
+		const ocpp_configuration_data_t type = get_value_type(i);
+		const size_t cap = get_value_cap(i);
+		const uint8_t desc[2] = { (uint8_t)type, (uint8_t)cap, };
+
+		for (const char *c = confstr[i]; *c; c++) {
+			hash = (hash ^ (uint8_t)*c) * 0x01000193u;
+		}
+		for (size_t j = 0; j < sizeof(desc); j++) {
+			hash = (hash ^ desc[j]) * 0x01000193u;
+		}
+	}
+
+	return hash;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++) {
+		p[i] = (uint8_t)(v >> (i * 8));
+	}
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int save_configuration(ocpp_configuration_writer_t writer, void *ctx,
+		bool all)
+{
+	struct record rec;
+	size_t written = 0;
+
+	if (writer == NULL) {
+		return -EINVAL;
+	}
+
+	for (configuration_t i = 0; i < CONFIGURATION_MAX; i++) {
+		ocpp_configuration_lock();
+		const bool changed = is_dirty(i);
+		if (all || changed) {
+			make_record(&rec, i);
+			set_dirty(i, false);
+		}
+		ocpp_configuration_unlock();
+
+		if (!all && !changed) {
+			continue;
+		}
+
+		/* written without the lock as flash may take long */
+		const int err = (*writer)(rec.buf, rec.len, ctx);
+
+		if (err < 0) {
+			ocpp_configuration_lock();
+			set_dirty(i, changed);
+			ocpp_configuration_unlock();
+			return err;
+		}
+
+		written += rec.len;
+	}
+
+	return (int)written;
+}
+
+int ocpp_save_configuration(ocpp_configuration_writer_t writer, void *ctx)
+{
+	return save_configuration(writer, ctx, false);
+}
+
+int ocpp_compact_configuration(ocpp_configuration_writer_t writer, void *ctx)
+{
+	return save_configuration(writer, ctx, true);
+}
+
+int ocpp_load_configuration(const void *log, size_t logsize)
+{
+	const uint8_t *p = (const uint8_t *)log;
+
+	if (log == NULL && logsize > 0) {
+		return -EINVAL;
+	}
+
+	ocpp_configuration_lock();
+	begin_write();
+	load_defaults();
+	const size_t len = apply_records(p, logsize, SIZE_MAX, false);
+	end_write();
+	ocpp_configuration_unlock();
+
+	return (int)len;
+}
+
 bool ocpp_has_configuration(const char * const keystr)
 {
 	return get_key_from_keystr(keystr) != UnknownConfiguration;
@@ -239,10 +635,13 @@ int ocpp_copy_configuration_from(const void *data, size_t datasize)
 	}
 
 	ocpp_configuration_lock();
+	begin_write();
 
 	memcpy(configurations_pool, data, datasize);
 	link_configuration_pool();
+	memset(dirty, 0xff, sizeof(dirty));
 
+	end_write();
 	ocpp_configuration_unlock();
 
 	return 0;
@@ -261,10 +660,142 @@ int ocpp_copy_configuration_to(void *buf, size_t bufsize)
 	return 0;
 }
 
+uint32_t ocpp_get_configuration_schema(void)
+{
+	return compute_schema();
+}
+
+size_t ocpp_compute_configuration_blob_size(void)
+{
+	size_t size = BLOB_HEADER_SIZE;
+
+	for (configuration_t i = 0; i < CONFIGURATION_MAX; i++) {
+		size += RECORD_HEADER_SIZE + strlen(confstr[i]) +
+			get_value_cap(i);
+	}
+
+	return size;
+}
+
+int ocpp_serialize_configuration(void *buf, size_t bufsize)
+{
+	uint8_t *p = (uint8_t *)buf;
+	size_t offset = BLOB_HEADER_SIZE;
+	struct record rec;
+
+	if (buf == NULL || bufsize < ocpp_compute_configuration_blob_size()) {
+		return -EINVAL;
+	}
+
+	memcpy(p, blob_magic, sizeof(blob_magic));
+	p[4] = BLOB_VERSION;
+	p[5] = 0;
+	p[6] = (uint8_t)CONFIGURATION_MAX;
+	p[7] = (uint8_t)(CONFIGURATION_MAX >> 8);
+	put_u32(&p[8], compute_schema());
+
+	ocpp_configuration_lock();
+	for (configuration_t i = 0; i < CONFIGURATION_MAX; i++) {
+		make_record(&rec, i);
+		memcpy(&p[offset], rec.buf, rec.len);
+		offset += rec.len;
+	}
+	ocpp_configuration_unlock();
+
+	return (int)offset;
+}
+
+int ocpp_deserialize_configuration(const void *data, size_t datasize)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	if (data == NULL || datasize < BLOB_HEADER_SIZE ||
+			memcmp(p, blob_magic, sizeof(blob_magic)) != 0) {
+		return -EINVAL;
+	}
+	if (p[4] != BLOB_VERSION) {
+		return -ENOTSUP;
+	}
+
+	const size_t count = (size_t)(p[6] | p[7] << 8);
+	/* no need to compare the key strings written by the same firmware */
+	const bool same_schema = get_u32(&p[8]) == compute_schema();
+
+	ocpp_configuration_lock();
+	begin_write();
+	load_defaults();
+	apply_records(&p[BLOB_HEADER_SIZE], datasize - BLOB_HEADER_SIZE,
+			count, same_schema);
+	end_write();
+	ocpp_configuration_unlock();
+
+	return 0;
+}
+
+static size_t get_subscriptions(configuration_t key, struct subscription *p)
+{
+	size_t n = 0;
+
+	for (int i = 0; i < OCPP_CONFIGURATION_OBSERVERS_MAX; i++) {
+		const struct subscription *sub = &subscriptions[i];
+
+		if (sub->cb && (sub->key == key ||
+				sub->key == CONFIGURATION_MAX)) {
+			p[n++] = *sub;
+		}
+	}
+
+	return n;
+}
+
+static int notify_change(configuration_t key, const struct subscription *subs,
+		size_t n, const void *old_value, const void *new_value)
+{
+	int rc = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		if ((*subs[i].cb)(confstr[key], old_value, new_value,
+				get_value_cap(key), subs[i].ctx) ==
+				OCPP_CONFIGURATION_REBOOT_REQUIRED) {
+			rc = OCPP_CONFIGURATION_REBOOT_REQUIRED;
+		}
+	}
+
+	return rc;
+}
+
+/* Constraints apply to integers only. */
+static bool is_valid_value(configuration_t key,
+		const void *value, size_t value_size)
+{
+	const struct constraint *c = &constraints[key];
+	int v = 0;
+
+	if (get_value_type(key) != OCPP_CONF_TYPE_INT ||
+			(!c->ranged && c->oneof_len == 0)) {
+		return true;
+	}
+
+	memcpy(&v, value, MIN(value_size, sizeof(v)));
+
+	for (uint8_t i = 0; i < c->oneof_len; i++) {
+		if (v == c->oneof[i]) {
+			return true;
+		}
+	}
+
+	return c->ranged && v >= c->min && v <= c->max;
+}
+
 int ocpp_set_configuration(const char * const keystr,
 		const void *value, size_t value_size)
 {
 	configuration_t key = get_key_from_keystr(keystr);
+	struct subscription subs[OCPP_CONFIGURATION_OBSERVERS_MAX];
+	union configuration_value old_value;
+	union configuration_value new_value;
+	size_t n = 0;
+	bool changed = false;
 
 	if (key == UnknownConfiguration || value_size > get_value_cap(key)) {
 		return -EINVAL;
@@ -274,11 +805,101 @@ int ocpp_set_configuration(const char * const keystr,
 		return -EPERM;
 	}
 
+	if (!is_valid_value(key, value, value_size)) {
+		return -ERANGE;
+	}
+
 	ocpp_configuration_lock();
-	memcpy(configurations[key].value, value, value_size);
+	if (memcmp(configurations[key].value, value, value_size) != 0) {
+		memcpy(&old_value, configurations[key].value,
+				get_value_cap(key));
+		begin_write();
+		store_value(configurations[key].value, value, value_size);
+		end_write();
+		memcpy(&new_value, configurations[key].value,
+				get_value_cap(key));
+		set_dirty(key, true);
+		n = get_subscriptions(key, subs);
+		changed = true;
+	}
 	ocpp_configuration_unlock();
 
-	return 0;
+#if OCPP_CAPTURE
+	ocpp_capture_config(keystr, value, value_size);
+#endif
+
+	if (!changed) {
+		return 0;
+	}
+
+	/* without the lock so that observers read the configuration */
+	const int rc = notify_change(key, subs, n, &old_value, &new_value);
+
+	/* notified still, for observers keeping the value on their own */
+	if (constraints[key].reboot) {
+		return OCPP_CONFIGURATION_REBOOT_REQUIRED;
+	}
+
+	return rc;
+}
+
+int ocpp_subscribe_configuration(const char * const keystr,
+		ocpp_configuration_observer_t cb, void *ctx)
+{
+	configuration_t key = CONFIGURATION_MAX;
+	int err = -ENOMEM;
+
+	if (cb == NULL) {
+		return -EINVAL;
+	}
+	if (keystr && (key = get_key_from_keystr(keystr))
+			== UnknownConfiguration) {
+		return -EINVAL;
+	}
+
+	ocpp_configuration_lock();
+	for (int i = 0; i < OCPP_CONFIGURATION_OBSERVERS_MAX; i++) {
+		struct subscription *sub = &subscriptions[i];
+
+		if (sub->cb == NULL) {
+			*sub = (struct subscription) {
+				.key = key,
+				.cb = cb,
+				.ctx = ctx,
+			};
+			err = 0;
+			break;
+		}
+	}
+	ocpp_configuration_unlock();
+
+	return err;
+}
+
+int ocpp_unsubscribe_configuration(const char * const keystr,
+		ocpp_configuration_observer_t cb, void *ctx)
+{
+	configuration_t key = CONFIGURATION_MAX;
+	int err = -ENOENT;
+
+	if (keystr && (key = get_key_from_keystr(keystr))
+			== UnknownConfiguration) {
+		return -EINVAL;
+	}
+
+	ocpp_configuration_lock();
+	for (int i = 0; i < OCPP_CONFIGURATION_OBSERVERS_MAX; i++) {
+		struct subscription *sub = &subscriptions[i];
+
+		if (sub->cb == cb && sub->ctx == ctx && sub->key == key) {
+			memset(sub, 0, sizeof(*sub));
+			err = 0;
+			break;
+		}
+	}
+	ocpp_configuration_unlock();
+
+	return err;
 }
 
 size_t ocpp_get_configuration_size(const char * const keystr)
@@ -309,22 +930,14 @@ int ocpp_get_configuration(const char * const keystr,
 {
 	configuration_t key = get_key_from_keystr(keystr);
 
-	ocpp_configuration_lock();
-	int rc = get_configuration(key, buf, bufsize, readonly);
-	ocpp_configuration_unlock();
-
-	return rc;
+	return get_configuration(key, buf, bufsize, readonly);
 }
 
 int ocpp_get_configuration_by_index(int index,
 		void *buf, size_t bufsize, bool *readonly)
 {
-	ocpp_configuration_lock();
-	int rc = get_configuration((configuration_t)index,
+	return get_configuration((configuration_t)index,
 			buf, bufsize, readonly);
-	ocpp_configuration_unlock();
-
-	return rc;
 }
 
 const char *ocpp_get_configuration_keystr_from_index(int index)
@@ -360,12 +973,9 @@ bool ocpp_is_configuration_readable(const char * const keystr)
 
 void ocpp_reset_configuration(void)
 {
-	memset(&configurations_pool, 0, sizeof(configurations_pool));
-
 	ocpp_configuration_lock();
-
-	link_configuration_pool();
-	set_default_value();
-
+	begin_write();
+	load_defaults();
+	end_write();
 	ocpp_configuration_unlock();
 }
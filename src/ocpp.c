@@ -6,6 +6,8 @@
 
 #include "ocpp/ocpp.h"
 #include "ocpp/list.h"
+#include "ocpp/trace.h"
+#include "ocpp/capture.h"
 
 #include <string.h>
 #include <errno.h>
@@ -27,28 +29,110 @@
 #if !defined(OCPP_DEFAULT_TX_RETRIES)
 #define OCPP_DEFAULT_TX_RETRIES			3
 #endif
+/* The most messages received in a step */
+#if !defined(OCPP_RX_BUDGET)
+#define OCPP_RX_BUDGET				8
+#endif
+/* Events kept during a step to be delivered at once after the lock released.
+ * 0 to call the event callback right away, releasing the lock each time. */
+#if !defined(OCPP_EVENT_BATCH_LEN)
+#define OCPP_EVENT_BATCH_LEN			0
+#endif
+/* The number of responses kept to answer the CALLs received again with the
+ * same message ID. 0 to disable. Responses with a payload larger than
+ * OCPP_REPLAY_DATA_MAXLEN are not kept. */
+#if !defined(OCPP_REPLAY_CACHE_LEN)
+#define OCPP_REPLAY_CACHE_LEN			4
+#endif
+#if !defined(OCPP_REPLAY_DATA_MAXLEN)
+#define OCPP_REPLAY_DATA_MAXLEN			32
+#endif
+/* The number of requests received, tracked until responded */
+#if !defined(OCPP_INBOUND_LEN)
+#define OCPP_INBOUND_LEN			4
+#endif
+/* Storage class of the current context pointer. Define it thread-local, e.g.
+ * `__thread`, for threads to work on different contexts at the same time. */
+#if !defined(OCPP_CONTEXT_STORAGE)
+#define OCPP_CONTEXT_STORAGE
+#endif
 
 #define container_of(ptr, type, member)		\
 	((type *)(void *)((char *)(ptr) - offsetof(type, member)))
 
+/* Binary form of a message ID to compare in two loads. IDs of 32 hexadecimal
+ * digits, as `ocpp_generate_message_id()` gives by default, are packed as is
+ * and others hashed, confirmed by string comparison then. */
+struct msgkey {
+	uint64_t hi;
+	uint64_t lo;
+};
+
 struct message {
 	struct list link;
 	struct ocpp_message body;
+	struct msgkey key;
 	time_t expiry;
+	time_t queued_at; /**< when it got ready to be sent for the first time */
+	time_t sent_at; /**< when it was sent last time */
 	uint32_t attempts; /**< The number of message sending attempts. */
+	bool sending; /**< in `ocpp_send()` without the lock held */
+	bool answered; /**< the response came in while sending */
+	bool key_exact; /**< no need to compare the ID strings */
+	ocpp_queue_t queue; /**< the queue it is in, OCPP_QUEUE_MAX if none */
+	ocpp_request_callback_t on_done;
+	void *on_done_ctx;
 };
 
 typedef void (*list_add_func_t)(struct message *);
 
-static struct {
+/* a request received, waiting for the application to respond */
+struct inbound {
+	char id[OCPP_MESSAGE_ID_MAXLEN];
+	ocpp_message_t type;
+	time_t received_at;
+	time_t deadline; /**< 0 if none */
+	bool expired; /**< answered by the engine */
+};
+
+#if OCPP_REPLAY_CACHE_LEN > 0
+/* a response sent, kept to be sent again for the CALL received again */
+struct replay {
+	char id[OCPP_MESSAGE_ID_MAXLEN];
+	ocpp_message_t type;
+	bool err;
+	uint8_t pending; /**< responses queued referring to the data */
+	size_t datasize;
+	uint8_t data[OCPP_REPLAY_DATA_MAXLEN] __attribute__((aligned));
+};
+#endif
+
+#if OCPP_EVENT_BATCH_LEN > 0
+struct event {
+	ocpp_event_t type;
+	struct ocpp_message message;
+};
+#endif
+
+struct ocpp_context {
 	ocpp_event_callback_t event_callback;
 	void *event_callback_ctx;
+	uint32_t event_mask;
+
+#if OCPP_EVENT_BATCH_LEN > 0
+	struct {
+		struct event buf[OCPP_EVENT_BATCH_LEN];
+		uint16_t len;
+	} events;
+#endif
 
 	struct {
 		struct message pool[OCPP_TX_POOL_LEN];
 		struct list ready;
 		struct list wait;
 		struct list timer;
+		/* messages of each type in the queues, read without the lock */
+		uint16_t pending[OCPP_MSG_MAX];
 
 		time_t timestamp;
 	} tx;
@@ -57,8 +141,201 @@ static struct {
 		time_t timestamp;
 	} rx;
 
+	struct inbound inbound[OCPP_INBOUND_LEN];
+	struct {
+		uint32_t sec;
+		const void *conf;
+		size_t confsize;
+	} response_deadlines[OCPP_MSG_MAX];
+
+#if OCPP_REPLAY_CACHE_LEN > 0
+	struct {
+		struct replay entries[OCPP_REPLAY_CACHE_LEN];
+		uint8_t next;
+	} replay;
+#endif
+
+	struct ocpp_stats stats;
+	time_t now; /**< time of the latest step */
+
 	bool boot_accepted;
-} m;
+};
+
+static struct ocpp_context default_context;
+/** the current context */
+static OCPP_CONTEXT_STORAGE struct ocpp_context *m = &default_context;
+
+static struct ocpp_message_stats *get_msg_stats(const struct message *msg)
+{
+	static struct ocpp_message_stats dummy;
+
+	if (msg->body.type >= OCPP_MSG_MAX) {
+		return &dummy;
+	}
+
+	return &m->stats.msg[msg->body.type];
+}
+
+static uint32_t get_histogram_index(time_t elapsed)
+{
+	uint32_t sec = elapsed > 0? (uint32_t)elapsed : 0;
+	uint32_t i = 0;
+
+	while (sec && i < OCPP_STATS_HISTOGRAM_LEN - 1) {
+		sec >>= 1;
+		i++;
+	}
+
+	return i;
+}
+
+static void capture(ocpp_capture_kind_t kind,
+		const struct ocpp_message *msg, int rc, uint32_t arg,
+		uint8_t flags)
+{
+#if OCPP_CAPTURE
+	ocpp_capture_write(kind, msg, rc, arg, flags);
+#else
+	(void)kind;
+	(void)msg;
+	(void)rc;
+	(void)arg;
+	(void)flags;
+#endif
+}
+
+static void capture_time(time_t now)
+{
+#if OCPP_CAPTURE
+	ocpp_capture_time(now);
+#else
+	(void)now;
+#endif
+}
+
+static void capture_push(ocpp_capture_kind_t kind, const char *id,
+		ocpp_message_t type, const void *data, size_t datasize,
+		int rc, uint32_t arg, uint8_t flags)
+{
+#if OCPP_CAPTURE
+	struct ocpp_message msg = {
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = type,
+		.payload.fmt.request = data,
+		.payload.size = datasize,
+	};
+
+	if (id) {
+		msg.role = (flags & OCPP_CAPTURE_FLAG_ERR)?
+			OCPP_MSG_ROLE_CALLERROR : OCPP_MSG_ROLE_CALLRESULT;
+		memcpy(msg.id, id, sizeof(msg.id));
+	}
+
+	ocpp_capture_write(kind, &msg, rc, arg, flags);
+#else
+	(void)kind;
+	(void)id;
+	(void)type;
+	(void)data;
+	(void)datasize;
+	(void)rc;
+	(void)arg;
+	(void)flags;
+#endif
+}
+
+static void trace_message(ocpp_trace_event_t event, const struct message *msg)
+{
+#if OCPP_TRACE_LEN > 0
+	ocpp_trace_write(event, msg->body.type,
+			(uint16_t)(msg - m->tx.pool), msg->attempts);
+#else
+	(void)event;
+	(void)msg;
+#endif
+}
+
+static void trace_received(const struct ocpp_message *received)
+{
+#if OCPP_TRACE_LEN > 0
+	ocpp_trace_event_t event = OCPP_TRACE_RECV_ERROR;
+
+	if (received->role == OCPP_MSG_ROLE_CALL) {
+		event = OCPP_TRACE_RECV_CALL;
+	} else if (received->role == OCPP_MSG_ROLE_CALLRESULT) {
+		event = OCPP_TRACE_RECV_RESULT;
+	}
+
+	ocpp_trace_write(event, received->type, OCPP_TRACE_NO_SLOT, 0);
+#else
+	(void)received;
+#endif
+}
+
+static void update_pending(const struct message *msg, int delta)
+{
+	if (msg->body.type >= OCPP_MSG_MAX) {
+		return;
+	}
+
+	uint16_t *p = &m->tx.pending[msg->body.type];
+	/* only written under the lock, so no read-modify-write needed */
+	__atomic_store_n(p, (uint16_t)(*p + delta), __ATOMIC_RELAXED);
+}
+
+static void inc_queue_len(ocpp_queue_t queue, struct message *msg)
+{
+	uint32_t len = ++m->stats.queue[queue].len;
+
+	if (len > m->stats.queue[queue].high) {
+		m->stats.queue[queue].high = len;
+	}
+
+	msg->queue = queue;
+	update_pending(msg, 1);
+}
+
+static void dec_queue_len(ocpp_queue_t queue, struct message *msg)
+{
+	m->stats.queue[queue].len--;
+	msg->queue = OCPP_QUEUE_MAX;
+	update_pending(msg, -1);
+}
+
+static void record_queued_time(struct message *msg)
+{
+	if (msg->attempts == 0) {
+		msg->queued_at = m->now;
+	}
+}
+
+static void record_sent(struct message *msg, bool ok)
+{
+	struct ocpp_message_stats *stats = get_msg_stats(msg);
+
+	if (msg->attempts == 1) {
+		stats->queued[get_histogram_index(m->now - msg->queued_at)]++;
+	} else {
+		stats->retried++;
+	}
+
+	if (ok) {
+		stats->sent++;
+	} else {
+		stats->errored++;
+	}
+}
+
+static void record_response(struct message *req, bool err)
+{
+	struct ocpp_message_stats *stats = get_msg_stats(req);
+
+	stats->rtt[get_histogram_index(m->now - req->sent_at)]++;
+
+	if (err) {
+		stats->errored++;
+	}
+}
 
 static void add_last_to_list(struct message *msg, struct list *head)
 {
@@ -77,128 +354,321 @@ static void del_from_list(struct message *msg, struct list *head)
 
 static void put_msg_ready_infront(struct message *msg)
 {
-	add_first_to_list(msg, &m.tx.ready);
-	OCPP_DEBUG("%s pushed in front to ready list",
-			ocpp_stringify_type(msg->body.type));
+	add_first_to_list(msg, &m->tx.ready);
+	inc_queue_len(OCPP_QUEUE_READY, msg);
+	trace_message(OCPP_TRACE_PUT_READY_INFRONT, msg);
 }
 
 static void put_msg_ready(struct message *msg)
 {
-	add_last_to_list(msg, &m.tx.ready);
-	OCPP_DEBUG("%s pushed to ready list",
-			ocpp_stringify_type(msg->body.type));
+	add_last_to_list(msg, &m->tx.ready);
+	inc_queue_len(OCPP_QUEUE_READY, msg);
+	record_queued_time(msg);
+	trace_message(OCPP_TRACE_PUT_READY, msg);
 }
 
 static void put_msg_wait(struct message *msg)
 {
-	add_last_to_list(msg, &m.tx.wait);
-	OCPP_DEBUG("%s pushed to wait list",
-			ocpp_stringify_type(msg->body.type));
+	add_last_to_list(msg, &m->tx.wait);
+	inc_queue_len(OCPP_QUEUE_WAIT, msg);
+	trace_message(OCPP_TRACE_PUT_WAIT, msg);
 }
 
 static void put_msg_timer(struct message *msg)
 {
-	add_last_to_list(msg, &m.tx.timer);
-	OCPP_DEBUG("%s pushed to timer list",
-			ocpp_stringify_type(msg->body.type));
+	add_last_to_list(msg, &m->tx.timer);
+	inc_queue_len(OCPP_QUEUE_TIMER, msg);
+	trace_message(OCPP_TRACE_PUT_TIMER, msg);
 }
 
 static void del_msg_ready(struct message *msg)
 {
-	del_from_list(msg, &m.tx.ready);
-	OCPP_DEBUG("%s removed from ready list",
-			ocpp_stringify_type(msg->body.type));
+	del_from_list(msg, &m->tx.ready);
+	dec_queue_len(OCPP_QUEUE_READY, msg);
+	trace_message(OCPP_TRACE_DEL_READY, msg);
 }
 
 static void del_msg_wait(struct message *msg)
 {
-	del_from_list(msg, &m.tx.wait);
-	OCPP_DEBUG("%s removed from wait list",
-			ocpp_stringify_type(msg->body.type));
+	del_from_list(msg, &m->tx.wait);
+	dec_queue_len(OCPP_QUEUE_WAIT, msg);
+	trace_message(OCPP_TRACE_DEL_WAIT, msg);
 }
 
 static void del_msg_timer(struct message *msg)
 {
-	del_from_list(msg, &m.tx.timer);
-	OCPP_DEBUG("%s removed from timer list",
-			ocpp_stringify_type(msg->body.type));
+	del_from_list(msg, &m->tx.timer);
+	dec_queue_len(OCPP_QUEUE_TIMER, msg);
+	trace_message(OCPP_TRACE_DEL_TIMER, msg);
 }
 
 static int count_messages_waiting(void)
 {
-	return list_count(&m.tx.wait);
+	return (int)m->stats.queue[OCPP_QUEUE_WAIT].len;
 }
 
 static int count_messages_ticking(void)
 {
-	return list_count(&m.tx.timer);
+	return (int)m->stats.queue[OCPP_QUEUE_TIMER].len;
 }
 
 static int count_messages_ready(void)
 {
-	return list_count(&m.tx.ready);
+	return (int)m->stats.queue[OCPP_QUEUE_READY].len;
 }
 
 static bool is_boot_accepted(void)
 {
-	return m.boot_accepted;
+	return m->boot_accepted;
 }
 
 static void set_boot_accepted(bool accepted)
 {
-	m.boot_accepted = accepted;
+	m->boot_accepted = accepted;
 }
 
 static void update_last_tx_timestamp(const time_t *now)
 {
-	m.tx.timestamp = *now;
-	OCPP_DEBUG("Last TX timestamp: %ld", m.tx.timestamp);
+	m->tx.timestamp = *now;
+	OCPP_DEBUG("Last TX timestamp: %ld", m->tx.timestamp);
 }
 
 static void update_last_rx_timestamp(const time_t *now)
 {
-	m.rx.timestamp = *now;
-	OCPP_DEBUG("Last RX timestamp: %ld", m.rx.timestamp);
+	m->rx.timestamp = *now;
+	OCPP_DEBUG("Last RX timestamp: %ld", m->rx.timestamp);
 }
 
 static uint32_t get_elapsed_since_last_message(const time_t *now)
 {
-	const time_t last = m.tx.timestamp > m.rx.timestamp?
-		m.tx.timestamp : m.rx.timestamp;
+	const time_t last = m->tx.timestamp > m->rx.timestamp?
+		m->tx.timestamp : m->rx.timestamp;
 	return (uint32_t)(*now - last);
 }
 
+static uint32_t get_event_bit(ocpp_event_t event_type)
+{
+	if (event_type < 0) {
+		return OCPP_EVENT_MASK_ERROR;
+	}
+
+	return 1u << event_type;
+}
+
+/* Releases the lock, delivering the events kept so far. Messages received
+ * are valid only until the next `ocpp_recv()`, so call it before that. */
+static void unlock_and_deliver_events(void)
+{
+#if OCPP_EVENT_BATCH_LEN > 0
+	struct event events[OCPP_EVENT_BATCH_LEN];
+	const uint16_t n = m->events.len;
+
+	memcpy(events, m->events.buf, sizeof(events[0]) * n);
+	m->events.len = 0;
+
+	ocpp_unlock();
+
+	for (uint16_t i = 0; i < n; i++) {
+		(*m->event_callback)(events[i].type, &events[i].message,
+				m->event_callback_ctx);
+	}
+#else
+	ocpp_unlock();
+#endif
+}
+
 static void dispatch_event(ocpp_event_t event_type,
 		const struct ocpp_message *msg)
 {
-	if (m.event_callback) {
-		ocpp_unlock();
-		(*m.event_callback)(event_type, msg, m.event_callback_ctx);
+	if (!m->event_callback || !(m->event_mask & get_event_bit(event_type))) {
+		return;
+	}
+
+#if OCPP_EVENT_BATCH_LEN > 0
+	while (m->events.len >= OCPP_EVENT_BATCH_LEN) {
+		unlock_and_deliver_events();
 		ocpp_lock();
 	}
+
+	m->events.buf[m->events.len++] = (struct event) {
+		.type = event_type,
+		.message = *msg,
+	};
+#else
+	ocpp_unlock();
+	(*m->event_callback)(event_type, msg, m->event_callback_ctx);
+	ocpp_lock();
+#endif
 }
 
 static struct message *alloc_message(void)
 {
 	for (int i = 0; i < OCPP_TX_POOL_LEN; i++) {
-		if (m.tx.pool[i].body.role != OCPP_MSG_ROLE_NONE) {
+		if (m->tx.pool[i].body.role != OCPP_MSG_ROLE_NONE) {
 			continue;
 		}
 
-		m.tx.pool[i].body.role = OCPP_MSG_ROLE_ALLOC;
+		m->tx.pool[i].body.role = OCPP_MSG_ROLE_ALLOC;
+		m->tx.pool[i].queue = OCPP_QUEUE_MAX;
+
+		return &m->tx.pool[i];
+	}
+
+	return NULL;
+}
+
+/* The callback is detached before called without the lock, so it gets called
+ * once even if the message gets freed by another thread in the meantime. */
+static void complete_request(struct message *msg, int result,
+		const struct ocpp_message *response)
+{
+	const ocpp_request_callback_t cb = msg->on_done;
+	void *ctx = msg->on_done_ctx;
+
+	if (cb == NULL) {
+		return;
+	}
+
+	msg->on_done = NULL;
+	msg->on_done_ctx = NULL;
+
+	ocpp_unlock();
+	(*cb)(result, response, ctx);
+	ocpp_lock();
+}
+
+#if OCPP_REPLAY_CACHE_LEN > 0
+static struct replay *find_replay(const char *id)
+{
+	for (int i = 0; i < OCPP_REPLAY_CACHE_LEN; i++) {
+		struct replay *p = &m->replay.entries[i];
 
-		return &m.tx.pool[i];
+		if (p->id[0] && strncmp(p->id, id, sizeof(p->id)) == 0) {
+			return p;
+		}
 	}
 
 	return NULL;
 }
 
+static struct replay *get_replay_referred(const struct message *msg)
+{
+	const uint8_t *data = (const uint8_t *)msg->body.payload.fmt.data;
+	const uint8_t *start = (const uint8_t *)m->replay.entries;
+	const uint8_t *end = (const uint8_t *)
+		&m->replay.entries[OCPP_REPLAY_CACHE_LEN];
+
+	if (msg->body.role == OCPP_MSG_ROLE_CALL ||
+			data < start || data >= end) {
+		return NULL;
+	}
+
+	return &m->replay.entries[(size_t)(data - start) /
+		sizeof(struct replay)];
+}
+#endif
+
+/* Keeps the response sent, the payload copied as the original one is freed
+ * once sent. */
+static void keep_response(const struct message *msg)
+{
+#if OCPP_REPLAY_CACHE_LEN > 0
+	if (msg->body.payload.size > OCPP_REPLAY_DATA_MAXLEN ||
+			find_replay(msg->body.id) != NULL) {
+		return;
+	}
+
+	for (int i = 0; i < OCPP_REPLAY_CACHE_LEN; i++) {
+		struct replay *p = &m->replay.entries[m->replay.next];
+		m->replay.next = (uint8_t)((m->replay.next + 1) %
+				OCPP_REPLAY_CACHE_LEN);
+
+		if (p->pending) {
+			continue;
+		}
+
+		memcpy(p->id, msg->body.id, sizeof(p->id));
+		p->type = msg->body.type;
+		p->err = msg->body.role == OCPP_MSG_ROLE_CALLERROR;
+		p->datasize = msg->body.payload.size;
+		if (msg->body.payload.fmt.data && p->datasize) {
+			memcpy(p->data, msg->body.payload.fmt.data, p->datasize);
+		}
+		return;
+	}
+#else
+	(void)msg;
+#endif
+}
+
+static void release_response(const struct message *msg)
+{
+#if OCPP_REPLAY_CACHE_LEN > 0
+	struct replay *p = get_replay_referred(msg);
+
+	if (p && p->pending) {
+		p->pending--;
+	}
+#else
+	(void)msg;
+#endif
+}
+
 static void free_message(struct message *msg)
 {
+	complete_request(msg, -ECANCELED, NULL);
+	release_response(msg);
+	trace_message(OCPP_TRACE_FREE, msg);
 	dispatch_event(OCPP_EVENT_MESSAGE_FREE, &msg->body);
 	memset(msg, 0, sizeof(*msg));
 }
 
+static int get_hex_value(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+
+	return -1;
+}
+
+/* Returns true if the key is exact, no need to compare the strings. Only
+ * lowercase hex gets packed as IDs are case-sensitive; "ab" and "AB" differ. */
+static bool make_key(struct msgkey *key, const char *id)
+{
+	uint64_t v[2] = { 0, 0 };
+	size_t i;
+
+	for (i = 0; i < 32; i++) {
+		const int x = get_hex_value(id[i]);
+
+		if (x < 0) {
+			break;
+		}
+
+		v[i / 16] = (v[i / 16] << 4) | (uint64_t)x;
+	}
+
+	if (i == 32 && id[i] == '\0') {
+		key->hi = v[0];
+		key->lo = v[1];
+		return true;
+	}
+
+	/* FNV-1a with two different offset bases */
+	key->hi = 0xcbf29ce484222325ull;
+	key->lo = 0x84222325cbf29ce4ull;
+
+	for (i = 0; i < OCPP_MESSAGE_ID_MAXLEN && id[i]; i++) {
+		key->hi = (key->hi ^ (uint8_t)id[i]) * 0x100000001b3ull;
+		key->lo = (key->lo ^ (uint8_t)id[i]) * 0x100000001b3ull;
+	}
+
+	return false;
+}
+
 static struct message *new_message(const char *id,
 		ocpp_message_t type, bool err)
 {
@@ -220,17 +690,26 @@ static struct message *new_message(const char *id,
 		ocpp_generate_message_id(msg->body.id, sizeof(msg->body.id));
 	}
 
+	msg->body.id[sizeof(msg->body.id) - 1] = '\0';
+	msg->key_exact = make_key(&msg->key, msg->body.id);
+
 	return msg;
 }
 
 static struct message *find_msg_by_idstr(struct list *list_head,
 		const char *msgid)
 {
+	struct msgkey key;
+	const bool exact = make_key(&key, msgid);
 	struct list *p;
 
 	list_for_each(p, list_head) {
 		struct message *msg = container_of(p, struct message, link);
-		if (memcmp(msgid, msg->body.id, strlen(msgid)) == 0) {
+		if (msg->key.hi != key.hi || msg->key.lo != key.lo) {
+			continue;
+		}
+		if ((exact && msg->key_exact) || strncmp(msgid, msg->body.id,
+					sizeof(msg->body.id)) == 0) {
 			return msg;
 		}
 	}
@@ -238,14 +717,14 @@ static struct message *find_msg_by_idstr(struct list *list_head,
 	return NULL;
 }
 
-static int push_message(const char *id, ocpp_message_t type,
+static struct message *enqueue_message(const char *id, ocpp_message_t type,
 		const void *data, size_t datasize,
 		time_t timer, list_add_func_t f, bool err)
 {
 	struct message *msg = new_message(id, type, err);
 
 	if (!msg) {
-		return -ENOMEM;
+		return NULL;
 	}
 
 	msg->body.payload.fmt.request = data;
@@ -253,6 +732,19 @@ static int push_message(const char *id, ocpp_message_t type,
 	msg->expiry = timer;
 	(*f)(msg);
 
+	get_msg_stats(msg)->pushed++;
+
+	return msg;
+}
+
+static int push_message(const char *id, ocpp_message_t type,
+		const void *data, size_t datasize,
+		time_t timer, list_add_func_t f, bool err)
+{
+	if (!enqueue_message(id, type, data, datasize, timer, f, err)) {
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -350,18 +842,53 @@ static void send_message(struct message *msg, const time_t *now)
 			msg->attempts, OCPP_DEFAULT_TX_RETRIES,
 			(unsigned long)(msg->expiry - *now));
 
-	if (ocpp_send(&msg->body) == 0) {
-		if (msg->body.role == OCPP_MSG_ROLE_CALL) {
-			put_msg_wait(msg);
+	const bool call = msg->body.role == OCPP_MSG_ROLE_CALL;
+
+	/* a CALL waits for the response from before sending as the response
+	 * may be received on another thread before ocpp_send() returns. */
+	if (call) {
+		put_msg_wait(msg);
+	}
+
+	msg->sent_at = m->now;
+	msg->sending = true;
+
+	ocpp_unlock();
+	const int rc = ocpp_send(&msg->body);
+	ocpp_lock();
+
+	msg->sending = false;
+
+	const bool ok = rc == 0;
+	capture(OCPP_CAPTURE_SEND, &msg->body, rc, 0, 0);
+	record_sent(msg, ok);
+	trace_message(ok? OCPP_TRACE_SEND : OCPP_TRACE_SEND_FAIL, msg);
+
+	if (msg->answered) {
+		free_message(msg);
+		return;
+	} else if (ok) {
+		if (call) {
 			return;
 		}
+		keep_response(msg);
 	} else {
 		if (msg->attempts < OCPP_DEFAULT_TX_RETRIES ||
 				is_transaction_related(msg) ||
 				msg->body.type == OCPP_MSG_BOOTNOTIFICATION) {
-			put_msg_wait(msg);
+			if (!call) {
+				put_msg_wait(msg);
+			}
 			return;
 		}
+
+		if (call) {
+			del_msg_wait(msg);
+		}
+
+		get_msg_stats(msg)->dropped++;
+		trace_message(OCPP_TRACE_DROP, msg);
+		complete_request(msg, rc, NULL);
 	}
 
 	free_message(msg);
@@ -369,12 +896,13 @@ static void send_message(struct message *msg, const time_t *now)
 
 static void process_tx_timeout(const time_t *now)
 {
+	DEFINE_LIST_HEAD(dropped);
 	struct list *p;
 	struct list *t;
 
-	list_for_each_safe(p, t, &m.tx.wait) {
+	list_for_each_safe(p, t, &m->tx.wait) {
 		struct message *msg = container_of(p, struct message, link);
-		if (msg->expiry > *now) {
+		if (msg->expiry > *now || msg->sending) {
 			continue;
 		}
 
@@ -383,13 +911,24 @@ static void process_tx_timeout(const time_t *now)
 		if (should_drop(msg)) {
 			OCPP_INFO("Dropping message %s",
 					ocpp_stringify_type(msg->body.type));
-			free_message(msg);
+			get_msg_stats(msg)->dropped++;
+			trace_message(OCPP_TRACE_DROP, msg);
+			list_add_tail(&msg->link, &dropped);
 		} else {
 			OCPP_INFO("Retrying message %s",
 					ocpp_stringify_type(msg->body.type));
+			trace_message(OCPP_TRACE_RETRY, msg);
 			put_msg_ready_infront(msg);
 		}
 	}
+
+	/* completed after the walk as the lock gets released in calling back,
+	 * letting the wait queue change under it */
+	list_for_each_safe(p, t, &dropped) {
+		struct message *msg = container_of(p, struct message, link);
+		complete_request(msg, -ETIMEDOUT, NULL);
+		free_message(msg);
+	}
 }
 
 static int process_queued_messages(const time_t *now)
@@ -407,7 +946,7 @@ static int process_queued_messages(const time_t *now)
 	struct list *p;
 	struct list *t;
 
-	list_for_each_safe(p, t, &m.tx.ready) {
+	list_for_each_safe(p, t, &m->tx.ready) {
 		struct message *msg = container_of(p, struct message, link);
 		send_message(msg, now);
 		return 0; /* send one by one */
@@ -426,6 +965,7 @@ static int process_periodic_messages(const time_t *now)
 		}
 
 		put_msg_ready(msg);
+		get_msg_stats(msg)->pushed++;
 		process_queued_messages(now);
 	}
 
@@ -441,7 +981,7 @@ static int process_timer_messages(const time_t *now)
 	struct list *p;
 	struct list *t;
 
-	list_for_each_safe(p, t, &m.tx.timer) {
+	list_for_each_safe(p, t, &m->tx.timer) {
 		struct message *msg = container_of(p, struct message, link);
 		if (msg->expiry > *now) {
 			continue;
@@ -454,43 +994,222 @@ static int process_timer_messages(const time_t *now)
 	return 0;
 }
 
-static void process_central_request(const struct ocpp_message *received)
+static struct inbound *find_inbound(const char *id)
 {
-	OCPP_INFO("rx: %s.req", ocpp_stringify_type(received->type));
-}
+	for (int i = 0; i < OCPP_INBOUND_LEN; i++) {
+		struct inbound *p = &m->inbound[i];
 
-static bool process_central_response_error(const struct ocpp_message *received,
-		struct message *req, const time_t *now)
-{
-	if (!is_transaction_related(req)) {
-		return true;
+		if (p->id[0] && strncmp(p->id, id, sizeof(p->id)) == 0) {
+			return p;
+		}
 	}
 
-	uint32_t max_attempts = OCPP_DEFAULT_TX_RETRIES;
+	return NULL;
+}
 
-	ocpp_get_configuration("TransactionMessageAttempts",
-			&max_attempts, sizeof(max_attempts), NULL);
+/* A free one, or else the oldest one the engine has nothing more to do for,
+ * or else the oldest one, not to stop tracking when requests are left
+ * unanswered. */
+static struct inbound *alloc_inbound(void)
+{
+	struct inbound *oldest = NULL;
+	struct inbound *oldest_done = NULL;
 
-	if (req->attempts < max_attempts) {
-		update_message_expiry(req, now);
-		put_msg_wait(req);
+	for (int i = 0; i < OCPP_INBOUND_LEN; i++) {
+		struct inbound *p = &m->inbound[i];
 
-		OCPP_INFO("%s will be sent again at %ld (%d/%d)",
-				ocpp_stringify_type(req->body.type),
-				req->expiry, req->attempts, max_attempts);
-		return false;
+		if (p->id[0] == '\0') {
+			return p;
+		}
+		if (oldest == NULL || p->received_at < oldest->received_at) {
+			oldest = p;
+		}
+		if ((p->expired || !p->deadline) && (oldest_done == NULL ||
+				p->received_at < oldest_done->received_at)) {
+			oldest_done = p;
+		}
 	}
 
-	return true;
+	return oldest_done? oldest_done : oldest;
 }
 
-static bool process_central_response_result(const struct ocpp_message *received,
-		struct message *req, const time_t *now)
+static void track_request(const struct ocpp_message *received,
+		const time_t *now)
 {
-	if (received->type == OCPP_MSG_BOOTNOTIFICATION) {
-		const struct ocpp_BootNotification_conf *p =
-			(const struct ocpp_BootNotification_conf *)
-			received->payload.fmt.response;
+	if (received->type >= OCPP_MSG_MAX) {
+		return;
+	}
+
+	struct inbound *p = alloc_inbound();
+
+	const uint32_t sec = m->response_deadlines[received->type].sec;
+
+	memcpy(p->id, received->id, sizeof(p->id));
+	p->type = received->type;
+	p->received_at = *now;
+	p->deadline = sec? *now + (time_t)sec : 0;
+	p->expired = false;
+}
+
+/* Returns -ETIMEDOUT if the request is answered by the engine already. */
+static int untrack_request(const struct ocpp_message *req)
+{
+	struct inbound *p = find_inbound(req->id);
+	int rc = 0;
+
+	if (p == NULL) {
+		return 0;
+	}
+
+	if (p->expired) {
+		rc = -ETIMEDOUT;
+	} else if (p->type < OCPP_MSG_MAX) {
+		m->stats.msg[p->type].handling[
+			get_histogram_index(m->now - p->received_at)]++;
+	}
+
+	memset(p, 0, sizeof(*p));
+
+	return rc;
+}
+
+static int process_inbound_deadlines(const time_t *now)
+{
+	static const ocpp_error_t internal_error = OCPP_ERROR_INTERNAL;
+
+	for (int i = 0; i < OCPP_INBOUND_LEN; i++) {
+		struct inbound *p = &m->inbound[i];
+
+		if (p->id[0] == '\0' || p->expired || !p->deadline ||
+				p->deadline > *now) {
+			continue;
+		}
+
+		const void *conf = m->response_deadlines[p->type].conf;
+		const size_t confsize = m->response_deadlines[p->type].confsize;
+		int rc;
+
+		if (conf) {
+			rc = push_message(p->id, p->type, conf, confsize, 0,
+					put_msg_ready, false);
+		} else {
+			rc = push_message(p->id, p->type, &internal_error,
+					sizeof(internal_error), 0,
+					put_msg_ready, true);
+		}
+
+		if (rc == 0) { /* or try again next time */
+			OCPP_ERROR("No response to %s.req in time",
+					ocpp_stringify_type(p->type));
+			p->expired = true;
+			m->stats.msg[p->type].late++;
+		}
+	}
+
+	return 0;
+}
+
+static void process_central_request(const struct ocpp_message *received)
+{
+	OCPP_INFO("rx: %s.req", ocpp_stringify_type(received->type));
+}
+
+/* The server may send the same CALL again, e.g. after reconnecting. Answer it
+ * with the response already sent or queued rather than running it twice. */
+static bool is_response_queued(struct list *list_head, const char *id)
+{
+	struct list *p;
+
+	list_for_each(p, list_head) {
+		const struct message *msg =
+			container_of(p, struct message, link);
+		if (msg->body.role != OCPP_MSG_ROLE_CALL &&
+				strncmp(msg->body.id, id,
+					sizeof(msg->body.id)) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool process_duplicate_request(const struct ocpp_message *received)
+{
+	if (received->id[0] == '\0') {
+		return false;
+	}
+
+	const struct inbound *inbound = find_inbound(received->id);
+
+	/* an expired one has already been answered on its deadline */
+	if (inbound && !inbound->expired) {
+		OCPP_INFO("rx: %s.req again, being handled",
+				ocpp_stringify_type(received->type));
+		return true;
+	}
+
+	if (is_response_queued(&m->tx.ready, received->id) ||
+			is_response_queued(&m->tx.wait, received->id)) {
+		OCPP_INFO("rx: %s.req again, response queued",
+				ocpp_stringify_type(received->type));
+		return true;
+	}
+
+#if OCPP_REPLAY_CACHE_LEN > 0
+	struct replay *p = find_replay(received->id);
+
+	if (p == NULL || p->type != received->type) {
+		return false;
+	}
+
+	if (push_message(p->id, p->type, p->datasize? p->data : NULL,
+			p->datasize, 0, put_msg_ready, p->err) == 0) {
+		p->pending++;
+	}
+
+	OCPP_INFO("rx: %s.req again, response sent again",
+			ocpp_stringify_type(received->type));
+	return true;
+#else
+	return false;
+#endif
+}
+
+static bool process_central_response_error(const struct ocpp_message *received,
+		struct message *req, const time_t *now)
+{
+	if (!is_transaction_related(req)) {
+		return true;
+	}
+
+	uint32_t max_attempts = OCPP_DEFAULT_TX_RETRIES;
+
+	ocpp_get_configuration("TransactionMessageAttempts",
+			&max_attempts, sizeof(max_attempts), NULL);
+
+	if (req->attempts < max_attempts) {
+		update_message_expiry(req, now);
+		put_msg_wait(req);
+
+		OCPP_INFO("%s will be sent again at %ld (%d/%d)",
+				ocpp_stringify_type(req->body.type),
+				req->expiry, req->attempts, max_attempts);
+		return false;
+	}
+
+	get_msg_stats(req)->dropped++;
+	trace_message(OCPP_TRACE_DROP, req);
+
+	return true;
+}
+
+static bool process_central_response_result(const struct ocpp_message *received,
+		struct message *req, const time_t *now)
+{
+	if (received->type == OCPP_MSG_BOOTNOTIFICATION) {
+		const struct ocpp_BootNotification_conf *p =
+			(const struct ocpp_BootNotification_conf *)
+			received->payload.fmt.response;
 
 		if (p->status == OCPP_BOOT_STATUS_ACCEPTED) {
 			set_boot_accepted(true);
@@ -503,7 +1222,7 @@ static bool process_central_response_result(const struct ocpp_message *received,
 static int process_central_response(const struct ocpp_message *received,
 		const time_t *now)
 {
-	struct message *req = find_msg_by_idstr(&m.tx.wait, received->id);
+	struct message *req = find_msg_by_idstr(&m->tx.wait, received->id);
 	bool free_req = true;
 
 	if (req == NULL) {
@@ -513,6 +1232,7 @@ static int process_central_response(const struct ocpp_message *received,
 	}
 
 	del_msg_wait(req);
+	record_response(req, received->role == OCPP_MSG_ROLE_CALLERROR);
 	OCPP_INFO("rx: %s.conf", ocpp_stringify_type(req->body.type));
 
 	if (received->role == OCPP_MSG_ROLE_CALLRESULT) {
@@ -526,57 +1246,99 @@ static int process_central_response(const struct ocpp_message *received,
 	/* Note that tx timestamp is updated when the response of the message is
 	 * received. */
 	update_last_tx_timestamp(now);
-	if (free_req) {
+	if (free_req && req->sending) {
+		req->answered = true; /* freed by the sender */
+		complete_request(req, 0, received);
+	} else if (free_req) {
+		complete_request(req, 0, received);
 		free_message(req);
 	}
 
 	return 0;
 }
 
-static int process_incoming_messages(const time_t *now)
+static int process_incoming_message(const struct ocpp_message *received, int err,
+		const time_t *now)
 {
-	struct ocpp_message received = { 0, };
+	if (err != 0 && err != -ENOTSUP) {
+		if (err != -ENOMSG) {
+			capture(OCPP_CAPTURE_RECV, NULL, err, 0, 0);
+		}
+		goto out;
+	}
 
-	ocpp_unlock();
-	int err = ocpp_recv(&received);
-	ocpp_lock();
+	capture(OCPP_CAPTURE_RECV, received, err, 0, 0);
+	trace_received(received);
 
-	if (err != 0 && err != -ENOTSUP) {
+	if (received->role == OCPP_MSG_ROLE_CALL &&
+			process_duplicate_request(received)) {
+		update_last_rx_timestamp(now);
 		goto out;
 	}
 
-	switch (received.role) {
+	switch (received->role) {
 	case OCPP_MSG_ROLE_CALL:
-		process_central_request(&received);
+		process_central_request(received);
 		break;
 	case OCPP_MSG_ROLE_CALLRESULT: /* fall through */
 	case OCPP_MSG_ROLE_CALLERROR:
-		err = process_central_response(&received, now);
+		err = process_central_response(received, now);
 		break;
 	default:
 		err = -EINVAL;
-		OCPP_ERROR("Invalid message role: %d", received.role);
+		OCPP_ERROR("Invalid message role: %d", received->role);
 		break;
 	}
 
 	update_last_rx_timestamp(now);
 
-	if (err == -ENOTSUP && received.role == OCPP_MSG_ROLE_CALL) {
-		push_message(received.id, received.type, NULL, 0, 0,
+	if (err == -ENOTSUP && received->role == OCPP_MSG_ROLE_CALL) {
+		push_message(received->id, received->type, NULL, 0, 0,
 				put_msg_ready, true);
 	} else {
-		dispatch_event(err, &received);
+		if (err == 0 && received->role == OCPP_MSG_ROLE_CALL) {
+			track_request(received, now);
+		}
+		dispatch_event(err, received);
 	}
 out:
 	return err;
 }
 
+static int process_incoming_messages(const time_t *now)
+{
+	int err = -ENOMSG;
+
+	/* drain the messages buffered in the transport already, so that
+	 * pipelined ones do not wait for the next step each */
+	for (int i = 0; i < OCPP_RX_BUDGET; i++) {
+		struct ocpp_message received = { 0, };
+
+		unlock_and_deliver_events();
+		const int ready = ocpp_recv_ready();
+		if (ready == 0 || (ready < 0 && i > 0)) {
+			ocpp_lock();
+			break;
+		}
+		err = ocpp_recv(&received);
+		ocpp_lock();
+
+		process_incoming_message(&received, err, now);
+
+		if (err != 0 && err != -ENOTSUP) {
+			break;
+		}
+	}
+
+	return err;
+}
+
 static int remove_oldest(void)
 {
 	struct list *p;
 	struct list *t;
 
-	list_for_each_safe(p, t, &m.tx.ready) {
+	list_for_each_safe(p, t, &m->tx.ready) {
 		struct message *msg = container_of(p, struct message, link);
 		if (msg->body.type != OCPP_MSG_BOOTNOTIFICATION &&
 				msg->body.type != OCPP_MSG_START_TRANSACTION &&
@@ -584,6 +1346,8 @@ static int remove_oldest(void)
 			OCPP_ERROR("Removing the oldest message: %s",
 					ocpp_stringify_type(msg->body.type));
 			del_msg_ready(msg);
+			get_msg_stats(msg)->evicted++;
+			trace_message(OCPP_TRACE_EVICT, msg);
 			free_message(msg);
 			return 0;
 		}
@@ -592,83 +1356,13 @@ static int remove_oldest(void)
 	return -ENOMEM;
 }
 
-static const char **get_typestr_array(void)
-{
-	static const char *msgstr[] = {
-		[OCPP_MSG_AUTHORIZE] = "Authorize",
-		[OCPP_MSG_BOOTNOTIFICATION] = "BootNotification",
-		[OCPP_MSG_CHANGE_AVAILABILITY] = "ChangeAvailability",
-		[OCPP_MSG_CHANGE_CONFIGURATION] = "ChangeConfiguration",
-		[OCPP_MSG_CLEAR_CACHE] = "ClearCache",
-		[OCPP_MSG_DATA_TRANSFER] = "DataTransfer",
-		[OCPP_MSG_GET_CONFIGURATION] = "GetConfiguration",
-		[OCPP_MSG_HEARTBEAT] = "Heartbeat",
-		[OCPP_MSG_METER_VALUES] = "MeterValues",
-		[OCPP_MSG_REMOTE_START_TRANSACTION] = "RemoteStartTransaction",
-		[OCPP_MSG_REMOTE_STOP_TRANSACTION] = "RemoteStopTransaction",
-		[OCPP_MSG_RESET] = "Reset",
-		[OCPP_MSG_START_TRANSACTION] = "StartTransaction",
-		[OCPP_MSG_STATUS_NOTIFICATION] = "StatusNotification",
-		[OCPP_MSG_STOP_TRANSACTION] = "StopTransaction",
-		[OCPP_MSG_UNLOCK_CONNECTOR] = "UnlockConnector",
-		[OCPP_MSG_DIAGNOSTICS_NOTIFICATION] =
-			"DiagnosticsStatusNotification",
-		[OCPP_MSG_FIRMWARE_NOTIFICATION] = "FirmwareStatusNotification",
-		[OCPP_MSG_GET_DIAGNOSTICS] = "GetDiagnostics",
-		[OCPP_MSG_UPDATE_FIRMWARE] = "UpdateFirmware",
-		[OCPP_MSG_GET_LOCAL_LIST_VERSION] = "GetLocalListVersion",
-		[OCPP_MSG_SEND_LOCAL_LIST] = "SendLocalList",
-		[OCPP_MSG_CANCEL_RESERVATION] = "CancelReservation",
-		[OCPP_MSG_RESERVE_NOW] = "ReserveNow",
-		[OCPP_MSG_CLEAR_CHARGING_PROFILE] = "ClearChargingProfile",
-		[OCPP_MSG_GET_COMPOSITE_SCHEDULE] = "GetCompositeSchedule",
-		[OCPP_MSG_SET_CHARGING_PROFILE] = "SetChargingProfile",
-		[OCPP_MSG_TRIGGER_MESSAGE] = "TriggerMessage",
-		[OCPP_MSG_CERTIFICATE_SIGNED] = "CertificateSigned",
-		[OCPP_MSG_DELETE_CERTIFICATE] = "DeleteCertificate",
-		[OCPP_MSG_EXTENDED_TRIGGER_MESSAGE] = "ExtendedTriggerMessage",
-		[OCPP_MSG_GET_INSTALLED_CERTIFICATE_IDS] =
-			"GetInstalledCertificateIds",
-		[OCPP_MSG_GET_LOG] = "GetLog",
-		[OCPP_MSG_INSTALL_CERTIFICATE] = "InstallCertificate",
-		[OCPP_MSG_LOG_STATUS_NOTIFICATION] = "LogStatusNotification",
-		[OCPP_MSG_SECURITY_EVENT_NOTIFICATION] =
-			"SecurityEventNotification",
-		[OCPP_MSG_SIGN_CERTIFICATE] = "SignCertificate",
-		[OCPP_MSG_SIGNED_FIRMWARE_STATUS_NOTIFICATION] =
-			"SignedFirmwareStatusNotification",
-		[OCPP_MSG_SIGNED_UPDATE_FIRMWARE] = "SignedUpdateFirmware",
-	};
-
-	return msgstr;
-}
-
-const char *ocpp_stringify_type(ocpp_message_t msgtype)
-{
-	const char **msgstr = get_typestr_array();
-	return msgtype >= OCPP_MSG_MAX? "UnknownMessage" : msgstr[msgtype];
-}
-
-ocpp_message_t ocpp_get_type_from_string(const char *typestr)
-{
-	const char **msgstr = get_typestr_array();
-
-	for (ocpp_message_t i = 0; i < OCPP_MSG_MAX; i++) {
-		if (strcmp(typestr, msgstr[i]) == 0) {
-			return i;
-		}
-	}
-
-	return OCPP_MSG_MAX;
-}
-
 ocpp_message_t ocpp_get_type_from_idstr(const char *idstr)
 {
 	const struct message *req = NULL;
 
 	ocpp_lock();
 	{
-		req = find_msg_by_idstr(&m.tx.wait, idstr);
+		req = find_msg_by_idstr(&m->tx.wait, idstr);
 	}
 	ocpp_unlock();
 
@@ -694,48 +1388,251 @@ size_t ocpp_count_pending_requests(void)
 	return count;
 }
 
-static bool is_in_list(const struct list *node, const struct list *head)
+size_t ocpp_count_pending_type(ocpp_message_t type)
+{
+	if (type >= OCPP_MSG_MAX) {
+		return 0;
+	}
+
+	return __atomic_load_n(&m->tx.pending[type], __ATOMIC_RELAXED);
+}
+
+static void get_earliest_expiry(struct list *head,
+		time_t *earliest, bool *found)
 {
 	struct list *p;
+
 	list_for_each(p, head) {
-		if (p == node) {
-			return true;
+		const struct message *msg =
+			container_of(p, struct message, link);
+		if (!*found || msg->expiry < *earliest) {
+			*earliest = msg->expiry;
+			*found = true;
 		}
 	}
-	return false;
 }
 
-size_t ocpp_drop_pending_type(ocpp_message_t type)
+int ocpp_get_next_deadline(time_t *deadline)
 {
+	time_t next = 0;
+	bool found = false;
+
+	if (deadline == NULL) {
+		return -EINVAL;
+	}
+
+	ocpp_lock();
+	{
+		const bool idle = count_messages_ready() == 0 &&
+			count_messages_waiting() == 0;
+
+		if (!idle && count_messages_waiting() == 0) {
+			next = m->now;
+			found = true;
+		} else {
+			get_earliest_expiry(&m->tx.wait, &next, &found);
+		}
+
+		get_earliest_expiry(&m->tx.timer, &next, &found);
+
+		for (int i = 0; i < OCPP_INBOUND_LEN; i++) {
+			const struct inbound *p = &m->inbound[i];
+
+			if (p->id[0] && !p->expired && p->deadline &&
+					(!found || p->deadline < next)) {
+				next = p->deadline;
+				found = true;
+			}
+		}
+
+		uint32_t interval = 0;
+		ocpp_get_configuration("HeartbeatInterval",
+				&interval, sizeof(interval), 0);
+
+		if (idle && interval && is_boot_accepted()) {
+			const time_t last = m->tx.timestamp > m->rx.timestamp?
+				m->tx.timestamp : m->rx.timestamp;
+			const time_t heartbeat = last + (time_t)interval;
+
+			if (!found || heartbeat < next) {
+				next = heartbeat;
+				found = true;
+			}
+		}
+	}
+	ocpp_unlock();
+
+	if (!found) {
+		return -ENOENT;
+	}
+
+	*deadline = next;
+
+	return 0;
+}
+
+static struct list *get_queue(ocpp_queue_t queue)
+{
+	switch (queue) {
+	case OCPP_QUEUE_READY:
+		return &m->tx.ready;
+	case OCPP_QUEUE_WAIT:
+		return &m->tx.wait;
+	case OCPP_QUEUE_TIMER:
+		return &m->tx.timer;
+	case OCPP_QUEUE_MAX: /* fall through */
+	default:
+		return NULL;
+	}
+}
+
+/* Unlinks the marked messages in a single walk keeping the predecessor, as
+ * `list_del()` would walk the queue again for each of them. */
+static void del_marked_from_queue(ocpp_queue_t queue, const bool *marked)
+{
+	static const ocpp_trace_event_t events[OCPP_QUEUE_MAX] = {
+		[OCPP_QUEUE_READY] = OCPP_TRACE_DEL_READY,
+		[OCPP_QUEUE_WAIT] = OCPP_TRACE_DEL_WAIT,
+		[OCPP_QUEUE_TIMER] = OCPP_TRACE_DEL_TIMER,
+	};
+	struct list *head = get_queue(queue);
+	struct list *prev = head;
+	struct list *p;
+	struct list *t;
+
+	list_for_each_safe(p, t, head) {
+		struct message *msg = container_of(p, struct message, link);
+
+		if (!marked[msg - m->tx.pool]) {
+			prev = p;
+			continue;
+		}
+
+		prev->next = t;
+		dec_queue_len(queue, msg);
+		trace_message(events[queue], msg);
+	}
+}
+
+/* not to answer on the deadline the requests the application gives up,
+ * e.g. the ones received before reconnecting */
+static void forget_inbound_if(ocpp_message_pred_t pred, void *ctx)
+{
+	for (int i = 0; i < OCPP_INBOUND_LEN; i++) {
+		struct inbound *p = &m->inbound[i];
+		struct ocpp_message req = {
+			.role = OCPP_MSG_ROLE_CALL,
+			.type = p->type,
+		};
+
+		if (p->id[0] == '\0') {
+			continue;
+		}
+
+		memcpy(req.id, p->id, sizeof(req.id));
+
+		if (pred(&req, ctx)) {
+			memset(p, 0, sizeof(*p));
+		}
+	}
+}
+
+size_t ocpp_drop_pending_if(ocpp_message_pred_t pred, void *ctx)
+{
+	bool marked[OCPP_TX_POOL_LEN] = { false, };
+	bool queues[OCPP_QUEUE_MAX] = { false, };
 	size_t count = 0;
 
+	if (pred == NULL) {
+		return 0;
+	}
+
 	ocpp_lock();
 	{
-		/* Iterate through the message pool directly to find and clear
-		 * all messages of the specified type, regardless of which queue
-		 * they're in. This is more robust than iterating through queues. */
 		for (int i = 0; i < OCPP_TX_POOL_LEN; i++) {
-			struct message *msg = &m.tx.pool[i];
-			if (msg->body.role != OCPP_MSG_ROLE_NONE &&
-					msg->body.type == type) {
-				/* Find which queue it's in and remove from that queue */
-				if (is_in_list(&msg->link, &m.tx.ready)) {
-					del_from_list(msg, &m.tx.ready);
-				} else if (is_in_list(&msg->link, &m.tx.wait)) {
-					del_from_list(msg, &m.tx.wait);
-				} else if (is_in_list(&msg->link, &m.tx.timer)) {
-					del_from_list(msg, &m.tx.timer);
-				}
-				free_message(msg);
-				count++;
+			struct message *msg = &m->tx.pool[i];
+
+			if (msg->body.role == OCPP_MSG_ROLE_NONE ||
+					msg->queue >= OCPP_QUEUE_MAX ||
+					msg->sending || !pred(&msg->body, ctx)) {
+				continue;
 			}
+
+			marked[i] = true;
+			queues[msg->queue] = true;
+			count++;
+		}
+
+		for (int q = 0; q < OCPP_QUEUE_MAX; q++) {
+			if (queues[q]) {
+				del_marked_from_queue((ocpp_queue_t)q, marked);
+			}
+		}
+
+		forget_inbound_if(pred, ctx);
+
+		/* freed after all unlinked as the lock may be released in
+		 * delivering the events */
+		for (int i = 0; i < OCPP_TX_POOL_LEN; i++) {
+			struct message *msg = &m->tx.pool[i];
+
+			if (!marked[i]) {
+				continue;
+			}
+
+			get_msg_stats(msg)->evicted++;
+			trace_message(OCPP_TRACE_EVICT, msg);
+			free_message(msg);
 		}
 	}
-	ocpp_unlock();
+	unlock_and_deliver_events();
 
 	return count;
 }
 
+static bool is_type_of(const struct ocpp_message *msg, void *ctx)
+{
+	return msg->type == *(const ocpp_message_t *)ctx;
+}
+
+size_t ocpp_drop_pending_type(ocpp_message_t type)
+{
+	return ocpp_drop_pending_if(is_type_of, &type);
+}
+
+int ocpp_get_stats(struct ocpp_stats *stats)
+{
+	if (stats == NULL) {
+		return -EINVAL;
+	}
+
+	ocpp_lock();
+	memcpy(stats, &m->stats, sizeof(*stats));
+	ocpp_unlock();
+
+	return 0;
+}
+
+void ocpp_set_event_mask(uint32_t mask)
+{
+	ocpp_lock();
+	m->event_mask = mask;
+	ocpp_unlock();
+}
+
+void ocpp_reset_stats(void)
+{
+	ocpp_lock();
+	{
+		memset(m->stats.msg, 0, sizeof(m->stats.msg));
+
+		for (int i = 0; i < OCPP_QUEUE_MAX; i++) {
+			m->stats.queue[i].high = m->stats.queue[i].len;
+		}
+	}
+	ocpp_unlock();
+}
+
 int ocpp_push_request(ocpp_message_t type, const void *data, size_t datasize,
 		bool force)
 {
@@ -751,6 +1648,53 @@ int ocpp_push_request(ocpp_message_t type, const void *data, size_t datasize,
 			rc = push_message(NULL, type, data, datasize, 0,
 					put_msg_ready, 0);
 		}
+
+		capture_push(OCPP_CAPTURE_PUSH_REQUEST, NULL, type,
+				data, datasize, rc, 0,
+				force? OCPP_CAPTURE_FLAG_FORCE : 0);
+	}
+	unlock_and_deliver_events();
+
+	return rc;
+}
+
+int ocpp_set_response_deadline(ocpp_message_t type, uint32_t sec,
+		const void *conf, size_t confsize)
+{
+	if (type >= OCPP_MSG_MAX) {
+		return -EINVAL;
+	}
+
+	ocpp_lock();
+	{
+		m->response_deadlines[type].sec = sec;
+		m->response_deadlines[type].conf = conf;
+		m->response_deadlines[type].confsize = confsize;
+	}
+	ocpp_unlock();
+
+	return 0;
+}
+
+int ocpp_push_request_cb(ocpp_message_t type, const void *data,
+		size_t datasize, ocpp_request_callback_t on_done, void *ctx)
+{
+	int rc = 0;
+
+	ocpp_lock();
+	{
+		struct message *msg = enqueue_message(NULL, type,
+				data, datasize, 0, put_msg_ready, 0);
+
+		if (msg) {
+			msg->on_done = on_done;
+			msg->on_done_ctx = ctx;
+		} else {
+			rc = -ENOMEM;
+		}
+
+		capture_push(OCPP_CAPTURE_PUSH_REQUEST, NULL, type,
+				data, datasize, rc, 0, 0);
 	}
 	ocpp_unlock();
 
@@ -769,8 +1713,14 @@ int ocpp_push_request_defer(ocpp_message_t type,
 
 	ocpp_lock();
 	{
+		const time_t now = time(NULL);
+
 		rc = push_message(NULL, type, data, datasize,
-				time(NULL) + (time_t)timer_sec, f, 0);
+				now + (time_t)timer_sec, f, 0);
+
+		capture_time(now);
+		capture_push(OCPP_CAPTURE_PUSH_DEFER, NULL, type,
+				data, datasize, rc, timer_sec, 0);
 	}
 	ocpp_unlock();
 
@@ -784,47 +1734,135 @@ int ocpp_push_response(const struct ocpp_message *req,
 
 	ocpp_lock();
 	{
-		rc = push_message(req->id, req->type, data, datasize,
-				0, put_msg_ready, err);
+		rc = untrack_request(req);
+
+		if (rc == 0) {
+			rc = push_message(req->id, req->type, data, datasize,
+					0, put_msg_ready, err);
+		}
+
+		capture_push(OCPP_CAPTURE_PUSH_RESPONSE, req->id, req->type,
+				data, datasize, rc, 0,
+				err? OCPP_CAPTURE_FLAG_ERR : 0);
 	}
 	ocpp_unlock();
 
 	return rc;
 }
 
+int __attribute__((weak)) ocpp_recv_ready(void)
+{
+	return -ENOTSUP;
+}
+
+int ocpp_step_tx(void)
+{
+	const time_t now = time(NULL);
+
+	ocpp_lock();
+	{
+		m->now = now;
+
+		capture_time(now);
+		capture(OCPP_CAPTURE_STEP_TX, NULL, 0, 0, 0);
+
+		process_inbound_deadlines(&now);
+		process_queued_messages(&now);
+		process_periodic_messages(&now);
+		process_timer_messages(&now);
+	}
+	unlock_and_deliver_events();
+
+	return 0;
+}
+
+int ocpp_step_rx(void)
+{
+	struct ocpp_message received = { 0, };
+	const int err = ocpp_recv(&received);
+	const time_t now = time(NULL);
+
+	ocpp_lock();
+	{
+		m->now = now;
+
+		capture_time(now);
+		capture(OCPP_CAPTURE_STEP_RX, NULL, 0, 0, 0);
+
+		process_incoming_message(&received, err, &now);
+	}
+	unlock_and_deliver_events();
+
+	return err;
+}
+
 int ocpp_step(void)
 {
 	const time_t now = time(NULL);
 
 	ocpp_lock();
 	{
+		m->now = now;
+
+		capture_time(now);
+		capture(OCPP_CAPTURE_STEP, NULL, 0, 0, 0);
+
+		process_inbound_deadlines(&now);
 		process_queued_messages(&now);
 		process_incoming_messages(&now);
 		process_periodic_messages(&now);
 		process_timer_messages(&now);
 	}
-	ocpp_unlock();
+	unlock_and_deliver_events();
 
 	return 0;
 }
 
+size_t ocpp_compute_context_size(void)
+{
+	return sizeof(struct ocpp_context);
+}
+
+struct ocpp_context *ocpp_switch_context(struct ocpp_context *ctx)
+{
+	struct ocpp_context *prev = m;
+
+	m = ctx? ctx : &default_context;
+
+	return prev == &default_context? NULL : prev;
+}
+
+struct ocpp_context *ocpp_get_context(void)
+{
+	return m == &default_context? NULL : m;
+}
+
 int ocpp_init(ocpp_event_callback_t cb, void *cb_ctx)
 {
 	const time_t now = time(NULL);
 
-	memset(&m, 0, sizeof(m));
+	memset(m, 0, sizeof(*m));
 
-	list_init(&m.tx.ready);
-	list_init(&m.tx.wait);
-	list_init(&m.tx.timer);
+	list_init(&m->tx.ready);
+	list_init(&m->tx.wait);
+	list_init(&m->tx.timer);
 
-	m.event_callback = cb;
-	m.event_callback_ctx = cb_ctx;
+	m->event_callback = cb;
+	m->event_callback_ctx = cb_ctx;
+	m->event_mask = OCPP_EVENT_MASK_ALL;
+	m->now = now;
 
 	update_last_tx_timestamp(&now);
 	update_last_rx_timestamp(&now);
 
-	ocpp_reset_configuration();
+	capture_time(now);
+	capture(OCPP_CAPTURE_INIT, NULL, 0, 0, 0);
+
+	/* the configuration is shared, not to be reset by another charge
+	 * point joining */
+	if (m == &default_context) {
+		ocpp_reset_configuration();
+	}
 
 	return 0;
 }
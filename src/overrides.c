@@ -5,10 +5,70 @@
  */
 
 #include "ocpp/overrides.h"
+#include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
-#include <stdio.h>
 
+static uint64_t mix(uint64_t x)
+{
+	/* splitmix64 finalizer */
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+static void put_hex(char *p, uint64_t v)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for (int i = 15; i >= 0; i--) {
+		p[i] = digits[v & 0xf];
+		v >>= 4;
+	}
+}
+
+uint64_t __attribute__((weak)) ocpp_get_random_seed(void)
+{
+	uint64_t seed = (uint64_t)time(NULL);
+	return seed ^ (uint64_t)(uintptr_t)&seed;
+}
+
+/* set once for a session. The first one wins when called at the same time */
+static uint64_t get_prefix(void)
+{
+	static uint64_t prefix;
+	uint64_t p = __atomic_load_n(&prefix, __ATOMIC_ACQUIRE);
+
+	if (p == 0) {
+		const uint64_t fresh = mix(ocpp_get_random_seed()) | 1;
+
+		if (__atomic_compare_exchange_n(&prefix, &p, fresh, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			p = fresh;
+		}
+	}
+
+	return p;
+}
+
+/* 32 hexadecimal digits of a session prefix and a counter, unique in a
+ * session without any formatting. The prefix tells sessions apart as much as
+ * the seed differs from boot to boot. */
 void __attribute__((weak)) ocpp_generate_message_id(void *buf, size_t bufsize)
 {
-	snprintf(buf, bufsize, "%lu", time(NULL));
+	static uint64_t counter;
+	char id[32];
+
+	put_hex(&id[0], get_prefix());
+	put_hex(&id[16], __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED));
+
+	char *p = (char *)buf;
+	size_t i;
+
+	for (i = 0; i < sizeof(id) && i + 1 < bufsize; i++) {
+		p[i] = id[i];
+	}
+	if (bufsize) {
+		p[i] = '\0';
+	}
 }
@@ -0,0 +1,267 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Single-threaded runtime running many charge point contexts over one epoll
+ * set. `ocpp_send()` and `ocpp_recv()` are defined here to go through the
+ * transport of the connection being stepped, so leave out any other
+ * definition such as `ws_overrides.c`. */
+
+#include "ocpp/runtime/gateway.h"
+#include "runtime.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+static struct ocpp_gw_conn *current; /**< the connection being stepped */
+
+static int sync_fd(struct ocpp_gw *gw, struct ocpp_gw_conn *conn)
+{
+	const int fd = conn->api->get_fd(conn->transport);
+	const uint32_t events = fd >= 0?
+		to_epoll_events(conn->api->get_events(conn->transport)) : 0;
+	struct epoll_event ev = {
+		.events = events,
+		.data.ptr = conn,
+	};
+
+	if (fd == conn->fd && events == conn->events) {
+		return 0;
+	}
+
+	if (fd != conn->fd && conn->fd >= 0) {
+		/* the old fd may be closed already, removing it implicitly */
+		epoll_ctl(gw->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+		conn->fd = -1;
+	}
+
+	if (fd >= 0) {
+		const int op = conn->fd == fd? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (epoll_ctl(gw->epfd, op, fd, &ev) != 0) {
+			return -errno;
+		}
+	}
+
+	conn->fd = fd;
+	conn->events = events;
+
+	return 0;
+}
+
+static bool has_pending(const struct ocpp_gw_conn *conn)
+{
+	return conn->api->has_pending != NULL &&
+		conn->api->has_pending(conn->transport);
+}
+
+static time_t get_deadline(const struct ocpp_gw *gw)
+{
+	time_t deadline;
+
+	if (ocpp_get_next_deadline(&deadline) != 0) {
+		deadline = gw->tick + OCPP_GW_IDLE_INTERVAL_SEC;
+	}
+
+	return deadline;
+}
+
+static void step_conn(struct ocpp_gw *gw, struct ocpp_gw_conn *conn,
+		short revents)
+{
+	struct ocpp_context *prev = ocpp_switch_context(conn->ctx);
+	time_t deadline;
+	int budget = OCPP_GW_STEP_BUDGET;
+
+	current = conn;
+
+	conn->api->process(conn->transport, revents);
+
+	/* keep stepping while it makes progress right away, e.g. sending the
+	 * next request on the response of the previous one */
+	do {
+		ocpp_step();
+		deadline = get_deadline(gw);
+	} while (--budget > 0 && (has_pending(conn) || deadline <= gw->tick));
+
+	current = NULL;
+	ocpp_switch_context(prev);
+
+	if (has_pending(conn)) {
+		deadline = gw->tick;
+	} else if (deadline <= gw->tick) {
+		/* what is left for now is not going anywhere in this second,
+		 * e.g. requests held until the boot is accepted */
+		deadline = gw->tick + 1;
+	}
+
+	arm(gw, conn, deadline);
+	sync_fd(gw, conn);
+}
+
+static int compute_timeout(const struct ocpp_gw *gw, int timeout_ms)
+{
+	int ms = -1;
+
+	if (gw->due != NULL) {
+		return 0;
+	}
+
+	if (gw->armed) {
+		ms = get_ms_to_next_second();
+	}
+
+	if (timeout_ms >= 0 && (ms < 0 || timeout_ms < ms)) {
+		ms = timeout_ms;
+	}
+
+	return ms;
+}
+
+int ocpp_gw_run(struct ocpp_gw *gw, int timeout_ms)
+{
+	struct epoll_event events[OCPP_GW_MAX_EVENTS];
+	int stepped = 0;
+
+	if (gw == NULL) {
+		return -EINVAL;
+	}
+
+	const int n = epoll_wait(gw->epfd, events, OCPP_GW_MAX_EVENTS,
+			compute_timeout(gw, timeout_ms));
+
+	if (n < 0 && errno != EINTR) {
+		return -errno;
+	}
+
+	advance_wheel(gw, time(NULL));
+
+	for (int i = 0; i < n; i++) {
+		struct ocpp_gw_conn *conn =
+			(struct ocpp_gw_conn *)events[i].data.ptr;
+		step_conn(gw, conn, to_poll_events(events[i].events));
+		stepped++;
+	}
+
+	/* connections stepped on I/O above are armed again for later, so only
+	 * the ones still due are left. Take the list out first as stepping
+	 * may add to it again. */
+	struct ocpp_gw_conn *due = gw->due;
+	if (due) {
+		due->pprev = &due;
+		gw->due = NULL;
+	}
+
+	while (due) {
+		struct ocpp_gw_conn *conn = due;
+		disarm(gw, conn);
+		step_conn(gw, conn, 0);
+		stepped++;
+	}
+
+	return stepped;
+}
+
+void ocpp_gw_kick(struct ocpp_gw *gw, struct ocpp_gw_conn *conn)
+{
+	arm(gw, conn, gw->tick);
+}
+
+int ocpp_gw_add(struct ocpp_gw *gw, struct ocpp_gw_conn *conn,
+		struct ocpp_context *ctx, const struct ocpp_gw_transport *api,
+		void *transport)
+{
+	if (gw == NULL || conn == NULL || ctx == NULL || api == NULL ||
+			api->get_fd == NULL || api->get_events == NULL ||
+			api->process == NULL || api->send == NULL ||
+			api->recv == NULL) {
+		return -EINVAL;
+	}
+
+	*conn = (struct ocpp_gw_conn) {
+		.ctx = ctx,
+		.api = api,
+		.transport = transport,
+		.fd = -1,
+	};
+
+	int err = sync_fd(gw, conn);
+
+	if (err == 0) {
+		ocpp_gw_kick(gw, conn);
+	}
+
+	return err;
+}
+
+void ocpp_gw_remove(struct ocpp_gw *gw, struct ocpp_gw_conn *conn)
+{
+	disarm(gw, conn);
+
+	if (conn->fd >= 0) {
+		epoll_ctl(gw->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+		conn->fd = -1;
+	}
+
+	if (current == conn) {
+		current = NULL;
+	}
+}
+
+int ocpp_gw_init(struct ocpp_gw *gw)
+{
+	if (gw == NULL) {
+		return -EINVAL;
+	}
+
+	memset(gw, 0, sizeof(*gw));
+
+	if ((gw->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		return -errno;
+	}
+
+	gw->tick = time(NULL);
+
+	return 0;
+}
+
+void ocpp_gw_deinit(struct ocpp_gw *gw)
+{
+	if (gw && gw->epfd >= 0) {
+		close(gw->epfd);
+		gw->epfd = -1;
+	}
+}
+
+int ocpp_send(const struct ocpp_message *msg)
+{
+	if (current == NULL) {
+		return -ENOTCONN;
+	}
+
+	return current->api->send(current->transport, msg);
+}
+
+int ocpp_recv(struct ocpp_message *msg)
+{
+	if (current == NULL) {
+		return -ENOTCONN;
+	}
+
+	return current->api->recv(current->transport, msg);
+}
+
+int ocpp_recv_ready(void)
+{
+	if (current == NULL) {
+		return 0;
+	}
+	if (current->api->has_pending == NULL) {
+		return -ENOTSUP;
+	}
+
+	return current->api->has_pending(current->transport);
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ocpp/runtime/gateway.h"
+#include "ocpp/transport/ws.h"
+
+static int get_fd(const void *transport)
+{
+	return ocpp_ws_get_fd((const struct ocpp_ws *)transport);
+}
+
+static short get_events(const void *transport)
+{
+	return ocpp_ws_get_events((const struct ocpp_ws *)transport);
+}
+
+static int process(void *transport, short revents)
+{
+	return ocpp_ws_process((struct ocpp_ws *)transport, revents);
+}
+
+static int send_message(void *transport, const struct ocpp_message *msg)
+{
+	return ocpp_ws_send((struct ocpp_ws *)transport, msg);
+}
+
+static int recv_message(void *transport, struct ocpp_message *msg)
+{
+	return ocpp_ws_recv((struct ocpp_ws *)transport, msg);
+}
+
+static bool has_pending(const void *transport)
+{
+	return ocpp_ws_has_frame((const struct ocpp_ws *)transport);
+}
+
+const struct ocpp_gw_transport ocpp_gw_ws_transport = {
+	.get_fd = get_fd,
+	.get_events = get_events,
+	.process = process,
+	.send = send_message,
+	.recv = recv_message,
+	.has_pending = has_pending,
+};
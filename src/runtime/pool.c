@@ -0,0 +1,598 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Worker threads stepping charge point contexts with work stealing.
+ * `ocpp_send()` and `ocpp_recv()` are defined here to go through the
+ * transport of the connection being stepped on the calling thread. */
+
+#include "ocpp/runtime/pool.h"
+#include "runtime.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+typedef enum {
+	CONN_IDLE,
+	CONN_QUEUED,
+	CONN_RUNNING,
+	CONN_RERUN, /**< got work while running */
+	CONN_REMOVED,
+} conn_state_t;
+
+/** the connection being stepped by this thread */
+static __thread struct ocpp_pool_conn *current;
+
+static uint64_t get_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool change_state(struct ocpp_pool_conn *conn,
+		conn_state_t from, conn_state_t to)
+{
+	int expected = (int)from;
+	return __atomic_compare_exchange_n(&conn->state, &expected, (int)to,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void enqueue_locked(struct ocpp_pool_worker *w,
+		struct ocpp_pool_conn *conn)
+{
+	conn->qnext = NULL;
+
+	if (w->tail) {
+		w->tail->qnext = conn;
+	} else {
+		w->head = conn;
+	}
+	w->tail = conn;
+	w->len++;
+}
+
+/* a connection is in a run queue if and only if it is CONN_QUEUED, both
+ * changed together under the lock of the queue, so that the one removing it
+ * never misses it on the way to a queue. */
+static bool enqueue(struct ocpp_pool_worker *w, struct ocpp_pool_conn *conn,
+		conn_state_t from)
+{
+	pthread_mutex_lock(&w->lock);
+	const bool queued = change_state(conn, from, CONN_QUEUED);
+	if (queued) {
+		enqueue_locked(w, conn);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return queued;
+}
+
+static struct ocpp_pool_conn *dequeue_locked(struct ocpp_pool_worker *w)
+{
+	struct ocpp_pool_conn *conn = w->head;
+
+	if (conn) {
+		w->head = conn->qnext;
+		if (w->head == NULL) {
+			w->tail = NULL;
+		}
+		w->len--;
+		__atomic_store_n(&conn->state, CONN_RUNNING, __ATOMIC_RELEASE);
+	}
+
+	return conn;
+}
+
+static struct ocpp_pool_conn *dequeue(struct ocpp_pool_worker *w)
+{
+	pthread_mutex_lock(&w->lock);
+	struct ocpp_pool_conn *conn = dequeue_locked(w);
+	pthread_mutex_unlock(&w->lock);
+
+	return conn;
+}
+
+static bool unqueue(struct ocpp_pool *pool, struct ocpp_pool_conn *conn)
+{
+	for (uint8_t i = 0; i < pool->nworkers; i++) {
+		struct ocpp_pool_worker *w = &pool->workers[i];
+		struct ocpp_pool_conn **p = &w->head;
+		struct ocpp_pool_conn *prev = NULL;
+		bool found = false;
+
+		pthread_mutex_lock(&w->lock);
+		while (*p && *p != conn) {
+			prev = *p;
+			p = &(*p)->qnext;
+		}
+		if (*p) {
+			*p = conn->qnext;
+			if (w->tail == conn) {
+				w->tail = prev;
+			}
+			w->len--;
+			__atomic_store_n(&conn->state, CONN_REMOVED,
+					__ATOMIC_RELEASE);
+			found = true;
+		}
+		pthread_mutex_unlock(&w->lock);
+
+		if (found) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static struct ocpp_pool_conn *steal(struct ocpp_pool *pool,
+		struct ocpp_pool_worker *thief)
+{
+	for (uint8_t i = 1; i < pool->nworkers; i++) {
+		struct ocpp_pool_worker *victim =
+			&pool->workers[(thief->id + i) % pool->nworkers];
+		struct ocpp_pool_conn *conn = NULL;
+
+		if (__atomic_load_n(&victim->len, __ATOMIC_RELAXED) == 0 ||
+				pthread_mutex_trylock(&victim->lock) != 0) {
+			continue;
+		}
+		conn = dequeue_locked(victim);
+		pthread_mutex_unlock(&victim->lock);
+
+		if (conn) {
+			__atomic_fetch_add(&thief->stats.steals, 1,
+					__ATOMIC_RELAXED);
+			return conn;
+		}
+	}
+
+	return NULL;
+}
+
+static void wake_up(struct ocpp_pool *pool)
+{
+	const uint64_t one = 1;
+	ssize_t rc = write(pool->wakeup, &one, sizeof(one));
+	(void)rc;
+}
+
+/* only one worker steps a connection at a time. Work coming in while it is
+ * queued is merged and while it is running gets it queued again after. */
+static void schedule(struct ocpp_pool_worker *w, struct ocpp_pool_conn *conn,
+		short revents)
+{
+	__atomic_fetch_or(&conn->revents, revents, __ATOMIC_RELAXED);
+
+	while (1) {
+		const int state = __atomic_load_n(&conn->state,
+				__ATOMIC_ACQUIRE);
+
+		if (state == CONN_IDLE) {
+			if (enqueue(w, conn, CONN_IDLE)) {
+				return;
+			}
+		} else if (state == CONN_RUNNING) {
+			if (change_state(conn, CONN_RUNNING, CONN_RERUN)) {
+				return;
+			}
+		} else {
+			return;
+		}
+	}
+}
+
+static int sync_fd(struct ocpp_pool *pool, struct ocpp_pool_conn *conn)
+{
+	struct ocpp_gw_conn *c = &conn->base;
+	const int fd = c->api->get_fd(c->transport);
+	struct epoll_event ev = {
+		.events = EPOLLONESHOT | (fd >= 0?
+			to_epoll_events(c->api->get_events(c->transport)) : 0),
+		.data.ptr = conn,
+	};
+
+	if (fd != c->fd && c->fd >= 0) {
+		epoll_ctl(pool->gw.epfd, EPOLL_CTL_DEL, c->fd, NULL);
+		c->fd = -1;
+	}
+
+	if (fd >= 0) {
+		/* one-shot, so that only one worker gets an event of it until
+		 * it is stepped */
+		const int op = c->fd == fd? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (epoll_ctl(pool->gw.epfd, op, fd, &ev) != 0) {
+			return -errno;
+		}
+	}
+
+	c->fd = fd;
+	c->events = ev.events;
+
+	return 0;
+}
+
+static void arm_locked(struct ocpp_pool *pool, struct ocpp_gw_conn *conn,
+		time_t expiry)
+{
+	pthread_mutex_lock(&pool->wheel_lock);
+	arm(&pool->gw, conn, expiry);
+	pthread_mutex_unlock(&pool->wheel_lock);
+}
+
+static bool has_pending(const struct ocpp_gw_conn *conn)
+{
+	return conn->api->has_pending != NULL &&
+		conn->api->has_pending(conn->transport);
+}
+
+static void step_conn(struct ocpp_pool *pool, struct ocpp_pool_worker *w,
+		struct ocpp_pool_conn *conn)
+{
+	struct ocpp_gw_conn *c = &conn->base;
+	const short revents = __atomic_exchange_n(&conn->revents, 0,
+			__ATOMIC_RELAXED);
+	struct ocpp_context *prev = ocpp_switch_context(c->ctx);
+	const time_t now = time(NULL);
+	int budget = OCPP_GW_STEP_BUDGET;
+	time_t deadline;
+
+	current = conn;
+	conn->worker = w->id;
+
+	c->api->process(c->transport, revents);
+
+	do {
+		ocpp_step();
+		if (ocpp_get_next_deadline(&deadline) != 0) {
+			deadline = now + OCPP_GW_IDLE_INTERVAL_SEC;
+		}
+	} while (--budget > 0 && (has_pending(c) || deadline <= now));
+
+	__atomic_fetch_add(&w->stats.steps,
+			(unsigned long)(OCPP_GW_STEP_BUDGET - budget),
+			__ATOMIC_RELAXED);
+
+	current = NULL;
+	ocpp_switch_context(prev);
+
+	const bool more = has_pending(c);
+	arm_locked(pool, c, deadline > now? deadline : now + 1);
+	sync_fd(pool, conn);
+
+	/* behind the others in the queue not to starve them. Nothing of it is
+	 * touched after, as it may be removed and freed right away. */
+	if (more && enqueue(w, conn, CONN_RUNNING)) {
+		return;
+	}
+	if (!change_state(conn, CONN_RUNNING, CONN_IDLE)) {
+		enqueue(w, conn, CONN_RERUN);
+	}
+}
+
+static void poll_work(struct ocpp_pool *pool, struct ocpp_pool_worker *w)
+{
+	struct epoll_event events[OCPP_GW_MAX_EVENTS];
+	int timeout = OCPP_POOL_POLL_INTERVAL_MS;
+
+	if (__atomic_load_n(&pool->gw.armed, __ATOMIC_RELAXED)) {
+		const int ms = get_ms_to_next_second();
+		timeout = ms < timeout? ms : timeout;
+	}
+
+	/* odd until the events are handled, for the one removing a
+	 * connection to wait for an event of it in hand */
+	__atomic_add_fetch(&w->polls, 1, __ATOMIC_SEQ_CST);
+	const int n = epoll_wait(pool->gw.epfd, events, OCPP_GW_MAX_EVENTS,
+			timeout);
+
+	for (int i = 0; i < n; i++) {
+		if (events[i].data.ptr == &pool->wakeup) {
+			uint64_t count;
+			if (!__atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) {
+				ssize_t rc = read(pool->wakeup,
+						&count, sizeof(count));
+				(void)rc;
+			}
+			continue;
+		}
+
+		schedule(w, (struct ocpp_pool_conn *)events[i].data.ptr,
+				to_poll_events(events[i].events));
+	}
+	__atomic_add_fetch(&w->polls, 1, __ATOMIC_SEQ_CST);
+
+	/* a worker busy on the wheel already does it for the others */
+	if (pthread_mutex_trylock(&pool->wheel_lock) == 0) {
+		const time_t now = time(NULL);
+
+		if (now > pool->gw.tick) {
+			advance_wheel(&pool->gw, now);
+		}
+
+		while (pool->gw.due) {
+			struct ocpp_gw_conn *c = pool->gw.due;
+			disarm(&pool->gw, c);
+			schedule(w, (struct ocpp_pool_conn *)c, 0);
+		}
+
+		pthread_mutex_unlock(&pool->wheel_lock);
+	}
+
+	/* more than one to do, call for a thief */
+	if (__atomic_load_n(&w->len, __ATOMIC_RELAXED) > 1) {
+		wake_up(pool);
+	}
+}
+
+static void *run_worker(void *arg)
+{
+	struct ocpp_pool_worker *w = (struct ocpp_pool_worker *)arg;
+	struct ocpp_pool *pool = w->pool;
+
+	while (!__atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) {
+		const uint64_t t0 = get_ns();
+		struct ocpp_pool_conn *conn = dequeue(w);
+
+		if (conn == NULL) {
+			conn = steal(pool, w);
+		}
+
+		if (conn) {
+			step_conn(pool, w, conn);
+			__atomic_fetch_add(&w->stats.busy_ns, get_ns() - t0,
+					__ATOMIC_RELAXED);
+		} else {
+			poll_work(pool, w);
+			__atomic_fetch_add(&w->stats.idle_ns, get_ns() - t0,
+					__ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+int ocpp_pool_get_stats(struct ocpp_pool *pool, int worker,
+		struct ocpp_pool_stats *stats)
+{
+	if (pool == NULL || stats == NULL ||
+			worker < 0 || worker >= pool->nworkers) {
+		return -EINVAL;
+	}
+
+	struct ocpp_pool_stats *p = &pool->workers[worker].stats;
+
+	stats->busy_ns = __atomic_load_n(&p->busy_ns, __ATOMIC_RELAXED);
+	stats->idle_ns = __atomic_load_n(&p->idle_ns, __ATOMIC_RELAXED);
+	stats->steps = __atomic_load_n(&p->steps, __ATOMIC_RELAXED);
+	stats->steals = __atomic_load_n(&p->steals, __ATOMIC_RELAXED);
+
+	const uint64_t total = stats->busy_ns + stats->idle_ns;
+	stats->utilization = (uint8_t)(total?
+			stats->busy_ns * 100 / total : 0);
+
+	return 0;
+}
+
+void ocpp_pool_kick(struct ocpp_pool *pool, struct ocpp_pool_conn *conn)
+{
+	schedule(&pool->workers[conn->worker], conn, 0);
+	wake_up(pool);
+}
+
+int ocpp_pool_add(struct ocpp_pool *pool, struct ocpp_pool_conn *conn,
+		struct ocpp_context *ctx, const struct ocpp_gw_transport *api,
+		void *transport)
+{
+	if (pool == NULL || conn == NULL || ctx == NULL || api == NULL ||
+			api->get_fd == NULL || api->get_events == NULL ||
+			api->process == NULL || api->send == NULL ||
+			api->recv == NULL) {
+		return -EINVAL;
+	}
+
+	*conn = (struct ocpp_pool_conn) {
+		.base = {
+			.ctx = ctx,
+			.api = api,
+			.transport = transport,
+			.fd = -1,
+		},
+		.state = CONN_QUEUED,
+		.worker = pool->next_worker,
+	};
+
+	pool->next_worker = (uint8_t)((pool->next_worker + 1) %
+			pool->nworkers);
+
+	/* registered before queued, so that a worker does not step it
+	 * while being registered */
+	int err = sync_fd(pool, conn);
+
+	if (err == 0) {
+		struct ocpp_pool_worker *w = &pool->workers[conn->worker];
+		pthread_mutex_lock(&w->lock);
+		enqueue_locked(w, conn);
+		pthread_mutex_unlock(&w->lock);
+		wake_up(pool);
+	}
+
+	return err;
+}
+
+static void wait_for_polls(struct ocpp_pool *pool)
+{
+	for (uint8_t i = 0; i < pool->nworkers; i++) {
+		struct ocpp_pool_worker *w = &pool->workers[i];
+		const unsigned int polls = __atomic_load_n(&w->polls,
+				__ATOMIC_SEQ_CST);
+
+		while ((polls & 1) && polls == __atomic_load_n(&w->polls,
+				__ATOMIC_SEQ_CST)) {
+			sched_yield();
+		}
+	}
+}
+
+void ocpp_pool_remove(struct ocpp_pool *pool, struct ocpp_pool_conn *conn)
+{
+	struct ocpp_gw_conn *c = &conn->base;
+
+	/* the timer wheel is handled under the lock, so no more from there
+	 * once disarmed */
+	pthread_mutex_lock(&pool->wheel_lock);
+	disarm(&pool->gw, c);
+	pthread_mutex_unlock(&pool->wheel_lock);
+
+	/* queued is out of the queue, otherwise it is on the way to another
+	 * queue or running to be waited for */
+	while (!unqueue(pool, conn) &&
+			!change_state(conn, CONN_IDLE, CONN_REMOVED)) {
+		sched_yield();
+	}
+
+	/* once more for the step that has been just finished */
+	pthread_mutex_lock(&pool->wheel_lock);
+	disarm(&pool->gw, c);
+	pthread_mutex_unlock(&pool->wheel_lock);
+
+	if (c->fd >= 0) {
+		epoll_ctl(pool->gw.epfd, EPOLL_CTL_DEL, c->fd, NULL);
+		c->fd = -1;
+	}
+
+	/* an event of it taken out of the epoll set before deleted may still
+	 * be on the way to schedule() */
+	wait_for_polls(pool);
+}
+
+int ocpp_pool_start(struct ocpp_pool *pool)
+{
+	if (pool == NULL || pool->running) {
+		return -EINVAL;
+	}
+
+	pool->stop = false;
+
+	for (uint8_t i = 0; i < pool->nworkers; i++) {
+		int err = pthread_create(&pool->workers[i].thread, NULL,
+				run_worker, &pool->workers[i]);
+		if (err) {
+			pool->nworkers = i;
+			ocpp_pool_stop(pool);
+			return -err;
+		}
+	}
+
+	pool->running = true;
+
+	return 0;
+}
+
+void ocpp_pool_stop(struct ocpp_pool *pool)
+{
+	__atomic_store_n(&pool->stop, true, __ATOMIC_RELAXED);
+	wake_up(pool);
+
+	for (uint8_t i = 0; i < pool->nworkers; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+
+	pool->running = false;
+}
+
+int ocpp_pool_init(struct ocpp_pool *pool, int nworkers)
+{
+	if (pool == NULL || nworkers <= 0 ||
+			nworkers > OCPP_POOL_MAX_WORKERS) {
+		return -EINVAL;
+	}
+
+	memset(pool, 0, sizeof(*pool));
+
+	if ((pool->gw.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		return -errno;
+	}
+
+	if ((pool->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		const int err = -errno;
+		close(pool->gw.epfd);
+		return err;
+	}
+
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = &pool->wakeup,
+	};
+	epoll_ctl(pool->gw.epfd, EPOLL_CTL_ADD, pool->wakeup, &ev);
+
+	pthread_mutex_init(&pool->wheel_lock, NULL);
+
+	pool->gw.tick = time(NULL);
+	pool->nworkers = (uint8_t)nworkers;
+
+	for (uint8_t i = 0; i < pool->nworkers; i++) {
+		struct ocpp_pool_worker *w = &pool->workers[i];
+		w->pool = pool;
+		w->id = i;
+		pthread_mutex_init(&w->lock, NULL);
+	}
+
+	return 0;
+}
+
+void ocpp_pool_deinit(struct ocpp_pool *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	if (pool->running) {
+		ocpp_pool_stop(pool);
+	}
+
+	for (uint8_t i = 0; i < pool->nworkers; i++) {
+		pthread_mutex_destroy(&pool->workers[i].lock);
+	}
+
+	pthread_mutex_destroy(&pool->wheel_lock);
+	close(pool->wakeup);
+	close(pool->gw.epfd);
+}
+
+int ocpp_send(const struct ocpp_message *msg)
+{
+	if (current == NULL) {
+		return -ENOTCONN;
+	}
+
+	return current->base.api->send(current->base.transport, msg);
+}
+
+int ocpp_recv(struct ocpp_message *msg)
+{
+	if (current == NULL) {
+		return -ENOTCONN;
+	}
+
+	return current->base.api->recv(current->base.transport, msg);
+}
+
+int ocpp_recv_ready(void)
+{
+	if (current == NULL) {
+		return 0;
+	}
+	if (current->base.api->has_pending == NULL) {
+		return -ENOTSUP;
+	}
+
+	return current->base.api->has_pending(current->base.transport);
+}
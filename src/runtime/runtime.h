@@ -0,0 +1,131 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Helpers shared by the runtimes: conversion of poll events and the timer
+ * wheel of connections. The wheel is not synchronized. */
+
+#ifndef OCPP_RUNTIME_H
+#define OCPP_RUNTIME_H
+
+#include "ocpp/runtime/gateway.h"
+#include <poll.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+#define WHEEL_MASK				(OCPP_GW_WHEEL_SLOTS - 1)
+
+static inline uint32_t to_epoll_events(short events)
+{
+	uint32_t ev = 0;
+
+	if (events & POLLIN) {
+		ev |= EPOLLIN;
+	}
+	if (events & POLLOUT) {
+		ev |= EPOLLOUT;
+	}
+
+	return ev;
+}
+
+static inline short to_poll_events(uint32_t ev)
+{
+	short revents = 0;
+
+	if (ev & EPOLLIN) {
+		revents |= POLLIN;
+	}
+	if (ev & EPOLLOUT) {
+		revents |= POLLOUT;
+	}
+	if (ev & EPOLLERR) {
+		revents |= POLLERR;
+	}
+	if (ev & EPOLLHUP) {
+		revents |= POLLHUP;
+	}
+
+	return revents;
+}
+
+static inline void link_conn(struct ocpp_gw_conn **head, struct ocpp_gw_conn *conn)
+{
+	conn->next = *head;
+	conn->pprev = head;
+	if (*head) {
+		(*head)->pprev = &conn->next;
+	}
+	*head = conn;
+}
+
+static inline void unlink_conn(struct ocpp_gw_conn *conn)
+{
+	*conn->pprev = conn->next;
+	if (conn->next) {
+		conn->next->pprev = conn->pprev;
+	}
+	conn->next = NULL;
+	conn->pprev = NULL;
+}
+
+static inline void disarm(struct ocpp_gw *gw, struct ocpp_gw_conn *conn)
+{
+	if (conn->pprev == NULL) {
+		return;
+	}
+
+	unlink_conn(conn);
+	gw->armed--;
+}
+
+static inline void arm(struct ocpp_gw *gw, struct ocpp_gw_conn *conn, time_t expiry)
+{
+	disarm(gw, conn);
+
+	conn->expiry = expiry;
+	gw->armed++;
+
+	if (expiry <= gw->tick) {
+		link_conn(&gw->due, conn);
+	} else {
+		link_conn(&gw->wheel[expiry & WHEEL_MASK], conn);
+	}
+}
+
+static inline void advance_wheel(struct ocpp_gw *gw, time_t now)
+{
+	/* a whole turn visits every slot once, however long it has been */
+	const time_t from = now - gw->tick > OCPP_GW_WHEEL_SLOTS?
+		now - OCPP_GW_WHEEL_SLOTS : gw->tick;
+
+	for (time_t t = from + 1; t <= now; t++) {
+		struct ocpp_gw_conn *conn = gw->wheel[t & WHEEL_MASK];
+
+		while (conn) {
+			struct ocpp_gw_conn *next = conn->next;
+
+			if (conn->expiry <= now) {
+				unlink_conn(conn);
+				link_conn(&gw->due, conn);
+			}
+
+			conn = next;
+		}
+	}
+
+	gw->tick = now;
+}
+
+/* time() has the resolution of a second. Wake up a bit after the next second
+ * boundary. */
+static inline int get_ms_to_next_second(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int)(1000 - ts.tv_nsec / 1000000) + 1;
+}
+
+#endif /* OCPP_RUNTIME_H */
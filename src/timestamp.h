@@ -0,0 +1,24 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* The default timestamp of the trace and capture records, included only when
+ * they are enabled not to require clock_gettime() on targets without it. */
+
+#ifndef OCPP_TIMESTAMP_H
+#define OCPP_TIMESTAMP_H
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint32_t get_monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000u +
+			(uint64_t)ts.tv_nsec / 1000u);
+}
+
+#endif /* OCPP_TIMESTAMP_H */
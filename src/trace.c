@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ocpp/trace.h"
+#include <string.h>
+
+#if OCPP_TRACE_LEN > 0
+#include "timestamp.h"
+
+#if (OCPP_TRACE_LEN & (OCPP_TRACE_LEN - 1)) != 0
+#error "OCPP_TRACE_LEN should be a power of two"
+#endif
+
+static struct {
+	struct ocpp_trace_record ring[OCPP_TRACE_LEN];
+	uint32_t head; /**< total number of records ever written */
+} m;
+
+uint32_t __attribute__((weak)) ocpp_trace_get_timestamp(void)
+{
+	return get_monotonic_us();
+}
+#endif
+
+void ocpp_trace_write(ocpp_trace_event_t event, ocpp_message_t type,
+		uint16_t slot, uint32_t attempts)
+{
+#if OCPP_TRACE_LEN > 0
+	const uint32_t index = __atomic_fetch_add(&m.head, 1, __ATOMIC_RELAXED);
+	struct ocpp_trace_record *rec = &m.ring[index & (OCPP_TRACE_LEN - 1)];
+
+	rec->timestamp = ocpp_trace_get_timestamp();
+	rec->slot = slot;
+	rec->event = (uint8_t)event;
+	rec->type = (uint8_t)type;
+	rec->attempts = (uint8_t)(attempts > UINT8_MAX? UINT8_MAX : attempts);
+#else
+	(void)event;
+	(void)type;
+	(void)slot;
+	(void)attempts;
+#endif
+}
+
+size_t ocpp_trace_dump(void *buf, size_t bufsize)
+{
+	struct ocpp_trace_header hdr = {
+		.magic = OCPP_TRACE_MAGIC,
+		.version = OCPP_TRACE_VERSION,
+		.record_size = sizeof(struct ocpp_trace_record),
+	};
+
+	if (buf == NULL || bufsize < sizeof(hdr)) {
+		return 0;
+	}
+
+#if OCPP_TRACE_LEN > 0
+	const uint32_t head = __atomic_load_n(&m.head, __ATOMIC_ACQUIRE);
+	const size_t room = (bufsize - sizeof(hdr)) / sizeof(m.ring[0]);
+	uint32_t count = head > OCPP_TRACE_LEN? OCPP_TRACE_LEN : head;
+
+	if (count > room) {
+		count = (uint32_t)room;
+	}
+
+	hdr.count = count;
+	/* not the ones left out for the buffer given */
+	hdr.overwritten = head > OCPP_TRACE_LEN? head - OCPP_TRACE_LEN : 0;
+
+	struct ocpp_trace_record *p = (struct ocpp_trace_record *)
+		(void *)((uint8_t *)buf + sizeof(hdr));
+
+	for (uint32_t i = head - count; i != head; i++) {
+		*p++ = m.ring[i & (OCPP_TRACE_LEN - 1)];
+	}
+#endif
+
+	memcpy(buf, &hdr, sizeof(hdr));
+
+	return sizeof(hdr) + hdr.count * sizeof(struct ocpp_trace_record);
+}
+
+size_t ocpp_compute_trace_dump_size(void)
+{
+	return sizeof(struct ocpp_trace_header) +
+		OCPP_TRACE_LEN * sizeof(struct ocpp_trace_record);
+}
+
+void ocpp_trace_clear(void)
+{
+#if OCPP_TRACE_LEN > 0
+	__atomic_store_n(&m.head, 0, __ATOMIC_RELEASE);
+#endif
+}
@@ -0,0 +1,1032 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ocpp/transport/ws.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define WS_GUID			"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_HEADER_LEN	14 /* 2 + 8 of extended length + 4 of mask */
+
+#define WS_FIN			0x80u
+#define WS_MASK			0x80u
+
+enum {
+	WS_OP_CONTINUATION	= 0x0,
+	WS_OP_TEXT		= 0x1,
+	WS_OP_BINARY		= 0x2,
+	WS_OP_CLOSE		= 0x8,
+	WS_OP_PING		= 0x9,
+	WS_OP_PONG		= 0xA,
+};
+
+#define WS_CLOSE_NORMAL		1000
+#define WS_CLOSE_PROTOCOL	1002
+#define WS_CLOSE_TOO_BIG	1009
+
+struct frame {
+	uint8_t opcode;
+	bool fin;
+	size_t offset; /**< of payload */
+	size_t len; /**< of payload */
+};
+
+static struct ocpp_ws *bound;
+
+static uint64_t get_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+void __attribute__((weak)) ocpp_ws_lock(struct ocpp_ws *ws)
+{
+	(void)ws;
+}
+
+void __attribute__((weak)) ocpp_ws_unlock(struct ocpp_ws *ws)
+{
+	(void)ws;
+}
+
+uint32_t __attribute__((weak)) ocpp_ws_get_random(void)
+{
+	static uint32_t x;
+
+	if (x == 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		x = (uint32_t)ts.tv_nsec ^ (uint32_t)ts.tv_sec ^
+			(uint32_t)(uintptr_t)&ts;
+		x = x? x : 0x9e3779b9u;
+	}
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return x;
+}
+
+static uint32_t rol(uint32_t x, int n)
+{
+	return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const uint8_t *p)
+{
+	uint32_t w[80];
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+	for (int i = 0; i < 16; i++) {
+		w[i] = (uint32_t)p[i*4] << 24 | (uint32_t)p[i*4+1] << 16 |
+			(uint32_t)p[i*4+2] << 8 | (uint32_t)p[i*4+3];
+	}
+	for (int i = 16; i < 80; i++) {
+		w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+	}
+
+	for (int i = 0; i < 80; i++) {
+		uint32_t f, k;
+
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999u;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1u;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdcu;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6u;
+		}
+
+		const uint32_t t = rol(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = rol(b, 30);
+		b = a;
+		a = t;
+	}
+
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+}
+
+static void sha1(const void *data, size_t len, uint8_t digest[20])
+{
+	uint32_t h[5] = {
+		0x67452301u, 0xefcdab89u, 0x98badcfeu, 0x10325476u, 0xc3d2e1f0u,
+	};
+	const uint8_t *p = (const uint8_t *)data;
+	uint8_t block[64];
+	size_t left = len;
+
+	for (; left >= 64; left -= 64, p += 64) {
+		sha1_block(h, p);
+	}
+
+	memset(block, 0, sizeof(block));
+	memcpy(block, p, left);
+	block[left] = 0x80;
+
+	if (left >= 56) {
+		sha1_block(h, block);
+		memset(block, 0, sizeof(block));
+	}
+
+	const uint64_t bits = (uint64_t)len * 8;
+	for (int i = 0; i < 8; i++) {
+		block[63 - i] = (uint8_t)(bits >> (i * 8));
+	}
+	sha1_block(h, block);
+
+	for (int i = 0; i < 5; i++) {
+		digest[i*4] = (uint8_t)(h[i] >> 24);
+		digest[i*4+1] = (uint8_t)(h[i] >> 16);
+		digest[i*4+2] = (uint8_t)(h[i] >> 8);
+		digest[i*4+3] = (uint8_t)h[i];
+	}
+}
+
+static void base64(const uint8_t *data, size_t len, char *out)
+{
+	static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+		"abcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	for (size_t i = 0; i < len; i += 3) {
+		const uint32_t v = (uint32_t)data[i] << 16 |
+			(i + 1 < len? (uint32_t)data[i+1] << 8 : 0) |
+			(i + 2 < len? (uint32_t)data[i+2] : 0);
+
+		*out++ = tbl[(v >> 18) & 0x3f];
+		*out++ = tbl[(v >> 12) & 0x3f];
+		*out++ = i + 1 < len? tbl[(v >> 6) & 0x3f] : '=';
+		*out++ = i + 2 < len? tbl[v & 0x3f] : '=';
+	}
+
+	*out = '\0';
+}
+
+static ssize_t io_read(struct ocpp_ws *ws, void *buf, size_t bufsize)
+{
+	if (ws->has_tls) {
+		return (*ws->tls.read)(ws->fd, buf, bufsize, ws->tls.ctx);
+	}
+
+	const ssize_t n = recv(ws->fd, buf, bufsize, MSG_DONTWAIT);
+
+	if (n < 0) {
+		return errno == EWOULDBLOCK? -EAGAIN : -errno;
+	}
+
+	return n;
+}
+
+static ssize_t io_write(struct ocpp_ws *ws, const void *data, size_t datasize)
+{
+	if (ws->has_tls) {
+		return (*ws->tls.write)(ws->fd, data, datasize, ws->tls.ctx);
+	}
+
+	const ssize_t n = send(ws->fd, data, datasize,
+			MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	if (n < 0) {
+		return errno == EWOULDBLOCK? -EAGAIN : -errno;
+	}
+
+	return n;
+}
+
+static void shut(struct ocpp_ws *ws)
+{
+	if (ws->fd >= 0) {
+		if (ws->has_tls && ws->tls.close) {
+			(*ws->tls.close)(ws->fd, ws->tls.ctx);
+		}
+		close(ws->fd);
+	}
+
+	ws->fd = -1;
+	ws->state = OCPP_WS_STATE_CLOSED;
+	ws->rx_len = 0;
+	ws->tx_len = 0;
+	ws->frag_len = 0;
+	ws->frag_opcode = 0;
+}
+
+static int flush_tx(struct ocpp_ws *ws)
+{
+	while (ws->tx_len > 0) {
+		const ssize_t n = io_write(ws, ws->tx, ws->tx_len);
+
+		if (n == -EAGAIN) {
+			return 0;
+		} else if (n < 0) {
+			return (int)n;
+		}
+
+		memmove(ws->tx, &ws->tx[n], ws->tx_len - (size_t)n);
+		ws->tx_len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/* The end of the stream is reported only after the frames received before it
+ * are consumed, not to lose them. */
+static int fill_rx(struct ocpp_ws *ws)
+{
+	while (!ws->eof && ws->rx_len < OCPP_WS_RX_BUFSIZE) {
+		const ssize_t n = io_read(ws, &ws->rx[ws->rx_len],
+				OCPP_WS_RX_BUFSIZE - ws->rx_len);
+
+		if (n == -EAGAIN) {
+			break;
+		} else if (n == 0) {
+			ws->eof = true;
+		} else if (n < 0) {
+			return (int)n;
+		} else {
+			ws->rx_len += (size_t)n;
+		}
+	}
+
+	if (ws->eof && !ocpp_ws_has_frame(ws)) {
+		return -ECONNRESET;
+	}
+
+	return 0;
+}
+
+static size_t get_header_len(size_t len)
+{
+	return 2 + 4 + (len > 0xffff? 8 : len > 125? 2 : 0);
+}
+
+static void write_header(uint8_t *p, uint8_t opcode, size_t len,
+		const uint8_t mask[4])
+{
+	*p++ = (uint8_t)(WS_FIN | opcode);
+
+	if (len > 0xffff) {
+		*p++ = WS_MASK | 127;
+		for (int i = 7; i >= 0; i--) {
+			*p++ = (uint8_t)((uint64_t)len >> (i * 8));
+		}
+	} else if (len > 125) {
+		*p++ = WS_MASK | 126;
+		*p++ = (uint8_t)(len >> 8);
+		*p++ = (uint8_t)len;
+	} else {
+		*p++ = (uint8_t)(WS_MASK | len);
+	}
+
+	memcpy(p, mask, 4);
+}
+
+/* The payload is at WS_MAX_HEADER_LEN past the end of the transmit buffer. */
+static void commit_frame(struct ocpp_ws *ws, uint8_t opcode, size_t len)
+{
+	const size_t hdrlen = get_header_len(len);
+	uint8_t *frame = &ws->tx[ws->tx_len];
+	const uint32_t r = ocpp_ws_get_random();
+	const uint8_t mask[4] = {
+		(uint8_t)r, (uint8_t)(r >> 8),
+		(uint8_t)(r >> 16), (uint8_t)(r >> 24),
+	};
+
+	memmove(&frame[hdrlen], &frame[WS_MAX_HEADER_LEN], len);
+	write_header(frame, opcode, len, mask);
+
+	for (size_t i = 0; i < len; i++) {
+		frame[hdrlen + i] ^= mask[i & 3];
+	}
+
+	ws->tx_len += hdrlen + len;
+}
+
+static int queue_frame(struct ocpp_ws *ws, uint8_t opcode,
+		const void *payload, size_t len)
+{
+	if (ws->tx_len + WS_MAX_HEADER_LEN + len > OCPP_WS_TX_BUFSIZE) {
+		return -ENOBUFS;
+	}
+
+	memcpy(&ws->tx[ws->tx_len + WS_MAX_HEADER_LEN], payload, len);
+	commit_frame(ws, opcode, len);
+
+	return 0;
+}
+
+static int queue_close(struct ocpp_ws *ws, uint16_t code)
+{
+	const uint8_t payload[2] = { (uint8_t)(code >> 8), (uint8_t)code };
+	return queue_frame(ws, WS_OP_CLOSE, payload, sizeof(payload));
+}
+
+static int fail(struct ocpp_ws *ws, uint16_t code, int err)
+{
+	if (ws->state == OCPP_WS_STATE_OPEN) {
+		queue_close(ws, code);
+		flush_tx(ws);
+	}
+
+	shut(ws);
+
+	return err;
+}
+
+/* The frame is parsed past the fragments put together so far. */
+static int parse_frame(struct ocpp_ws *ws, struct frame *f)
+{
+	const size_t base = ws->frag_len;
+	const size_t avail = ws->rx_len - base;
+	const uint8_t *p = &ws->rx[base];
+	size_t hdrlen = 2;
+
+	if (avail < 2) {
+		return -ENOMSG;
+	}
+
+	f->fin = (p[0] & WS_FIN) != 0;
+	f->opcode = p[0] & 0x0f;
+	f->len = p[1] & 0x7f;
+
+	if (f->len == 126) {
+		hdrlen += 2;
+	} else if (f->len == 127) {
+		hdrlen += 8;
+	}
+	if (p[1] & WS_MASK) {
+		hdrlen += 4;
+	}
+	if (avail < hdrlen) {
+		return -ENOMSG;
+	}
+
+	if (f->len == 126) {
+		f->len = (size_t)p[2] << 8 | p[3];
+	} else if (f->len == 127) {
+		uint64_t len = 0;
+		for (int i = 0; i < 8; i++) {
+			len = len << 8 | p[2 + i];
+		}
+		if (len > OCPP_WS_RX_BUFSIZE) {
+			return -EMSGSIZE;
+		}
+		f->len = (size_t)len;
+	}
+
+	f->offset = base + hdrlen;
+
+	if (f->offset + f->len > OCPP_WS_RX_BUFSIZE) {
+		return -EMSGSIZE;
+	}
+	if (avail < hdrlen + f->len) {
+		return -ENOMSG;
+	}
+
+	if (p[1] & WS_MASK) { /* servers should not mask but unmask anyway */
+		uint8_t *payload = &ws->rx[f->offset];
+		const uint8_t *mask = &p[hdrlen - 4];
+		for (size_t i = 0; i < f->len; i++) {
+			payload[i] ^= mask[i & 3];
+		}
+	}
+
+	return 0;
+}
+
+static void consume_rx(struct ocpp_ws *ws, size_t len)
+{
+	memmove(&ws->rx[ws->frag_len], &ws->rx[ws->frag_len + len],
+			ws->rx_len - ws->frag_len - len);
+	ws->rx_len -= len;
+}
+
+/* Fragments of a message are put together at the start of the receive
+ * buffer, leaving the headers in between out. */
+static void join_fragment(struct ocpp_ws *ws, const struct frame *f)
+{
+	const size_t hdrlen = f->offset - ws->frag_len;
+
+	memmove(&ws->rx[ws->frag_len], &ws->rx[f->offset],
+			ws->rx_len - f->offset);
+	ws->rx_len -= hdrlen;
+	ws->frag_len += f->len;
+}
+
+static int decode_text(struct ocpp_ws *ws, size_t offset, size_t len,
+		struct ocpp_message *msg)
+{
+	uint8_t *text = &ws->rx[offset];
+	/* the buffer has a spare byte past the end */
+	const uint8_t saved = text[len];
+
+	text[len] = '\0';
+	const int err = (*ws->codec.decode)((const char *)text,
+			len, msg, ws->codec.ctx);
+	text[len] = saved;
+
+	return err;
+}
+
+static int request_upgrade(struct ocpp_ws *ws)
+{
+	uint8_t nonce[16];
+
+	for (size_t i = 0; i < sizeof(nonce); i += 4) {
+		const uint32_t r = ocpp_ws_get_random();
+		memcpy(&nonce[i], &r, sizeof(r));
+	}
+	base64(nonce, sizeof(nonce), ws->key);
+
+	int len = snprintf((char *)ws->tx, OCPP_WS_TX_BUFSIZE,
+			"GET %s HTTP/1.1\r\n"
+			"Host: %s:%u\r\n"
+			"Upgrade: websocket\r\n"
+			"Connection: Upgrade\r\n"
+			"Sec-WebSocket-Key: %s\r\n"
+			"Sec-WebSocket-Version: 13\r\n"
+			"Sec-WebSocket-Protocol: %s\r\n",
+			ws->path, ws->host, ws->param.port, ws->key,
+			ws->param.protocol);
+
+	if (len > 0 && ws->param.authorization) {
+		len += snprintf((char *)&ws->tx[len],
+				OCPP_WS_TX_BUFSIZE - (size_t)len,
+				"Authorization: %s\r\n",
+				ws->param.authorization);
+	}
+	if (len > 0 && (size_t)len < OCPP_WS_TX_BUFSIZE) {
+		len += snprintf((char *)&ws->tx[len],
+				OCPP_WS_TX_BUFSIZE - (size_t)len, "\r\n");
+	}
+	if (len <= 0 || (size_t)len >= OCPP_WS_TX_BUFSIZE) {
+		return -ENOBUFS;
+	}
+
+	ws->tx_len = (size_t)len;
+	ws->state = OCPP_WS_STATE_HANDSHAKE;
+
+	return flush_tx(ws);
+}
+
+static const char *find_header(const char *headers, const char *name,
+		size_t *len)
+{
+	const size_t namelen = strlen(name);
+	const char *p = strstr(headers, "\r\n");
+
+	while (p && p[2] != '\r') {
+		p += 2;
+
+		const char *eol = strstr(p, "\r\n");
+
+		if (eol && strncasecmp(p, name, namelen) == 0 &&
+				p[namelen] == ':') {
+			const char *v = &p[namelen + 1];
+			while (*v == ' ' || *v == '\t') {
+				v++;
+			}
+			*len = (size_t)(eol - v);
+			while (*len > 0 && (v[*len-1] == ' ' || v[*len-1] == '\t')) {
+				(*len)--;
+			}
+			return v;
+		}
+
+		p = eol;
+	}
+
+	return NULL;
+}
+
+static int check_upgrade(struct ocpp_ws *ws)
+{
+	char *headers = (char *)ws->rx;
+
+	ws->rx[ws->rx_len] = '\0';
+
+	char *end = strstr(headers, "\r\n\r\n");
+
+	if (end == NULL) {
+		return ws->rx_len < OCPP_WS_RX_BUFSIZE? -EAGAIN : -EMSGSIZE;
+	}
+
+	const size_t hdrlen = (size_t)(end - headers) + 4;
+	end[2] = '\0'; /* keep the last CRLF for find_header() */
+
+	if (strncmp(headers, "HTTP/1.1 101", 12) != 0) {
+		return -ECONNREFUSED;
+	}
+
+	char keybuf[sizeof(ws->key) + sizeof(WS_GUID)];
+	uint8_t digest[20];
+	char expected[29];
+	size_t len;
+
+	snprintf(keybuf, sizeof(keybuf), "%s%s", ws->key, WS_GUID);
+	sha1(keybuf, strlen(keybuf), digest);
+	base64(digest, sizeof(digest), expected);
+
+	const char *accept = find_header(headers,
+			"Sec-WebSocket-Accept", &len);
+	if (accept == NULL || len != strlen(expected) ||
+			memcmp(accept, expected, len) != 0) {
+		return -EPROTO;
+	}
+
+	const char *protocol = find_header(headers,
+			"Sec-WebSocket-Protocol", &len);
+	if (protocol && (len != strlen(ws->param.protocol) ||
+			memcmp(protocol, ws->param.protocol, len) != 0)) {
+		return -EPROTO;
+	}
+
+	consume_rx(ws, hdrlen);
+
+	ws->state = OCPP_WS_STATE_OPEN;
+	ws->last_ping_ms = get_ms();
+
+	return 0;
+}
+
+static int process_connecting(struct ocpp_ws *ws, short revents)
+{
+	if (!(revents & (POLLOUT | POLLERR | POLLHUP))) {
+		struct pollfd pfd = { .fd = ws->fd, .events = POLLOUT, };
+		if (poll(&pfd, 1, 0) <= 0) {
+			return 0;
+		}
+	}
+
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if (getsockopt(ws->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+		return -errno;
+	} else if (err) {
+		return -err;
+	}
+
+	if (ws->has_tls) {
+		ws->state = OCPP_WS_STATE_TLS_HANDSHAKE;
+		return 0;
+	}
+
+	return request_upgrade(ws);
+}
+
+static void process_ping(struct ocpp_ws *ws)
+{
+	if (ws->param.ping_interval_sec == 0 ||
+			ws->state != OCPP_WS_STATE_OPEN) {
+		return;
+	}
+
+	const uint64_t now = get_ms();
+
+	if (now - ws->last_ping_ms < ws->param.ping_interval_sec * 1000u) {
+		return;
+	}
+
+	/* try again next time if the buffer is full */
+	if (queue_frame(ws, WS_OP_PING, NULL, 0) == 0) {
+		ws->last_ping_ms = now;
+	}
+}
+
+static int process(struct ocpp_ws *ws, short revents)
+{
+	int err = 0;
+
+	switch (ws->state) {
+	case OCPP_WS_STATE_CLOSED:
+		return -ENOTCONN;
+	case OCPP_WS_STATE_CONNECTING:
+		if ((err = process_connecting(ws, revents)) != 0 ||
+				ws->state == OCPP_WS_STATE_CONNECTING) {
+			break;
+		}
+		/* fall through */
+	case OCPP_WS_STATE_TLS_HANDSHAKE:
+		if (ws->state == OCPP_WS_STATE_TLS_HANDSHAKE) {
+			err = (*ws->tls.handshake)(ws->fd, ws->tls.ctx);
+			if (err == -EAGAIN) {
+				err = 0;
+				break;
+			} else if (err || (err = request_upgrade(ws)) != 0) {
+				break;
+			}
+		}
+		/* fall through */
+	case OCPP_WS_STATE_HANDSHAKE:
+		if ((err = flush_tx(ws)) == 0 && (err = fill_rx(ws)) == 0) {
+			if ((err = check_upgrade(ws)) == -EAGAIN) {
+				err = 0;
+			}
+		}
+		break;
+	case OCPP_WS_STATE_OPEN: /* fall through */
+	case OCPP_WS_STATE_CLOSING:
+		process_ping(ws);
+		if ((err = flush_tx(ws)) == 0) {
+			err = fill_rx(ws);
+		}
+		break;
+	default:
+		err = -EINVAL;
+		break;
+	}
+
+	if (err) {
+		shut(ws);
+	}
+
+	return err;
+}
+
+int ocpp_ws_process(struct ocpp_ws *ws, short revents)
+{
+	ocpp_ws_lock(ws);
+	const int err = process(ws, revents);
+	ocpp_ws_unlock(ws);
+
+	return err;
+}
+
+static int send_text(struct ocpp_ws *ws, const struct ocpp_message *msg)
+{
+	if (ws->state != OCPP_WS_STATE_OPEN) {
+		return -ENOTCONN;
+	}
+
+	const size_t room = OCPP_WS_TX_BUFSIZE - ws->tx_len;
+
+	if (room <= WS_MAX_HEADER_LEN) {
+		return -ENOBUFS;
+	}
+
+	char *text = (char *)&ws->tx[ws->tx_len + WS_MAX_HEADER_LEN];
+	const int len = (*ws->codec.encode)(msg, text,
+			room - WS_MAX_HEADER_LEN, ws->codec.ctx);
+
+	if (len < 0) {
+		return len;
+	} else if ((size_t)len > room - WS_MAX_HEADER_LEN) {
+		return -ENOBUFS;
+	}
+
+	commit_frame(ws, WS_OP_TEXT, (size_t)len);
+
+	int err = flush_tx(ws);
+	if (err) {
+		shut(ws);
+	}
+
+	return err;
+}
+
+int ocpp_ws_send(struct ocpp_ws *ws, const struct ocpp_message *msg)
+{
+	ocpp_ws_lock(ws);
+	const int err = send_text(ws, msg);
+	ocpp_ws_unlock(ws);
+
+	return err;
+}
+
+static int recv_text(struct ocpp_ws *ws, struct ocpp_message *msg)
+{
+	struct frame f;
+	int err;
+
+	if (ws->state != OCPP_WS_STATE_OPEN &&
+			ws->state != OCPP_WS_STATE_CLOSING) {
+		return -ENOTCONN;
+	}
+
+	while ((err = parse_frame(ws, &f)) != -EMSGSIZE) {
+		if (err == -ENOMSG) {
+			if ((err = fill_rx(ws)) != 0) {
+				shut(ws);
+				return err;
+			}
+			if ((err = parse_frame(ws, &f)) != 0) {
+				break;
+			}
+		}
+
+		uint8_t *payload = &ws->rx[f.offset];
+
+		switch (f.opcode) {
+		case WS_OP_TEXT:
+			if (ws->frag_opcode) { /* in the middle of another */
+				return fail(ws, WS_CLOSE_PROTOCOL, -EPROTO);
+			} else if (f.fin) {
+				err = decode_text(ws, f.offset, f.len, msg);
+				consume_rx(ws, f.offset + f.len);
+				return err;
+			}
+			ws->frag_opcode = WS_OP_TEXT;
+			join_fragment(ws, &f);
+			continue;
+		case WS_OP_CONTINUATION:
+			if (ws->frag_opcode == 0) { /* with no fragment started */
+				return fail(ws, WS_CLOSE_PROTOCOL, -EPROTO);
+			} else if (ws->frag_opcode == WS_OP_TEXT) {
+				join_fragment(ws, &f);
+				if (!f.fin) {
+					continue;
+				}
+				const size_t len = ws->frag_len;
+				err = decode_text(ws, 0, len, msg);
+				ws->frag_opcode = 0;
+				ws->frag_len = 0;
+				consume_rx(ws, len);
+				return err;
+			}
+			ws->frag_opcode = f.fin? 0 : ws->frag_opcode;
+			break;
+		case WS_OP_BINARY: /* ignored */
+			if (ws->frag_opcode) {
+				return fail(ws, WS_CLOSE_PROTOCOL, -EPROTO);
+			}
+			ws->frag_opcode = f.fin? 0 : WS_OP_BINARY;
+			break;
+		case WS_OP_PING:
+			queue_frame(ws, WS_OP_PONG, payload, f.len);
+			flush_tx(ws);
+			break;
+		case WS_OP_CLOSE:
+			if (ws->state == OCPP_WS_STATE_OPEN) {
+				queue_frame(ws, WS_OP_CLOSE, payload,
+						f.len < 2? f.len : 2);
+				flush_tx(ws);
+			}
+			shut(ws);
+			return -ECONNRESET;
+		default: /* pong ignored */
+			break;
+		}
+
+		consume_rx(ws, f.offset + f.len - ws->frag_len);
+	}
+
+	if (err == -EMSGSIZE) {
+		return fail(ws, WS_CLOSE_TOO_BIG, err);
+	}
+
+	return err;
+}
+
+int ocpp_ws_recv(struct ocpp_ws *ws, struct ocpp_message *msg)
+{
+	ocpp_ws_lock(ws);
+	const int err = recv_text(ws, msg);
+	ocpp_ws_unlock(ws);
+
+	return err;
+}
+
+int ocpp_ws_poll(struct ocpp_ws *ws, int timeout_ms)
+{
+	struct pollfd pfd = {
+		.fd = ws->fd,
+		.events = ocpp_ws_get_events(ws),
+	};
+	time_t deadline;
+
+	if (ws->state == OCPP_WS_STATE_CLOSED) {
+		return -ENOTCONN;
+	}
+
+	if (ocpp_get_next_deadline(&deadline) == 0) {
+		const time_t now = time(NULL);
+		const int ms = deadline <= now? 0 :
+			(deadline - now > INT32_MAX / 1000?
+			 INT32_MAX : (int)(deadline - now) * 1000);
+		if (timeout_ms < 0 || ms < timeout_ms) {
+			timeout_ms = ms;
+		}
+	}
+
+	if (ws->state == OCPP_WS_STATE_OPEN && ws->param.ping_interval_sec) {
+		const uint64_t due = ws->last_ping_ms +
+			ws->param.ping_interval_sec * 1000u;
+		const uint64_t now = get_ms();
+		const int ms = due <= now? 0 : (int)(due - now);
+		if (timeout_ms < 0 || ms < timeout_ms) {
+			timeout_ms = ms;
+		}
+	}
+
+	if (ocpp_ws_has_frame(ws)) {
+		timeout_ms = 0; /* frames already buffered */
+	}
+
+	const int rc = poll(&pfd, 1, timeout_ms);
+
+	if (rc < 0) {
+		return errno == EINTR? 0 : -errno;
+	}
+
+	return ocpp_ws_process(ws, rc > 0? pfd.revents : 0);
+}
+
+static int start_connecting(struct ocpp_ws *ws)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res;
+	char port[6];
+	int err;
+
+	if (ws->state != OCPP_WS_STATE_CLOSED) {
+		return -EISCONN;
+	}
+
+	snprintf(port, sizeof(port), "%u", ws->param.port);
+
+	if (getaddrinfo(ws->host, port, &hints, &res) != 0) {
+		return -EHOSTUNREACH;
+	}
+
+	ws->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+	if (ws->fd < 0) {
+		err = -errno;
+		freeaddrinfo(res);
+		return err;
+	}
+
+	fcntl(ws->fd, F_SETFL, fcntl(ws->fd, F_GETFL, 0) | O_NONBLOCK);
+
+	ws->rx_len = 0;
+	ws->tx_len = 0;
+	ws->eof = false;
+	ws->state = OCPP_WS_STATE_CONNECTING;
+
+	err = connect(ws->fd, res->ai_addr, res->ai_addrlen);
+	freeaddrinfo(res);
+
+	if (err != 0 && errno != EINPROGRESS) {
+		err = -errno;
+		shut(ws);
+		return err;
+	}
+
+	return 0;
+}
+
+int ocpp_ws_connect(struct ocpp_ws *ws)
+{
+	ocpp_ws_lock(ws);
+	const int err = start_connecting(ws);
+	ocpp_ws_unlock(ws);
+
+	return err;
+}
+
+void ocpp_ws_close(struct ocpp_ws *ws)
+{
+	ocpp_ws_lock(ws);
+
+	if (ws->state == OCPP_WS_STATE_OPEN) {
+		ws->tx_len = 0; /* drop whatever not sent yet */
+		queue_close(ws, WS_CLOSE_NORMAL);
+		flush_tx(ws);
+	}
+
+	shut(ws);
+
+	ocpp_ws_unlock(ws);
+}
+
+int ocpp_ws_get_fd(const struct ocpp_ws *ws)
+{
+	return ws->fd;
+}
+
+short ocpp_ws_get_events(const struct ocpp_ws *ws)
+{
+	switch (ws->state) {
+	case OCPP_WS_STATE_CLOSED:
+		return 0;
+	case OCPP_WS_STATE_CONNECTING:
+		return POLLOUT;
+	default:
+		return (short)(POLLIN | (ws->tx_len? POLLOUT : 0));
+	}
+}
+
+ocpp_ws_state_t ocpp_ws_get_state(const struct ocpp_ws *ws)
+{
+	return ws->state;
+}
+
+bool ocpp_ws_is_connected(const struct ocpp_ws *ws)
+{
+	return ws->state == OCPP_WS_STATE_OPEN;
+}
+
+bool ocpp_ws_has_frame(const struct ocpp_ws *ws)
+{
+	const uint8_t *p = &ws->rx[ws->frag_len];
+	const size_t avail = ws->rx_len - ws->frag_len;
+	size_t hdrlen = 2;
+	uint64_t len;
+
+	if (ws->state != OCPP_WS_STATE_OPEN || avail < 2) {
+		return false;
+	}
+
+	len = p[1] & 0x7f;
+	hdrlen += len == 126? 2 : len == 127? 8 : 0;
+	hdrlen += (p[1] & WS_MASK)? 4 : 0;
+
+	if (avail < hdrlen) {
+		return false;
+	}
+
+	if (len == 126) {
+		len = (uint64_t)p[2] << 8 | p[3];
+	} else if (len == 127) {
+		len = 0;
+		for (int i = 0; i < 8; i++) {
+			len = len << 8 | p[2 + i];
+		}
+	}
+
+	return avail >= hdrlen + len;
+}
+
+int ocpp_ws_init(struct ocpp_ws *ws, const struct ocpp_ws_param *param,
+		const struct ocpp_ws_codec *codec, const struct ocpp_ws_tls *tls)
+{
+	if (ws == NULL || param == NULL || param->host == NULL ||
+			codec == NULL || codec->encode == NULL ||
+			codec->decode == NULL) {
+		return -EINVAL;
+	}
+	if (tls && (tls->handshake == NULL || tls->read == NULL ||
+			tls->write == NULL)) {
+		return -EINVAL;
+	}
+
+	memset(ws, 0, sizeof(*ws));
+
+	ws->fd = -1;
+	ws->param = *param;
+	ws->codec = *codec;
+
+	strncpy(ws->host, param->host, sizeof(ws->host) - 1);
+	strncpy(ws->path, param->path? param->path : "/",
+			sizeof(ws->path) - 1);
+	ws->param.host = ws->host;
+	ws->param.path = ws->path;
+
+	if (ws->param.protocol == NULL) {
+		ws->param.protocol = OCPP_WS_PROTOCOL;
+	}
+
+	if (tls) {
+		ws->tls = *tls;
+		ws->has_tls = true;
+	}
+
+	return 0;
+}
+
+void ocpp_ws_bind(struct ocpp_ws *ws)
+{
+	bound = ws;
+}
+
+struct ocpp_ws *ocpp_ws_get_bound(void)
+{
+	return bound;
+}
@@ -0,0 +1,45 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* `ocpp_send()` and `ocpp_recv()` going through the WebSocket transport set
+ * by `ocpp_ws_bind()`. Leave this file out to implement them yourself. */
+
+#include "ocpp/transport/ws.h"
+#include <errno.h>
+
+int ocpp_send(const struct ocpp_message *msg)
+{
+	struct ocpp_ws *ws = ocpp_ws_get_bound();
+
+	if (ws == NULL) {
+		return -ENOTCONN;
+	}
+
+	return ocpp_ws_send(ws, msg);
+}
+
+int ocpp_recv(struct ocpp_message *msg)
+{
+	struct ocpp_ws *ws = ocpp_ws_get_bound();
+
+	if (ws == NULL) {
+		return -ENOTCONN;
+	}
+
+	return ocpp_ws_recv(ws, msg);
+}
+
+int ocpp_recv_ready(void)
+{
+	const struct ocpp_ws *ws = ocpp_ws_get_bound();
+
+	if (ws == NULL) {
+		return 0;
+	}
+
+	/* a partial frame or data not read yet is up to ocpp_recv() */
+	return ocpp_ws_has_frame(ws)? 1 : -ENOTSUP;
+}
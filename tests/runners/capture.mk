@@ -0,0 +1,19 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = Capture
+
+SRC_FILES = \
+	../src/capture.c \
+
+TEST_SRC_FILES = \
+	src/capture_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+CPPUTEST_CPPFLAGS = -DOCPP_CAPTURE=1
+
+include runners/MakefileRunner
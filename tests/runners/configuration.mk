@@ -15,5 +15,6 @@ INCLUDE_DIRS = \
 
 MOCKS_SRC_DIRS =
 CPPUTEST_CPPFLAGS =
+LD_LIBRARIES = -lpthread
 
 include runners/MakefileRunner
@@ -5,6 +5,7 @@ COMPONENT_NAME = Core
 SRC_FILES = \
 	../src/ocpp.c \
 	../src/core/configuration.c \
+	../src/stringify.c \
 	../examples/messages.c \
 
 TEST_SRC_FILES = \
@@ -16,7 +17,7 @@ INCLUDE_DIRS = \
 	../include \
 
 MOCKS_SRC_DIRS =
-CPPUTEST_CPPFLAGS = -DOCPP_DEFAULT_TX_TIMEOUT_SEC=5 -DOCPP_DEFAULT_TX_RETRIES=2 \
+CPPUTEST_CPPFLAGS = -DOCPP_DEFAULT_TX_TIMEOUT_SEC=5 -DOCPP_DEFAULT_TX_RETRIES=2 -DOCPP_RX_BUDGET=4 \
 		    -DOCPP_DEBUG=printf -DOCPP_ERROR=printf -DOCPP_INFO=printf \
 		    -include stdio.h
 
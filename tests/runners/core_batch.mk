@@ -0,0 +1,25 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = CoreBatch
+
+SRC_FILES = \
+	../src/ocpp.c \
+	../src/core/configuration.c \
+	../src/stringify.c \
+	../examples/messages.c \
+
+TEST_SRC_FILES = \
+	src/core_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+CPPUTEST_CPPFLAGS = -DOCPP_DEFAULT_TX_TIMEOUT_SEC=5 -DOCPP_DEFAULT_TX_RETRIES=2 -DOCPP_RX_BUDGET=4 \
+		    -DOCPP_EVENT_BATCH_LEN=4 \
+		    -DOCPP_DEBUG=printf -DOCPP_ERROR=printf -DOCPP_INFO=printf \
+		    -include stdio.h
+
+include runners/MakefileRunner
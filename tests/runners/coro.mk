@@ -0,0 +1,23 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = Coroutine
+
+SRC_FILES = \
+	../src/ocpp.c \
+	../src/core/configuration.c \
+	../src/stringify.c \
+
+TEST_SRC_FILES = \
+	src/coro_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+CPPUTEST_CPPFLAGS = -DOCPP_DEFAULT_TX_TIMEOUT_SEC=5 -DOCPP_DEFAULT_TX_RETRIES=2
+# the switch generated for coroutines has no default case
+CPPUTEST_CXXFLAGS = -std=c++20 -Wno-switch-default
+
+include runners/MakefileRunner
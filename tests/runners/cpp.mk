@@ -0,0 +1,22 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = Cpp
+
+SRC_FILES = \
+	../src/ocpp.c \
+	../src/core/configuration.c \
+	../src/stringify.c \
+
+TEST_SRC_FILES = \
+	src/cpp_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+CPPUTEST_CPPFLAGS =
+CPPUTEST_CXXFLAGS = -std=c++17
+
+include runners/MakefileRunner
@@ -0,0 +1,20 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = Pool
+
+SRC_FILES = \
+	../src/runtime/pool.c \
+
+TEST_SRC_FILES = \
+	src/pool_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+LD_LIBRARIES = -lpthread
+CPPUTEST_CPPFLAGS =
+
+include runners/MakefileRunner
@@ -0,0 +1,22 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = Simulation
+
+SRC_FILES = \
+	../src/ocpp.c \
+	../src/core/configuration.c \
+	../src/stringify.c \
+	src/simulator.c \
+
+TEST_SRC_FILES = \
+	src/simulation_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+CPPUTEST_CPPFLAGS =
+
+include runners/MakefileRunner
@@ -0,0 +1,19 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = Trace
+
+SRC_FILES = \
+	../src/trace.c \
+
+TEST_SRC_FILES = \
+	src/trace_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+CPPUTEST_CPPFLAGS = -DOCPP_TRACE_LEN=4
+
+include runners/MakefileRunner
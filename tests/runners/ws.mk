@@ -0,0 +1,19 @@
+# SPDX-License-Identifier: MIT
+
+COMPONENT_NAME = WebSocket
+
+SRC_FILES = \
+	../src/transport/ws.c \
+
+TEST_SRC_FILES = \
+	src/ws_test.cpp \
+	src/test_all.cpp \
+
+INCLUDE_DIRS = \
+	$(CPPUTEST_HOME)/include \
+	../include \
+
+MOCKS_SRC_DIRS =
+CPPUTEST_CPPFLAGS =
+
+include runners/MakefileRunner
@@ -0,0 +1,127 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/capture.h"
+
+#include <string.h>
+
+static uint8_t buf[512];
+static size_t len;
+
+static int write_buf(const void *data, size_t datasize, void *ctx) {
+	memcpy(&buf[len], data, datasize);
+	len += datasize;
+	return mock().actualCall(__func__).returnIntValueOrDefault(0);
+}
+
+uint32_t ocpp_capture_get_timestamp(void) {
+	return (uint32_t)mock().actualCall(__func__).returnUnsignedIntValueOrDefault(0);
+}
+
+TEST_GROUP(Capture) {
+	void setup(void) {
+		len = 0;
+		mock().ignoreOtherCalls();
+	}
+	void teardown(void) {
+		ocpp_capture_stop();
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	struct ocpp_capture_record get_record(size_t offset) {
+		struct ocpp_capture_record rec;
+		memcpy(&rec, &buf[offset], sizeof(rec));
+		return rec;
+	}
+	void start(void) {
+		LONGS_EQUAL(0, ocpp_capture_start(write_buf, NULL));
+		len = 0;
+	}
+};
+
+TEST(Capture, start_ShouldWriteHeader) {
+	struct ocpp_capture_header hdr;
+
+	LONGS_EQUAL(0, ocpp_capture_start(write_buf, NULL));
+
+	LONGS_EQUAL(sizeof(hdr), len);
+	memcpy(&hdr, buf, sizeof(hdr));
+	LONGS_EQUAL(OCPP_CAPTURE_MAGIC, hdr.magic);
+	LONGS_EQUAL(OCPP_CAPTURE_VERSION, hdr.version);
+	LONGS_EQUAL(sizeof(struct ocpp_capture_record), hdr.record_size);
+	LONGS_EQUAL(OCPP_MESSAGE_ID_MAXLEN, hdr.id_maxlen);
+}
+
+TEST(Capture, start_ShouldReturnEINVAL_WhenNullWriterGiven) {
+	LONGS_EQUAL(-EINVAL, ocpp_capture_start(NULL, NULL));
+}
+
+TEST(Capture, write_ShouldAppendRecordFollowedByIdAndPayload) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	struct ocpp_message msg = {
+		.id = "1234",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	msg.payload.fmt.request = &data;
+	msg.payload.size = 16;
+	start();
+
+	mock().expectOneCall("ocpp_capture_get_timestamp").andReturnValue(100);
+	ocpp_capture_write(OCPP_CAPTURE_SEND, &msg, -5, 7, OCPP_CAPTURE_FLAG_ERR);
+
+	struct ocpp_capture_record rec = get_record(0);
+	LONGS_EQUAL(sizeof(rec) + 4 + 16, len);
+	LONGS_EQUAL(100, rec.timestamp);
+	LONGS_EQUAL(-5, rec.rc);
+	LONGS_EQUAL(7, rec.arg);
+	LONGS_EQUAL(OCPP_CAPTURE_SEND, rec.kind);
+	LONGS_EQUAL(OCPP_MSG_ROLE_CALL, rec.role);
+	LONGS_EQUAL(OCPP_MSG_DATA_TRANSFER, rec.type);
+	LONGS_EQUAL(OCPP_CAPTURE_FLAG_ERR, rec.flags);
+	LONGS_EQUAL(4, rec.idlen);
+	LONGS_EQUAL(16, rec.size);
+	MEMCMP_EQUAL("1234", &buf[sizeof(rec)], 4);
+	MEMCMP_EQUAL(&data, &buf[sizeof(rec) + 4], 16);
+}
+
+TEST(Capture, time_ShouldBeWrittenOnlyWhenChanged) {
+	int64_t t;
+	start();
+
+	ocpp_capture_time(10);
+	ocpp_capture_time(10);
+	ocpp_capture_time(11);
+
+	LONGS_EQUAL((sizeof(struct ocpp_capture_record) + sizeof(t)) * 2, len);
+	LONGS_EQUAL(OCPP_CAPTURE_TIME, get_record(0).kind);
+	memcpy(&t, &buf[sizeof(struct ocpp_capture_record)], sizeof(t));
+	LONGS_EQUAL(10, t);
+	memcpy(&t, &buf[len - sizeof(t)], sizeof(t));
+	LONGS_EQUAL(11, t);
+}
+
+TEST(Capture, config_ShouldCarryKeyInPlaceOfId) {
+	uint32_t value = 60;
+	start();
+
+	ocpp_capture_config("HeartbeatInterval", &value, sizeof(value));
+
+	struct ocpp_capture_record rec = get_record(0);
+	LONGS_EQUAL(OCPP_CAPTURE_CONFIG, rec.kind);
+	LONGS_EQUAL(strlen("HeartbeatInterval"), rec.idlen);
+	LONGS_EQUAL(sizeof(value), rec.size);
+	MEMCMP_EQUAL("HeartbeatInterval", &buf[sizeof(rec)], rec.idlen);
+	MEMCMP_EQUAL(&value, &buf[sizeof(rec) + rec.idlen], sizeof(value));
+}
+
+TEST(Capture, ShouldWriteNothing_WhenStopped) {
+	start();
+	ocpp_capture_stop();
+
+	ocpp_capture_write(OCPP_CAPTURE_STEP, NULL, 0, 0, 0);
+	ocpp_capture_time(1);
+
+	LONGS_EQUAL(0, len);
+}
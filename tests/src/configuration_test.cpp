@@ -4,11 +4,18 @@
 #include "ocpp/core/configuration.h"
 #include "ocpp/overrides.h"
 #include <errno.h>
+#include <pthread.h>
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int locks;
 
 int ocpp_configuration_lock(void) {
+	pthread_mutex_lock(&lock);
+	locks++;
 	return 0;
 }
 int ocpp_configuration_unlock(void) {
+	pthread_mutex_unlock(&lock);
 	return 0;
 }
 
@@ -124,3 +131,319 @@ TEST(Configuration, get_keystr_ShouldReturnKeyString_WhenKnownKeyGiven) {
 TEST(Configuration, get_keystr_ShouldReturnUnknownKeyString_WhenUnknownKeyGiven) {
 	STRCMP_EQUAL(NULL, ocpp_get_configuration_keystr_from_index(-1));
 }
+
+static uint8_t saved[2048];
+static size_t saved_len;
+
+static int write_log(const void *data, size_t datasize, void *ctx) {
+	if (saved_len + datasize > sizeof(saved)) {
+		return -ENOSPC;
+	}
+	memcpy(&saved[saved_len], data, datasize);
+	saved_len += datasize;
+	return 0;
+}
+
+TEST(Configuration, save_ShouldWriteNothing_WhenNothingChanged) {
+	saved_len = 0;
+	LONGS_EQUAL(0, ocpp_save_configuration(write_log, NULL));
+	int interval = 1800;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	LONGS_EQUAL(0, ocpp_save_configuration(write_log, NULL));
+	LONGS_EQUAL(0, saved_len);
+}
+
+TEST(Configuration, save_ShouldWriteOnlyChangedKeys) {
+	saved_len = 0;
+	int interval = 60;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	LONGS_EQUAL(6 + strlen("HeartbeatInterval") + sizeof(int),
+			ocpp_save_configuration(write_log, NULL));
+	LONGS_EQUAL(0, ocpp_save_configuration(write_log, NULL));
+}
+
+TEST(Configuration, load_ShouldReplayLogOverDefaults) {
+	saved_len = 0;
+	int interval = 60;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	ocpp_save_configuration(write_log, NULL);
+	interval = 120;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	ocpp_set_configuration("CpoName", "cpo", 4);
+	ocpp_save_configuration(write_log, NULL);
+
+	ocpp_reset_configuration();
+	LONGS_EQUAL(saved_len, ocpp_load_configuration(saved, saved_len));
+
+	char name[64];
+	ocpp_get_configuration("HeartbeatInterval", &interval, sizeof(interval), NULL);
+	ocpp_get_configuration("CpoName", name, sizeof(name), NULL);
+	LONGS_EQUAL(120, interval);
+	STRCMP_EQUAL("cpo", name);
+	ocpp_get_configuration("ConnectionTimeOut", &interval, sizeof(interval), NULL);
+	LONGS_EQUAL(180, interval);
+}
+
+TEST(Configuration, load_ShouldStopAtInvalidRecord) {
+	saved_len = 0;
+	int interval = 60;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	ocpp_save_configuration(write_log, NULL);
+	const size_t valid = saved_len;
+	interval = 120;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	ocpp_save_configuration(write_log, NULL);
+	saved[saved_len - 1] ^= 1; /* torn */
+	memset(&saved[saved_len], 0xff, 16); /* erased */
+
+	LONGS_EQUAL(valid, ocpp_load_configuration(saved, saved_len + 16));
+	ocpp_get_configuration("HeartbeatInterval", &interval, sizeof(interval), NULL);
+	LONGS_EQUAL(60, interval);
+}
+
+TEST(Configuration, compact_ShouldWriteAllKeys) {
+	saved_len = 0;
+	int interval = 60;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	/* the same records as serialized without the header */
+	LONGS_EQUAL(ocpp_compute_configuration_blob_size() - 12,
+			ocpp_compact_configuration(write_log, NULL));
+	LONGS_EQUAL(0, ocpp_save_configuration(write_log, NULL));
+
+	ocpp_reset_configuration();
+	ocpp_load_configuration(saved, saved_len);
+	ocpp_get_configuration("HeartbeatInterval", &interval, sizeof(interval), NULL);
+	LONGS_EQUAL(60, interval);
+}
+
+TEST(Configuration, save_ShouldKeepKeysDirty_WhenWriteFailed) {
+	saved_len = sizeof(saved);
+	int interval = 60;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	LONGS_EQUAL(-ENOSPC, ocpp_save_configuration(write_log, NULL));
+	saved_len = 0;
+	LONGS_EQUAL(6 + strlen("HeartbeatInterval") + sizeof(int),
+			ocpp_save_configuration(write_log, NULL));
+}
+
+TEST(Configuration, serialize_ShouldReturnEINVAL_WhenBufferTooSmall) {
+	LONGS_EQUAL(-EINVAL, ocpp_serialize_configuration(saved,
+			ocpp_compute_configuration_blob_size() - 1));
+}
+
+TEST(Configuration, deserialize_ShouldRestoreValues) {
+	uint8_t blob[2048];
+	int interval = 60;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	ocpp_set_configuration("CpoName", "cpo", 4);
+	LONGS_EQUAL(ocpp_compute_configuration_blob_size(),
+			ocpp_serialize_configuration(blob, sizeof(blob)));
+
+	ocpp_reset_configuration();
+	LONGS_EQUAL(0, ocpp_deserialize_configuration(blob, sizeof(blob)));
+
+	char name[64];
+	ocpp_get_configuration("HeartbeatInterval", &interval, sizeof(interval), NULL);
+	ocpp_get_configuration("CpoName", name, sizeof(name), NULL);
+	LONGS_EQUAL(60, interval);
+	STRCMP_EQUAL("cpo", name);
+}
+
+TEST(Configuration, deserialize_ShouldReturnEINVAL_WhenNotSerializedData) {
+	uint8_t blob[64] = { 0, };
+	LONGS_EQUAL(-EINVAL, ocpp_deserialize_configuration(blob, sizeof(blob)));
+	LONGS_EQUAL(-EINVAL, ocpp_deserialize_configuration(NULL, 0));
+}
+
+/* rewrites the index hint of a record as another firmware would have */
+static void set_record_index(uint8_t *rec, uint16_t index) {
+	uint8_t sum = 0xa5;
+	rec[1] = (uint8_t)index;
+	rec[2] = (uint8_t)(index >> 8);
+	for (size_t i = 1; i < 6u + rec[4] + rec[5]; i++) {
+		sum = (uint8_t)((sum << 1 | sum >> 7) ^ rec[i]);
+	}
+	rec[0] = sum;
+}
+
+TEST(Configuration, deserialize_ShouldMigrateByKey_WhenSchemaChanged) {
+	uint8_t blob[2048];
+	int interval = 60;
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+	ocpp_set_configuration("ResetRetries", &interval, sizeof(interval));
+	ocpp_serialize_configuration(blob, sizeof(blob));
+	blob[8] ^= 1; /* schema */
+
+	/* as if a key inserted before */
+	size_t offset = 12;
+	for (int i = 0; i < (int)ocpp_count_configurations(); i++) {
+		uint8_t *rec = &blob[offset];
+		set_record_index(rec, (uint16_t)(i + 1));
+		if (i == 9) { /* HeartbeatInterval renamed to an unknown key */
+			rec[6] = 'X';
+			set_record_index(rec, (uint16_t)(i + 1));
+		}
+		offset += 6u + rec[4] + rec[5];
+	}
+
+	ocpp_reset_configuration();
+	LONGS_EQUAL(0, ocpp_deserialize_configuration(blob, offset));
+
+	ocpp_get_configuration("HeartbeatInterval", &interval, sizeof(interval), NULL);
+	LONGS_EQUAL(1800, interval);
+	ocpp_get_configuration("ResetRetries", &interval, sizeof(interval), NULL);
+	LONGS_EQUAL(60, interval);
+}
+
+TEST(Configuration, get_ShouldNotTakeLock) {
+	int interval;
+	locks = 0;
+	ocpp_get_configuration("HeartbeatInterval", &interval, sizeof(interval), NULL);
+	ocpp_get_configuration_by_index(0, &interval, sizeof(interval), NULL);
+	LONGS_EQUAL(0, locks);
+}
+
+static void *change_cponame(void *arg) {
+	char name[2][64];
+	memset(name[0], 'a', sizeof(name[0]) - 1);
+	memset(name[1], 'b', sizeof(name[1]) - 1);
+	name[0][63] = name[1][63] = '\0';
+
+	for (int i = 0; i < 10000; i++) {
+		ocpp_set_configuration("CpoName", name[i & 1], sizeof(name[0]));
+	}
+	return NULL;
+}
+
+TEST(Configuration, get_ShouldNeverReadTornValue_WhenWrittenConcurrently) {
+	pthread_t writer;
+	int torn = 0;
+	pthread_create(&writer, NULL, change_cponame, NULL);
+
+	for (int i = 0; i < 10000; i++) {
+		char name[64];
+		ocpp_get_configuration("CpoName", name, sizeof(name), NULL);
+		if (name[0] != 'l' && memchr(name, name[0] ^ ('a' ^ 'b'), 63)) {
+			torn++;
+		}
+	}
+
+	pthread_join(writer, NULL);
+	LONGS_EQUAL(0, torn);
+}
+
+static const char *changed_keystr;
+
+static int on_change(const char *keystr, const void *old_value,
+		const void *new_value, size_t value_size, void *ctx) {
+	changed_keystr = keystr;
+	return mock().actualCall(__func__)
+		.withParameter("old", *(const int *)old_value)
+		.withParameter("new", *(const int *)new_value)
+		.returnIntValueOrDefault(0);
+}
+
+TEST(Configuration, set_ShouldNotifyObservers_WhenChanged) {
+	int interval = 60;
+	ocpp_subscribe_configuration("HeartbeatInterval", on_change, NULL);
+	mock().expectOneCall("on_change")
+		.withParameter("old", 1800).withParameter("new", 60);
+	LONGS_EQUAL(0, ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval)));
+	STRCMP_EQUAL("HeartbeatInterval", changed_keystr);
+	/* the same value */
+	LONGS_EQUAL(0, ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval)));
+	/* another key */
+	ocpp_set_configuration("ResetRetries", &interval, sizeof(interval));
+	LONGS_EQUAL(0, ocpp_unsubscribe_configuration("HeartbeatInterval", on_change, NULL));
+}
+
+TEST(Configuration, set_ShouldNotifyObserversOfAllKeys_WhenSubscribedWithNull) {
+	int interval = 60;
+	ocpp_subscribe_configuration(NULL, on_change, NULL);
+	mock().expectOneCall("on_change")
+		.withParameter("old", 0).withParameter("new", 60);
+	ocpp_set_configuration("ResetRetries", &interval, sizeof(interval));
+	STRCMP_EQUAL("ResetRetries", changed_keystr);
+	LONGS_EQUAL(0, ocpp_unsubscribe_configuration(NULL, on_change, NULL));
+}
+
+TEST(Configuration, set_ShouldReturnRebootRequired_WhenObserverCannotApply) {
+	int interval = 60;
+	ocpp_subscribe_configuration("HeartbeatInterval", on_change, NULL);
+	mock().expectOneCall("on_change").ignoreOtherParameters()
+		.andReturnValue(OCPP_CONFIGURATION_REBOOT_REQUIRED);
+	LONGS_EQUAL(OCPP_CONFIGURATION_REBOOT_REQUIRED,
+			ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval)));
+	ocpp_unsubscribe_configuration("HeartbeatInterval", on_change, NULL);
+}
+
+TEST(Configuration, subscribe_ShouldReturnError_WhenInvalidOrFull) {
+	LONGS_EQUAL(-EINVAL, ocpp_subscribe_configuration("UnknownKey", on_change, NULL));
+	LONGS_EQUAL(-EINVAL, ocpp_subscribe_configuration("HeartbeatInterval", NULL, NULL));
+	LONGS_EQUAL(-ENOENT, ocpp_unsubscribe_configuration("HeartbeatInterval", on_change, NULL));
+
+	int i;
+	for (i = 0; ocpp_subscribe_configuration("HeartbeatInterval", on_change,
+				(void *)(uintptr_t)(i + 1)) == 0; i++) {
+	}
+	CHECK(i > 0);
+	while (i-- > 0) {
+		LONGS_EQUAL(0, ocpp_unsubscribe_configuration("HeartbeatInterval",
+				on_change, (void *)(uintptr_t)(i + 1)));
+	}
+}
+
+TEST(Configuration, set_ShouldReturnERANGE_WhenOutOfRange) {
+	int value = 0;
+	LONGS_EQUAL(-ERANGE, ocpp_set_configuration("HeartbeatInterval", &value, sizeof(value)));
+	value = 1;
+	LONGS_EQUAL(-ERANGE, ocpp_set_configuration("MeterValueSampleInterval", &value, sizeof(value)));
+	value = 4;
+	LONGS_EQUAL(-ERANGE, ocpp_set_configuration("SecurityProfile", &value, sizeof(value)));
+
+	ocpp_get_configuration("HeartbeatInterval", &value, sizeof(value), NULL);
+	LONGS_EQUAL(1800, value);
+}
+
+TEST(Configuration, set_ShouldAcceptOneOf_EvenWhenOutOfRange) {
+	int value = 0;
+	LONGS_EQUAL(0, ocpp_set_configuration("MeterValueSampleInterval", &value, sizeof(value)));
+	value = 10;
+	LONGS_EQUAL(0, ocpp_set_configuration("MeterValueSampleInterval", &value, sizeof(value)));
+	value = 2;
+	LONGS_EQUAL(0, ocpp_set_configuration("SecurityProfile", &value, sizeof(value)));
+}
+
+static int on_bool_change(const char *keystr, const void *old_value,
+		const void *new_value, size_t value_size, void *ctx) {
+	changed_keystr = keystr;
+	return mock().actualCall(__func__)
+		.withParameter("old", *(const bool *)old_value)
+		.withParameter("new", *(const bool *)new_value)
+		.returnIntValueOrDefault(0);
+}
+
+TEST(Configuration, set_ShouldReturnRebootRequired_WhenDefinedSo) {
+	bool enabled = true;
+	ocpp_subscribe_configuration(NULL, on_bool_change, NULL);
+	mock().expectOneCall("on_bool_change").ignoreOtherParameters();
+	LONGS_EQUAL(OCPP_CONFIGURATION_REBOOT_REQUIRED,
+			ocpp_set_configuration("ISO15118PnCEnabled", &enabled, sizeof(enabled)));
+	ocpp_unsubscribe_configuration(NULL, on_bool_change, NULL);
+
+	enabled = false;
+	ocpp_get_configuration("ISO15118PnCEnabled", &enabled, sizeof(enabled), NULL);
+	LONGS_EQUAL(true, enabled);
+}
+
+TEST(Configuration, set_ShouldNotifyObservers_WhenRebootKeyChanged) {
+	bool enabled = true;
+	ocpp_subscribe_configuration("ISO15118PnCEnabled", on_bool_change, NULL);
+	mock().expectOneCall("on_bool_change")
+		.withParameter("old", false).withParameter("new", true);
+	LONGS_EQUAL(OCPP_CONFIGURATION_REBOOT_REQUIRED,
+			ocpp_set_configuration("ISO15118PnCEnabled", &enabled, sizeof(enabled)));
+	STRCMP_EQUAL("ISO15118PnCEnabled", changed_keystr);
+	LONGS_EQUAL(0, ocpp_unsubscribe_configuration("ISO15118PnCEnabled",
+			on_bool_change, NULL));
+}
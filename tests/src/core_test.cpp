@@ -12,6 +12,8 @@ static struct {
 	uint8_t message_id[OCPP_MESSAGE_ID_MAXLEN];
 	ocpp_message_role_t role;
 	ocpp_message_t type;
+	const void *data;
+	size_t datasize;
 } sent;
 
 static struct {
@@ -23,10 +25,22 @@ time_t time(time_t *second) {
 	return mock().actualCall(__func__).returnUnsignedIntValueOrDefault(0);
 }
 
+static bool recv_while_sending;
+static int recv_ready;
+static size_t pending_while_sending;
+
 int ocpp_send(const struct ocpp_message *msg) {
 	memcpy(sent.message_id, msg->id, sizeof(sent.message_id));
 	sent.role = msg->role;
 	sent.type = msg->type;
+	sent.data = msg->payload.fmt.request;
+	sent.datasize = msg->payload.size;
+	pending_while_sending = ocpp_count_pending_type(msg->type);
+
+	if (recv_while_sending) { /* as the receiver thread would do */
+		recv_while_sending = false;
+		ocpp_step_rx();
+	}
 
 	return mock().actualCall(__func__).returnIntValueOrDefault(0);
 }
@@ -35,13 +49,24 @@ int ocpp_recv(struct ocpp_message *msg)
 {
 	int rc = mock().actualCall(__func__).withOutputParameter("msg", msg).returnIntValueOrDefault(0);
 	memcpy(msg->id, sent.message_id, sizeof(msg->id));
+	if (recv_ready > 0) {
+		recv_ready--;
+	}
 	return rc;
 }
 
+int ocpp_recv_ready(void)
+{
+	return recv_ready;
+}
+
 int ocpp_lock(void) {
 	return 0;
 }
+static int unlocks;
+
 int ocpp_unlock(void) {
+	unlocks++;
 	return 0;
 }
 
@@ -52,9 +77,16 @@ int ocpp_configuration_unlock(void) {
 	return 0;
 }
 
+static const char *next_message_id;
+
 void ocpp_generate_message_id(void *buf, size_t bufsize)
 {
 	char *p = (char *)buf;
+	if (next_message_id) {
+		strncpy(p, next_message_id, bufsize);
+		next_message_id = NULL;
+		return;
+	}
 	char charset[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
 	while (bufsize-- > 0) {
 		int index = rand() % (int)(sizeof(charset) - 1);
@@ -70,9 +102,21 @@ static void on_ocpp_event(ocpp_event_t event_type,
 	mock().actualCall(__func__).withParameter("event_type", event_type);
 }
 
+static void *request_done_ctx;
+
+static void on_request_done(int result,
+		const struct ocpp_message *response, void *ctx) {
+	mock().actualCall(__func__)
+		.withParameter("result", result)
+		.withParameter("response", response != NULL);
+	request_done_ctx = ctx;
+}
+
 TEST_GROUP(Core) {
 	void setup(void) {
 		srand((unsigned int)clock());
+		recv_ready = -ENOTSUP;
+		memset(&sent, 0, sizeof(sent));
 		mock().expectOneCall("time").andReturnValue(0);
 		ocpp_init(on_ocpp_event, NULL);
 	}
@@ -538,3 +582,870 @@ TEST(Core, ShouldSendHeartBeat_WhenElapsedTimeExceedsIntervalFromRxMessage) {
 
         check_tx(OCPP_MSG_ROLE_CALL, OCPP_MSG_HEARTBEAT);
 }
+
+TEST(Core, stats_ShouldCountPushedAndSentMessages) {
+	struct ocpp_stats stats;
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(3);
+
+	LONGS_EQUAL(0, ocpp_get_stats(&stats));
+	LONGS_EQUAL(2, stats.msg[OCPP_MSG_DATA_TRANSFER].pushed);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_DATA_TRANSFER].sent);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_DATA_TRANSFER].queued[2]);
+	LONGS_EQUAL(1, stats.queue[OCPP_QUEUE_READY].len);
+	LONGS_EQUAL(2, stats.queue[OCPP_QUEUE_READY].high);
+	LONGS_EQUAL(1, stats.queue[OCPP_QUEUE_WAIT].len);
+	LONGS_EQUAL(0, stats.msg[OCPP_MSG_HEARTBEAT].pushed);
+}
+
+TEST(Core, stats_ShouldRecordRoundTripTime_WhenResponseReceived) {
+	struct ocpp_stats stats;
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLERROR,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	memcpy(resp.id, sent.message_id, sizeof(resp.id));
+	mock().expectOneCall("ocpp_recv").withOutputParameterReturning("msg", &resp, sizeof(resp));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(4);
+
+	ocpp_get_stats(&stats);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_DATA_TRANSFER].rtt[3]);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_DATA_TRANSFER].errored);
+	LONGS_EQUAL(0, stats.queue[OCPP_QUEUE_WAIT].len);
+	LONGS_EQUAL(1, stats.queue[OCPP_QUEUE_WAIT].high);
+}
+
+TEST(Core, stats_ShouldCountDroppedAndEvictedMessages) {
+	struct ocpp_stats stats;
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+
+	for (int i = 0; i < 8; i++) {
+		ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	}
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	ocpp_push_request(OCPP_MSG_HEARTBEAT, NULL, 0, true);
+
+	for (int i = 0; i < OCPP_DEFAULT_TX_RETRIES; i++) {
+		mock().expectOneCall("ocpp_send").andReturnValue(-1);
+		mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+		if (i == OCPP_DEFAULT_TX_RETRIES - 1) {
+			mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+		}
+		step(i * OCPP_DEFAULT_TX_TIMEOUT_SEC);
+	}
+
+	ocpp_get_stats(&stats);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_DATA_TRANSFER].evicted);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_DATA_TRANSFER].dropped);
+	LONGS_EQUAL(OCPP_DEFAULT_TX_RETRIES, stats.msg[OCPP_MSG_DATA_TRANSFER].errored);
+	LONGS_EQUAL(OCPP_DEFAULT_TX_RETRIES - 1, stats.msg[OCPP_MSG_DATA_TRANSFER].retried);
+
+	ocpp_reset_stats();
+	ocpp_get_stats(&stats);
+	LONGS_EQUAL(0, stats.msg[OCPP_MSG_DATA_TRANSFER].pushed);
+	LONGS_EQUAL(stats.queue[OCPP_QUEUE_READY].len, stats.queue[OCPP_QUEUE_READY].high);
+}
+
+TEST(Core, get_next_deadline_ShouldReturnENOENT_WhenNothingScheduled) {
+	time_t deadline;
+	LONGS_EQUAL(-ENOENT, ocpp_get_next_deadline(&deadline));
+}
+
+TEST(Core, get_next_deadline_ShouldReturnEarliestOfReadyTimeoutAndTimer) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	time_t deadline;
+
+	mock().expectOneCall("time").andReturnValue(100);
+	ocpp_push_request_defer(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), 30);
+	LONGS_EQUAL(0, ocpp_get_next_deadline(&deadline));
+	LONGS_EQUAL(130, deadline);
+
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	LONGS_EQUAL(0, ocpp_get_next_deadline(&deadline));
+	LONGS_EQUAL(0, deadline);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(110);
+	LONGS_EQUAL(0, ocpp_get_next_deadline(&deadline));
+	LONGS_EQUAL(110 + OCPP_DEFAULT_TX_TIMEOUT_SEC, deadline);
+}
+
+TEST(Core, get_next_deadline_ShouldReturnNextHeartbeat_WhenIdleAfterBoot) {
+	time_t deadline;
+	uint32_t interval = 60;
+
+	go_bootnoti_accepted();
+	ocpp_set_configuration("HeartbeatInterval", &interval, sizeof(interval));
+
+	LONGS_EQUAL(0, ocpp_get_next_deadline(&deadline));
+	LONGS_EQUAL(60, deadline);
+}
+
+TEST(Core, step_tx_ShouldSendWithoutReceiving) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+
+	mock().expectOneCall("time").andReturnValue(0);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	LONGS_EQUAL(0, ocpp_step_tx());
+	check_tx(OCPP_MSG_ROLE_CALL, OCPP_MSG_DATA_TRANSFER);
+	LONGS_EQUAL(1, ocpp_count_pending_requests());
+}
+
+TEST(Core, step_rx_ShouldReceiveResponseWithoutSending) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+
+	mock().expectOneCall("time").andReturnValue(0);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	ocpp_step_tx();
+
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLRESULT,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp))
+		.andReturnValue(0);
+	mock().expectOneCall("time").andReturnValue(1);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	LONGS_EQUAL(0, ocpp_step_rx());
+	LONGS_EQUAL(1, ocpp_count_pending_requests());
+}
+
+TEST(Core, step_rx_ShouldReturnENOMSG_WhenNothingReceived) {
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("time").andReturnValue(0);
+	LONGS_EQUAL(-ENOMSG, ocpp_step_rx());
+}
+
+TEST(Core, step_tx_ShouldFreeRequestOnce_WhenResponseReceivedWhileSending) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLRESULT,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	recv_while_sending = true;
+	mock().expectOneCall("time").andReturnValue(0);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp))
+		.andReturnValue(0);
+	mock().expectOneCall("time").andReturnValue(0);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	ocpp_step_tx();
+
+	LONGS_EQUAL(0, ocpp_count_pending_requests());
+	time_t deadline;
+	LONGS_EQUAL(-ENOENT, ocpp_get_next_deadline(&deadline));
+}
+
+TEST(Core, count_pending_type_ShouldCountMessagesInAllQueues) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	mock().expectOneCall("time").andReturnValue(0);
+	ocpp_push_request_defer(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), 10);
+	ocpp_push_request(OCPP_MSG_HEARTBEAT, NULL, 0, false);
+
+	LONGS_EQUAL(2, ocpp_count_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(1, ocpp_count_pending_type(OCPP_MSG_HEARTBEAT));
+	LONGS_EQUAL(0, ocpp_count_pending_type(OCPP_MSG_AUTHORIZE));
+	LONGS_EQUAL(0, ocpp_count_pending_type(OCPP_MSG_MAX));
+	LONGS_EQUAL(3, ocpp_count_pending_requests());
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+	LONGS_EQUAL(2, ocpp_count_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(3, ocpp_count_pending_requests());
+}
+
+TEST(Core, count_pending_type_ShouldCountCall_WhenBeingSent) {
+	ocpp_push_request(OCPP_MSG_HEARTBEAT, NULL, 0, false);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+
+	LONGS_EQUAL(1, pending_while_sending);
+	LONGS_EQUAL(1, ocpp_count_pending_type(OCPP_MSG_HEARTBEAT));
+}
+
+TEST(Core, count_pending_type_ShouldCountResponses_WhenQueued) {
+	struct ocpp_message req = {
+		.id = "req",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	struct ocpp_Reset_conf conf = { .status = OCPP_REMOTE_STATUS_ACCEPTED };
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+	LONGS_EQUAL(0, ocpp_push_response(&req, &conf, sizeof(conf), false));
+
+	LONGS_EQUAL(1, ocpp_count_pending_type(OCPP_MSG_RESET));
+}
+
+TEST(Core, count_pending_type_ShouldDecrease_WhenDequeued) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+
+	mock().expectNCalls(2, "on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(2, ocpp_drop_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(0, ocpp_count_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(0, ocpp_count_pending_requests());
+}
+
+TEST(Core, step_ShouldReceiveAllReadyMessages_WhenTransportTellsReady) {
+	struct ocpp_message req = {
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	recv_ready = 3;
+	mock().expectNCalls(3, "ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectNCalls(3, "on_ocpp_event")
+		.withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+	LONGS_EQUAL(0, recv_ready);
+}
+
+TEST(Core, step_ShouldNotReceive_WhenTransportTellsNothingReady) {
+	recv_ready = 0;
+	step(0);
+}
+
+TEST(Core, step_ShouldReceiveUpToBudget_WhenMoreMessagesReady) {
+	struct ocpp_message req = {
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	recv_ready = OCPP_RX_BUDGET + 2;
+	mock().expectNCalls(OCPP_RX_BUDGET, "ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectNCalls(OCPP_RX_BUDGET, "on_ocpp_event")
+		.withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+	LONGS_EQUAL(2, recv_ready);
+}
+
+TEST(Core, step_ShouldStopReceiving_WhenRecvFails) {
+	recv_ready = 3;
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters()
+		.andReturnValue(-ENOMSG);
+	step(0);
+}
+
+TEST(Core, push_request_cb_ShouldCallBack_WhenResponseReceived) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	int ctx;
+	LONGS_EQUAL(0, ocpp_push_request_cb(OCPP_MSG_DATA_TRANSFER,
+			&data, sizeof(data), on_request_done, &ctx));
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLRESULT,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp));
+	mock().expectOneCall("on_request_done").withParameter("result", 0)
+		.withParameter("response", true);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(1);
+	POINTERS_EQUAL(&ctx, request_done_ctx);
+}
+
+TEST(Core, push_request_cb_ShouldCallBackWithTimeout_WhenNoResponseReceived) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request_cb(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data),
+			on_request_done, NULL);
+
+	int i = 0;
+	for (; i < OCPP_DEFAULT_TX_RETRIES; i++) {
+		mock().expectOneCall("ocpp_send").andReturnValue(0);
+		mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+		step(i*OCPP_DEFAULT_TX_TIMEOUT_SEC);
+	}
+
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_request_done").withParameter("result", -ETIMEDOUT)
+		.withParameter("response", false);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(i*OCPP_DEFAULT_TX_TIMEOUT_SEC);
+}
+
+static void on_request_done_push_again(int result,
+		const struct ocpp_message *response, void *ctx) {
+	on_request_done(result, response, ctx);
+	ocpp_drop_pending_type(OCPP_MSG_DATA_TRANSFER);
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, ctx,
+			sizeof(struct ocpp_DataTransfer), false);
+}
+
+TEST(Core, push_request_cb_ShouldKeepQueuesIntact_WhenPushingFromTimeoutCallback) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request_cb(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data),
+			on_request_done_push_again, &data);
+
+	int i = 0;
+	for (; i < OCPP_DEFAULT_TX_RETRIES; i++) {
+		mock().expectOneCall("ocpp_send").andReturnValue(0);
+		mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+		step(i*OCPP_DEFAULT_TX_TIMEOUT_SEC);
+	}
+
+	mock().expectOneCall("on_request_done").withParameter("result", -ETIMEDOUT)
+		.withParameter("response", false);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(i*OCPP_DEFAULT_TX_TIMEOUT_SEC);
+	check_tx(OCPP_MSG_ROLE_CALL, OCPP_MSG_DATA_TRANSFER);
+	LONGS_EQUAL(1, ocpp_count_pending_requests());
+}
+
+TEST(Core, push_request_cb_ShouldCallBackWithSendError_WhenGivenUpSending) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request_cb(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data),
+			on_request_done, NULL);
+
+	int i = 0;
+	for (; i < OCPP_DEFAULT_TX_RETRIES-1; i++) {
+		mock().expectOneCall("ocpp_send").andReturnValue(-EIO);
+		mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+		step(i*OCPP_DEFAULT_TX_TIMEOUT_SEC);
+	}
+
+	mock().expectOneCall("ocpp_send").andReturnValue(-EIO);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_request_done").withParameter("result", -EIO)
+		.withParameter("response", false);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(i*OCPP_DEFAULT_TX_TIMEOUT_SEC);
+}
+
+TEST(Core, push_request_cb_ShouldCallBackWithCanceled_WhenDropped) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request_cb(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data),
+			on_request_done, NULL);
+
+	mock().expectOneCall("on_request_done").withParameter("result", -ECANCELED)
+		.withParameter("response", false);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(1, ocpp_drop_pending_type(OCPP_MSG_DATA_TRANSFER));
+}
+
+static bool is_connector(const struct ocpp_message *msg, void *ctx)
+{
+	const struct ocpp_StatusNotification *p =
+		(const struct ocpp_StatusNotification *)msg->payload.fmt.request;
+	return msg->type == OCPP_MSG_STATUS_NOTIFICATION &&
+		p->connectorId == *(const int *)ctx;
+}
+
+TEST(Core, drop_pending_if_ShouldDropOnlyMatchingMessages) {
+	struct ocpp_StatusNotification s[3] = {
+		{ .connectorId = 1, }, { .connectorId = 2, }, { .connectorId = 1, },
+	};
+	ocpp_push_request(OCPP_MSG_STATUS_NOTIFICATION, &s[0], sizeof(s[0]), false);
+	ocpp_push_request(OCPP_MSG_STATUS_NOTIFICATION, &s[1], sizeof(s[1]), false);
+	mock().expectOneCall("time").andReturnValue(0);
+	ocpp_push_request_defer(OCPP_MSG_STATUS_NOTIFICATION, &s[2], sizeof(s[2]), 10);
+
+	int connector = 1;
+	mock().expectNCalls(2, "on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(2, ocpp_drop_pending_if(is_connector, &connector));
+	LONGS_EQUAL(1, ocpp_count_pending_type(OCPP_MSG_STATUS_NOTIFICATION));
+	LONGS_EQUAL(1, ocpp_count_pending_requests());
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(10);
+	POINTERS_EQUAL(&s[1], sent.data);
+}
+
+TEST(Core, drop_pending_if_ShouldKeepQueuesIntact_WhenDroppingInTheMiddle) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	struct ocpp_StatusNotification s = { .connectorId = 1, };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	ocpp_push_request(OCPP_MSG_STATUS_NOTIFICATION, &s, sizeof(s), false);
+	ocpp_push_request(OCPP_MSG_HEARTBEAT, NULL, 0, false);
+
+	int connector = 1;
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(1, ocpp_drop_pending_if(is_connector, &connector));
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+	check_tx(OCPP_MSG_ROLE_CALL, OCPP_MSG_DATA_TRANSFER);
+	LONGS_EQUAL(2, ocpp_count_pending_requests());
+
+	mock().expectNCalls(2, "on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(1, ocpp_drop_pending_type(OCPP_MSG_HEARTBEAT));
+	LONGS_EQUAL(1, ocpp_drop_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(0, ocpp_count_pending_requests());
+}
+
+#if defined(OCPP_EVENT_BATCH_LEN) && OCPP_EVENT_BATCH_LEN > 0
+TEST(Core, events_ShouldBeDeliveredAtOnce_WhenBatched) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	for (int i = 0; i < 3; i++) {
+		ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	}
+
+	unlocks = 0;
+	mock().expectNCalls(3, "on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(3, ocpp_drop_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(1, unlocks);
+}
+
+TEST(Core, events_ShouldBeDeliveredInBatches_WhenMoreThanBatchLength) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	for (int i = 0; i < OCPP_EVENT_BATCH_LEN + 2; i++) {
+		ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	}
+
+	unlocks = 0;
+	mock().expectNCalls(OCPP_EVENT_BATCH_LEN + 2, "on_ocpp_event")
+		.withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(OCPP_EVENT_BATCH_LEN + 2,
+			ocpp_drop_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(2, unlocks);
+}
+#else
+TEST(Core, events_ShouldBeDeliveredOneByOne_WhenNotBatched) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	for (int i = 0; i < 3; i++) {
+		ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	}
+
+	unlocks = 0;
+	mock().expectNCalls(3, "on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	LONGS_EQUAL(3, ocpp_drop_pending_type(OCPP_MSG_DATA_TRANSFER));
+	LONGS_EQUAL(4, unlocks);
+}
+#endif
+
+TEST(Core, events_ShouldNotBeGenerated_WhenMaskedOut) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	ocpp_set_event_mask(OCPP_EVENT_MASK_INCOMING);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLRESULT,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(1);
+	LONGS_EQUAL(0, ocpp_count_pending_requests());
+}
+
+TEST(Core, events_ShouldNotGenerateErrors_WhenErrorMaskedOut) {
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLRESULT,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", -ENOLINK);
+	step(0);
+
+	ocpp_set_event_mask(OCPP_EVENT_MASK_ALL & ~OCPP_EVENT_MASK_ERROR);
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp));
+	step(1);
+}
+
+TEST(Core, ShouldSendResponseAgain_WhenSameRequestReceivedAgain) {
+	struct ocpp_message req = {
+		.id = "dup",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_REMOTE_START_TRANSACTION,
+	};
+	struct ocpp_RemoteStartTransaction_conf conf = {
+		.status = OCPP_REMOTE_STATUS_ACCEPTED,
+	};
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+
+	ocpp_push_response(&req, &conf, sizeof(conf), false);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(1);
+	check_tx(OCPP_MSG_ROLE_CALLRESULT, OCPP_MSG_REMOTE_START_TRANSACTION);
+
+	conf.status = OCPP_REMOTE_STATUS_REJECTED; /* freed by the application */
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	step(2);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(3);
+	check_tx(OCPP_MSG_ROLE_CALLRESULT, OCPP_MSG_REMOTE_START_TRANSACTION);
+	STRCMP_EQUAL("dup", (const char *)sent.message_id);
+	LONGS_EQUAL(sizeof(conf), sent.datasize);
+	LONGS_EQUAL(OCPP_REMOTE_STATUS_ACCEPTED,
+			((const struct ocpp_RemoteStartTransaction_conf *)
+			 sent.data)->status);
+}
+
+TEST(Core, ShouldIgnoreRequest_WhenReceivedAgainBeforeResponseSent) {
+	struct ocpp_message req = {
+		.id = "dup",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	struct ocpp_Reset_conf conf = { .status = OCPP_REMOTE_STATUS_ACCEPTED };
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+	ocpp_push_response(&req, &conf, sizeof(conf), false);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(-EIO);
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	step(1);
+
+	LONGS_EQUAL(1, ocpp_count_pending_requests());
+}
+
+TEST(Core, ShouldNotTakeRequestAsDuplicate_WhenIdMatchesOwnRequest) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+
+	struct ocpp_message req = {
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(1);
+}
+
+TEST(Core, init_ShouldKeepSharedConfiguration_WhenAnotherContextInitialized) {
+	const uint32_t interval = 123;
+	uint32_t got = 0;
+	struct ocpp_context *ctx =
+		(struct ocpp_context *)malloc(ocpp_compute_context_size());
+	LONGS_EQUAL(0, ocpp_set_configuration("HeartbeatInterval",
+			&interval, sizeof(interval)));
+
+	struct ocpp_context *prev = ocpp_switch_context(ctx);
+	mock().expectOneCall("time").andReturnValue(0);
+	ocpp_init(on_ocpp_event, NULL);
+	ocpp_get_configuration("HeartbeatInterval", &got, sizeof(got), NULL);
+	ocpp_switch_context(prev);
+	free(ctx);
+
+	LONGS_EQUAL(123, got);
+}
+
+TEST(Core, ShouldNotAnswerOnDeadline_WhenDeadlineSetOnAnotherContext) {
+	struct ocpp_message req = {
+		.id = "other",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	struct ocpp_context *ctx =
+		(struct ocpp_context *)malloc(ocpp_compute_context_size());
+	time_t deadline;
+
+	struct ocpp_context *prev = ocpp_switch_context(ctx);
+	mock().expectOneCall("time").andReturnValue(0);
+	ocpp_init(on_ocpp_event, NULL);
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 5, NULL, 0);
+	ocpp_switch_context(prev);
+	free(ctx);
+
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+	LONGS_EQUAL(-ENOENT, ocpp_get_next_deadline(&deadline));
+}
+
+TEST(Core, ShouldAnswerWithCallError_WhenNotRespondedInTime) {
+	struct ocpp_message req = {
+		.id = "late",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	struct ocpp_Reset_conf conf = { .status = OCPP_REMOTE_STATUS_ACCEPTED };
+	struct ocpp_stats stats;
+	time_t deadline;
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 5, NULL, 0);
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+	LONGS_EQUAL(0, ocpp_get_next_deadline(&deadline));
+	LONGS_EQUAL(5, deadline);
+
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(4);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(5);
+	check_tx(OCPP_MSG_ROLE_CALLERROR, OCPP_MSG_RESET);
+	LONGS_EQUAL(OCPP_ERROR_INTERNAL, *(const ocpp_error_t *)sent.data);
+
+	LONGS_EQUAL(-ETIMEDOUT, ocpp_push_response(&req, &conf, sizeof(conf), false));
+	ocpp_get_stats(&stats);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_RESET].late);
+
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 0, NULL, 0);
+}
+
+TEST(Core, ShouldSendDeadlineAnswerAgain_WhenSameRequestReceivedAgain) {
+	struct ocpp_message req = {
+		.id = "late",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 5, NULL, 0);
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(5);
+	check_tx(OCPP_MSG_ROLE_CALLERROR, OCPP_MSG_RESET);
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	step(6);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(7);
+	check_tx(OCPP_MSG_ROLE_CALLERROR, OCPP_MSG_RESET);
+	STRCMP_EQUAL("late", (const char *)sent.message_id);
+	LONGS_EQUAL(OCPP_ERROR_INTERNAL, *(const ocpp_error_t *)sent.data);
+
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 0, NULL, 0);
+}
+
+TEST(Core, ShouldAnswerWithDefaultResponse_WhenNotRespondedInTime) {
+	struct ocpp_message req = {
+		.id = "late",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	const struct ocpp_Reset_conf conf = { .status = OCPP_REMOTE_STATUS_REJECTED };
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 5, &conf, sizeof(conf));
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(5);
+	check_tx(OCPP_MSG_ROLE_CALLRESULT, OCPP_MSG_RESET);
+	POINTERS_EQUAL(&conf, sent.data);
+
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 0, NULL, 0);
+}
+
+TEST(Core, ShouldAnswerInTime_WhenMoreRequestsLeftUnansweredThanTracked) {
+	struct ocpp_message req = {
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 5, NULL, 0);
+
+	for (int i = 0; i < 8; i++) {
+		snprintf(req.id, sizeof(req.id), "unanswered%d", i);
+		memcpy(sent.message_id, req.id, sizeof(req.id));
+		mock().expectOneCall("ocpp_recv")
+			.withOutputParameterReturning("msg", &req, sizeof(req));
+		mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+		step(0);
+	}
+
+	memcpy(req.id, "late", sizeof("late"));
+	req.type = OCPP_MSG_RESET;
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_FREE);
+	step(5);
+	check_tx(OCPP_MSG_ROLE_CALLERROR, OCPP_MSG_RESET);
+
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 0, NULL, 0);
+}
+
+TEST(Core, ShouldNotAnswerOnDeadline_WhenRequestDropped) {
+	struct ocpp_message req = {
+		.id = "dropped",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	time_t deadline;
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 5, NULL, 0);
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+
+	LONGS_EQUAL(0, ocpp_drop_pending_type(OCPP_MSG_RESET));
+	LONGS_EQUAL(-ENOENT, ocpp_get_next_deadline(&deadline));
+
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(5);
+
+	ocpp_set_response_deadline(OCPP_MSG_RESET, 0, NULL, 0);
+}
+
+TEST(Core, stats_ShouldRecordHandlingTime_WhenResponsePushed) {
+	struct ocpp_message req = {
+		.id = "req",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	struct ocpp_Reset_conf conf = { .status = OCPP_REMOTE_STATUS_ACCEPTED };
+	struct ocpp_stats stats;
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(3);
+	LONGS_EQUAL(0, ocpp_push_response(&req, &conf, sizeof(conf), false));
+
+	ocpp_get_stats(&stats);
+	LONGS_EQUAL(1, stats.msg[OCPP_MSG_RESET].handling[2]);
+	LONGS_EQUAL(0, stats.msg[OCPP_MSG_RESET].late);
+}
+
+TEST(Core, ShouldIgnoreRequest_WhenReceivedAgainWhileBeingHandled) {
+	struct ocpp_message req = {
+		.id = "dup",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	memcpy(sent.message_id, req.id, sizeof(req.id));
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", OCPP_EVENT_MESSAGE_INCOMING);
+	step(0);
+
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &req, sizeof(req));
+	step(1);
+}
+
+TEST(Core, ShouldNotMatchResponse_WhenIdIsPrefixOfRequestId) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLRESULT,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	sent.message_id[8] = '\0';
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", -ENOLINK);
+	step(1);
+	LONGS_EQUAL(1, ocpp_count_pending_requests());
+}
+
+TEST(Core, ShouldNotMatchResponse_WhenIdDiffersOnlyInCase) {
+	struct ocpp_DataTransfer data = { .vendorId = "VendorID", };
+	next_message_id = "0123456789abcdef0123456789abcdef";
+	ocpp_push_request(OCPP_MSG_DATA_TRANSFER, &data, sizeof(data), false);
+	mock().expectOneCall("ocpp_send").andReturnValue(0);
+	mock().expectOneCall("ocpp_recv").ignoreOtherParameters().andReturnValue(-ENOMSG);
+	step(0);
+	STRCMP_EQUAL("0123456789abcdef0123456789abcdef",
+			(const char *)sent.message_id);
+
+	struct ocpp_message resp = {
+		.role = OCPP_MSG_ROLE_CALLRESULT,
+		.type = OCPP_MSG_DATA_TRANSFER,
+	};
+	strcpy((char *)sent.message_id, "0123456789ABCDEF0123456789ABCDEF");
+	mock().expectOneCall("ocpp_recv")
+		.withOutputParameterReturning("msg", &resp, sizeof(resp));
+	mock().expectOneCall("on_ocpp_event").withParameter("event_type", -ENOLINK);
+	step(1);
+	LONGS_EQUAL(1, ocpp_count_pending_requests());
+}
@@ -0,0 +1,171 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/coro.hpp"
+
+#include <errno.h>
+#include <string.h>
+
+static struct {
+	time_t now;
+	struct ocpp_message sent;
+	int nr_sent;
+	struct ocpp_message resp;
+	bool has_resp;
+} fake;
+
+time_t time(time_t *second) {
+	return fake.now;
+}
+
+int ocpp_send(const struct ocpp_message *msg) {
+	fake.sent = *msg;
+	fake.nr_sent++;
+	return 0;
+}
+
+int ocpp_recv(struct ocpp_message *msg) {
+	if (!fake.has_resp) {
+		return -ENOMSG;
+	}
+
+	fake.has_resp = false;
+	*msg = fake.resp;
+	memcpy(msg->id, fake.sent.id, sizeof(msg->id));
+
+	return 0;
+}
+
+int ocpp_recv_ready(void) {
+	return -ENOTSUP;
+}
+
+int ocpp_lock(void) {
+	return 0;
+}
+int ocpp_unlock(void) {
+	return 0;
+}
+int ocpp_configuration_lock(void) {
+	return 0;
+}
+int ocpp_configuration_unlock(void) {
+	return 0;
+}
+
+void ocpp_generate_message_id(void *buf, size_t bufsize) {
+	snprintf((char *)buf, bufsize, "%d", fake.nr_sent);
+}
+
+static void respond(ocpp_message_role_t role, const void *conf, size_t size) {
+	struct ocpp_message *resp = &fake.resp;
+
+	memset(resp, 0, sizeof(*resp));
+	resp->role = role;
+	resp->type = fake.sent.type;
+	resp->payload.fmt.response = conf;
+	resp->payload.size = size;
+	fake.has_resp = true;
+}
+
+static struct {
+	int step;
+	int auth_err;
+	ocpp_auth_status_t auth_status;
+	int start_err;
+	int transaction_id;
+} flow;
+
+static ocpp::task start_charging(const char *idtag) {
+	ocpp::Authorize auth = { };
+	strcpy(auth.idTag, idtag);
+
+	flow.step = 1;
+	auto auth_resp = co_await ocpp::call(auth);
+	flow.auth_err = auth_resp.err;
+	if (!auth_resp) {
+		co_return;
+	}
+	flow.auth_status = auth_resp.conf.idTagInfo.status;
+
+	flow.step = 2;
+	auto start_resp = co_await ocpp::call<ocpp::StartTransaction>({
+		.connectorId = 1,
+		.idTag = { 'a', },
+	});
+	flow.start_err = start_resp.err;
+	flow.transaction_id = start_resp.conf.transactionId;
+	flow.step = 3;
+}
+
+TEST_GROUP(Coroutine) {
+	void setup(void) {
+		memset(&fake, 0, sizeof(fake));
+		memset(&flow, 0, sizeof(flow));
+		ocpp_init(NULL, NULL);
+	}
+	void teardown(void) {
+		mock().checkExpectations();
+		mock().clear();
+	}
+};
+
+TEST(Coroutine, call_ShouldResumeWithResponse_WhenReceived) {
+	start_charging("tag");
+	LONGS_EQUAL(1, flow.step);
+
+	ocpp_step();
+	LONGS_EQUAL(OCPP_MSG_AUTHORIZE, fake.sent.type);
+	STRCMP_EQUAL("tag", ((const ocpp::Authorize *)
+			fake.sent.payload.fmt.request)->idTag);
+
+	ocpp::Authorize_conf auth_conf = { };
+	auth_conf.idTagInfo.status = OCPP_AUTH_STATUS_ACCEPTED;
+	respond(OCPP_MSG_ROLE_CALLRESULT, &auth_conf, sizeof(auth_conf));
+	ocpp_step();
+	LONGS_EQUAL(2, flow.step);
+	LONGS_EQUAL(0, flow.auth_err);
+	LONGS_EQUAL(OCPP_AUTH_STATUS_ACCEPTED, flow.auth_status);
+
+	ocpp_step();
+	LONGS_EQUAL(OCPP_MSG_START_TRANSACTION, fake.sent.type);
+
+	ocpp::StartTransaction_conf start_conf = { };
+	start_conf.transactionId = 1234;
+	respond(OCPP_MSG_ROLE_CALLRESULT, &start_conf, sizeof(start_conf));
+	ocpp_step();
+	LONGS_EQUAL(3, flow.step);
+	LONGS_EQUAL(0, flow.start_err);
+	LONGS_EQUAL(1234, flow.transaction_id);
+}
+
+TEST(Coroutine, call_ShouldResumeWithEPROTO_WhenCallErrorReceived) {
+	start_charging("tag");
+	ocpp_step();
+
+	respond(OCPP_MSG_ROLE_CALLERROR, NULL, 0);
+	ocpp_step();
+	LONGS_EQUAL(-EPROTO, flow.auth_err);
+	LONGS_EQUAL(1, flow.step);
+}
+
+TEST(Coroutine, call_ShouldResumeWithETIMEDOUT_WhenNoResponse) {
+	start_charging("tag");
+
+	for (int i = 0; i <= OCPP_DEFAULT_TX_RETRIES; i++) {
+		fake.now = i * OCPP_DEFAULT_TX_TIMEOUT_SEC;
+		ocpp_step();
+	}
+
+	LONGS_EQUAL(-ETIMEDOUT, flow.auth_err);
+}
+
+TEST(Coroutine, call_ShouldNotSuspend_WhenQueueIsFull) {
+	ocpp::DataTransfer data = { };
+	while (ocpp_push_request(OCPP_MSG_DATA_TRANSFER,
+				&data, sizeof(data), false) == 0) {
+	}
+
+	start_charging("tag");
+	LONGS_EQUAL(-ENOMEM, flow.auth_err);
+}
@@ -0,0 +1,140 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/ocpp.hpp"
+
+#include <errno.h>
+#include <string.h>
+
+static_assert(ocpp::request_traits<ocpp::StartTransaction>::type ==
+		OCPP_MSG_START_TRANSACTION);
+static_assert(std::is_same_v<ocpp::StartTransaction_conf,
+		ocpp::request_traits<ocpp::StartTransaction>::conf_type>);
+static_assert(std::is_same_v<ocpp::Reset,
+		ocpp::message_traits<OCPP_MSG_RESET>::request_type>);
+static_assert(std::is_same_v<ocpp::DiagnosticsStatusNotification_conf,
+		ocpp::message_traits<OCPP_MSG_DIAGNOSTICS_NOTIFICATION>::conf_type>);
+static_assert(ocpp::conf_traits<ocpp::Heartbeat_conf>::type ==
+		OCPP_MSG_HEARTBEAT);
+
+static struct ocpp_message sent;
+static struct ocpp_message received;
+
+time_t time(time_t *second) {
+	return 0;
+}
+
+int ocpp_send(const struct ocpp_message *msg) {
+	sent = *msg;
+	return 0;
+}
+
+int ocpp_recv(struct ocpp_message *msg) {
+	if (received.role == OCPP_MSG_ROLE_NONE) {
+		return -ENOMSG;
+	}
+
+	*msg = received;
+	memset(&received, 0, sizeof(received));
+
+	return 0;
+}
+
+int ocpp_recv_ready(void) {
+	return -ENOTSUP;
+}
+
+int ocpp_lock(void) {
+	return 0;
+}
+int ocpp_unlock(void) {
+	return 0;
+}
+int ocpp_configuration_lock(void) {
+	return 0;
+}
+int ocpp_configuration_unlock(void) {
+	return 0;
+}
+
+void ocpp_generate_message_id(void *buf, size_t bufsize) {
+	strncpy((char *)buf, "id", bufsize);
+}
+
+struct handler {
+	void operator()(const ocpp::Reset &req, const struct ocpp_message &msg) {
+		mock().actualCall("Reset").withParameter("type", req.type);
+	}
+	void operator()(const ocpp::Heartbeat_conf &conf,
+			const struct ocpp_message &msg) {
+		mock().actualCall("Heartbeat_conf")
+			.withParameter("currentTime", (long)conf.currentTime);
+	}
+};
+
+static void set_received(ocpp_message_role_t role, ocpp_message_t type,
+		const void *payload) {
+	struct ocpp_message *msg = &received;
+
+	memset(msg, 0, sizeof(*msg));
+	msg->role = role;
+	msg->type = type;
+	msg->payload.fmt.response = payload;
+}
+
+TEST_GROUP(Cpp) {
+	struct handler h;
+
+	void setup(void) {
+		memset(&sent, 0, sizeof(sent));
+		memset(&received, 0, sizeof(received));
+		ocpp_init(ocpp::on_event<struct handler>, &h);
+	}
+	void teardown(void) {
+		mock().checkExpectations();
+		mock().clear();
+	}
+};
+
+TEST(Cpp, push_ShouldDeduceTypeAndSize) {
+	ocpp::DataTransfer data = { };
+	LONGS_EQUAL(0, ocpp::push(data));
+	ocpp_step();
+	LONGS_EQUAL(OCPP_MSG_DATA_TRANSFER, sent.type);
+	LONGS_EQUAL(sizeof(data), sent.payload.size);
+	POINTERS_EQUAL(&data, sent.payload.fmt.request);
+}
+
+TEST(Cpp, push_response_ShouldReturnEINVAL_WhenResponseOfAnotherType) {
+	const struct ocpp_message req = {
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_RESET,
+	};
+	ocpp::Reset_conf reset_conf = { };
+	ocpp::Heartbeat_conf heartbeat_conf = { };
+
+	LONGS_EQUAL(-EINVAL, ocpp::push_response(req, heartbeat_conf));
+	LONGS_EQUAL(0, ocpp::push_response(req, reset_conf));
+}
+
+TEST(Cpp, visit_ShouldCallOverloadOfPayloadType) {
+	ocpp::Reset reset = { .type = OCPP_RESET_SOFT };
+	set_received(OCPP_MSG_ROLE_CALL, OCPP_MSG_RESET, &reset);
+	mock().expectOneCall("Reset").withParameter("type", OCPP_RESET_SOFT);
+	ocpp_step();
+
+	ocpp::Heartbeat_conf conf = { .currentTime = 1234 };
+	set_received(OCPP_MSG_ROLE_CALLRESULT, OCPP_MSG_HEARTBEAT, &conf);
+	mock().expectOneCall("Heartbeat_conf").withParameter("currentTime", 1234L);
+	ocpp::visit(received, h);
+}
+
+TEST(Cpp, visit_ShouldIgnore_WhenNoOverloadForPayloadType) {
+	ocpp::Reset_conf reset_conf = { };
+	set_received(OCPP_MSG_ROLE_CALLRESULT, OCPP_MSG_RESET, &reset_conf);
+	ocpp::visit(received, h);
+
+	ocpp::Reset reset = { };
+	set_received(OCPP_MSG_ROLE_CALLERROR, OCPP_MSG_RESET, &reset);
+	ocpp::visit(received, h);
+}
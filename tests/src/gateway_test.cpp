@@ -0,0 +1,237 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/runtime/gateway.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define T0			1700000000
+
+struct fake_transport {
+	int fd;
+	int processed;
+	short revents;
+	int pending;
+	int sent;
+};
+
+static struct {
+	time_t now;
+	struct ocpp_context *ctx;
+	int steps;
+	int deadline_rc;
+	time_t deadline;
+	bool send_on_step;
+	int send_rc;
+} fake;
+
+time_t time(time_t *second) {
+	return fake.now;
+}
+
+struct ocpp_context *ocpp_switch_context(struct ocpp_context *ctx) {
+	struct ocpp_context *prev = fake.ctx;
+	fake.ctx = ctx;
+	return prev;
+}
+
+int ocpp_step(void) {
+	fake.steps++;
+	if (fake.send_on_step) {
+		struct ocpp_message msg = { 0, };
+		fake.send_rc = ocpp_send(&msg);
+	}
+	return 0;
+}
+
+int ocpp_get_next_deadline(time_t *deadline) {
+	*deadline = fake.deadline;
+	return fake.deadline_rc;
+}
+
+static int get_fd(const void *transport) {
+	return ((const struct fake_transport *)transport)->fd;
+}
+
+static short get_events(const void *transport) {
+	return POLLIN;
+}
+
+static int process(void *transport, short revents) {
+	struct fake_transport *p = (struct fake_transport *)transport;
+	p->processed++;
+	p->revents = revents;
+	return 0;
+}
+
+static int send_message(void *transport, const struct ocpp_message *msg) {
+	((struct fake_transport *)transport)->sent++;
+	return 0;
+}
+
+static int recv_message(void *transport, struct ocpp_message *msg) {
+	return -ENOMSG;
+}
+
+static bool has_pending(const void *transport) {
+	struct fake_transport *p = (struct fake_transport *)transport;
+	return p->pending > 0 && p->pending--;
+}
+
+static const struct ocpp_gw_transport api = {
+	.get_fd = get_fd,
+	.get_events = get_events,
+	.process = process,
+	.send = send_message,
+	.recv = recv_message,
+	.has_pending = has_pending,
+};
+
+TEST_GROUP(Gateway) {
+	struct ocpp_gw gw;
+	struct ocpp_gw_conn conn;
+	struct fake_transport transport;
+	struct ocpp_context *ctx;
+	int sv[2];
+
+	void setup(void) {
+		memset(&fake, 0, sizeof(fake));
+		memset(&transport, 0, sizeof(transport));
+		fake.now = T0;
+		fake.deadline_rc = -ENOENT;
+		ctx = (struct ocpp_context *)&transport;
+
+		LONGS_EQUAL(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv));
+		transport.fd = sv[0];
+
+		LONGS_EQUAL(0, ocpp_gw_init(&gw));
+	}
+	void teardown(void) {
+		ocpp_gw_deinit(&gw);
+		close(sv[0]);
+		close(sv[1]);
+
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	void add(void) {
+		LONGS_EQUAL(0, ocpp_gw_add(&gw, &conn, ctx, &api, &transport));
+	}
+};
+
+TEST(Gateway, add_ShouldReturnEINVAL_WhenTransportIsIncomplete) {
+	struct ocpp_gw_transport incomplete = api;
+	incomplete.recv = NULL;
+	LONGS_EQUAL(-EINVAL, ocpp_gw_add(&gw, &conn, ctx, &incomplete, &transport));
+	LONGS_EQUAL(-EINVAL, ocpp_gw_add(&gw, &conn, NULL, &api, &transport));
+}
+
+TEST(Gateway, run_ShouldStepNewConnectionInItsContext) {
+	add();
+	LONGS_EQUAL(1, ocpp_gw_run(&gw, 0));
+	LONGS_EQUAL(1, fake.steps);
+	LONGS_EQUAL(1, transport.processed);
+	POINTERS_EQUAL(NULL, fake.ctx);
+}
+
+TEST(Gateway, run_ShouldNotStep_WhenDeadlineIsNotReached) {
+	fake.deadline_rc = 0;
+	fake.deadline = T0 + 10;
+	add();
+	ocpp_gw_run(&gw, 0);
+
+	fake.now = T0 + 9;
+	LONGS_EQUAL(0, ocpp_gw_run(&gw, 0));
+	fake.now = T0 + 10;
+	fake.deadline = T0 + 20;
+	LONGS_EQUAL(1, ocpp_gw_run(&gw, 0));
+	LONGS_EQUAL(2, fake.steps);
+}
+
+TEST(Gateway, run_ShouldStepOnDeadlineBeyondWheel) {
+	fake.deadline_rc = 0;
+	fake.deadline = T0 + OCPP_GW_WHEEL_SLOTS * 2 + 3;
+	add();
+	ocpp_gw_run(&gw, 0);
+
+	for (int i = 1; i < OCPP_GW_WHEEL_SLOTS * 2 + 3; i++) {
+		fake.now = T0 + i;
+		LONGS_EQUAL(0, ocpp_gw_run(&gw, 0));
+	}
+	fake.now = T0 + OCPP_GW_WHEEL_SLOTS * 2 + 3;
+	LONGS_EQUAL(1, ocpp_gw_run(&gw, 0));
+}
+
+TEST(Gateway, run_ShouldStepOnIdleInterval_WhenNoDeadline) {
+	add();
+	ocpp_gw_run(&gw, 0);
+
+	fake.now = T0 + OCPP_GW_IDLE_INTERVAL_SEC - 1;
+	LONGS_EQUAL(0, ocpp_gw_run(&gw, 0));
+	fake.now = T0 + OCPP_GW_IDLE_INTERVAL_SEC;
+	LONGS_EQUAL(1, ocpp_gw_run(&gw, 0));
+}
+
+TEST(Gateway, run_ShouldStepWithRevents_WhenReadable) {
+	add();
+	ocpp_gw_run(&gw, 0);
+
+	LONGS_EQUAL(1, write(sv[1], "x", 1));
+	LONGS_EQUAL(1, ocpp_gw_run(&gw, 0));
+	LONGS_EQUAL(POLLIN, transport.revents);
+}
+
+TEST(Gateway, run_ShouldStepUpToBudget_WhenMessagesArePending) {
+	transport.pending = OCPP_GW_STEP_BUDGET * 2;
+	add();
+	ocpp_gw_run(&gw, 0);
+	LONGS_EQUAL(OCPP_GW_STEP_BUDGET, fake.steps);
+	ocpp_gw_run(&gw, 0);
+	LONGS_EQUAL(OCPP_GW_STEP_BUDGET * 2, fake.steps);
+}
+
+TEST(Gateway, run_ShouldStepAgainNextSecond_WhenDeadlineIsInPast) {
+	fake.deadline_rc = 0;
+	fake.deadline = T0 - 1;
+	add();
+	ocpp_gw_run(&gw, 0);
+	LONGS_EQUAL(OCPP_GW_STEP_BUDGET, fake.steps);
+
+	LONGS_EQUAL(0, ocpp_gw_run(&gw, 0));
+	fake.now = T0 + 1;
+	LONGS_EQUAL(1, ocpp_gw_run(&gw, 0));
+}
+
+TEST(Gateway, kick_ShouldStepRightAway) {
+	fake.deadline_rc = 0;
+	fake.deadline = T0 + 100;
+	add();
+	ocpp_gw_run(&gw, 0);
+
+	ocpp_gw_kick(&gw, &conn);
+	LONGS_EQUAL(1, ocpp_gw_run(&gw, 0));
+}
+
+TEST(Gateway, remove_ShouldStopStepping) {
+	add();
+	ocpp_gw_remove(&gw, &conn);
+	LONGS_EQUAL(0, ocpp_gw_run(&gw, 0));
+	LONGS_EQUAL(0, fake.steps);
+}
+
+TEST(Gateway, send_ShouldGoThroughTransportOfConnectionBeingStepped) {
+	struct ocpp_message msg = { 0, };
+	LONGS_EQUAL(-ENOTCONN, ocpp_send(&msg));
+
+	fake.send_on_step = true;
+	add();
+	ocpp_gw_run(&gw, 0);
+	LONGS_EQUAL(0, fake.send_rc);
+	LONGS_EQUAL(1, transport.sent);
+}
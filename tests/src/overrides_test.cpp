@@ -0,0 +1,53 @@
+#include "CppUTest/TestHarness.h"
+
+#include "ocpp/ocpp.h"
+
+#include <string.h>
+
+uint64_t ocpp_get_random_seed(void) {
+	return 42;
+}
+
+TEST_GROUP(Overrides) {
+	void setup(void) {
+	}
+	void teardown(void) {
+	}
+};
+
+TEST(Overrides, generate_message_id_ShouldGiveHexDigitsOfPrefixAndCounter) {
+	char id1[OCPP_MESSAGE_ID_MAXLEN];
+	char id2[OCPP_MESSAGE_ID_MAXLEN];
+
+	ocpp_generate_message_id(id1, sizeof(id1));
+	ocpp_generate_message_id(id2, sizeof(id2));
+
+	LONGS_EQUAL(32, strlen(id1));
+	LONGS_EQUAL(32, strspn(id1, "0123456789abcdef"));
+	MEMCMP_EQUAL(id1, id2, 16);
+	CHECK(strcmp(id1, id2) != 0);
+}
+
+TEST(Overrides, generate_message_id_ShouldTakePrefixFromRandomSeed) {
+	char id[OCPP_MESSAGE_ID_MAXLEN];
+	ocpp_generate_message_id(id, sizeof(id));
+	/* splitmix64 of 42 with the lowest bit set */
+	MEMCMP_EQUAL("a759ea27d4727623", id, 16);
+}
+
+TEST(Overrides, generate_message_id_ShouldNotCollide_WhenGeneratedInSameSecond) {
+	char prev[OCPP_MESSAGE_ID_MAXLEN] = { 0, };
+
+	for (int i = 0; i < 1000; i++) {
+		char id[OCPP_MESSAGE_ID_MAXLEN];
+		ocpp_generate_message_id(id, sizeof(id));
+		CHECK(strcmp(prev, id) < 0);
+		strcpy(prev, id);
+	}
+}
+
+TEST(Overrides, generate_message_id_ShouldTruncate_WhenBufferIsSmall) {
+	char id[8];
+	ocpp_generate_message_id(id, sizeof(id));
+	LONGS_EQUAL(7, strlen(id));
+}
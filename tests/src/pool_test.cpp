@@ -0,0 +1,261 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/runtime/pool.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NR_CONNS		8
+#define T0			1700000000
+
+struct fake_transport {
+	int fd;
+	int steps; /**< of the context on this transport */
+	int stepping; /**< more than one if stepped at the same time */
+	int overlaps;
+	int sent;
+};
+
+static struct {
+	int steps;
+	int send_rc;
+} fake;
+
+static __thread struct ocpp_context *current_ctx;
+
+time_t time(time_t *second) {
+	return T0;
+}
+
+struct ocpp_context *ocpp_switch_context(struct ocpp_context *ctx) {
+	struct ocpp_context *prev = current_ctx;
+	current_ctx = ctx;
+	return prev;
+}
+
+int ocpp_step(void) {
+	struct fake_transport *p = (struct fake_transport *)current_ctx;
+	struct ocpp_message msg = { 0, };
+
+	if (__atomic_add_fetch(&p->stepping, 1, __ATOMIC_SEQ_CST) > 1) {
+		__atomic_fetch_add(&p->overlaps, 1, __ATOMIC_SEQ_CST);
+	}
+	usleep(100);
+	__atomic_fetch_add(&p->steps, 1, __ATOMIC_SEQ_CST);
+	__atomic_fetch_add(&fake.steps, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&fake.send_rc, ocpp_send(&msg), __ATOMIC_SEQ_CST);
+	__atomic_sub_fetch(&p->stepping, 1, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+int ocpp_get_next_deadline(time_t *deadline) {
+	*deadline = T0 + 100;
+	return 0;
+}
+
+static int get_fd(const void *transport) {
+	return ((const struct fake_transport *)transport)->fd;
+}
+
+static short get_events(const void *transport) {
+	return POLLIN;
+}
+
+static int process(void *transport, short revents) {
+	struct fake_transport *p = (struct fake_transport *)transport;
+	char buf[16];
+	if (revents & POLLIN) {
+		while (read(p->fd, buf, sizeof(buf)) > 0) {
+		}
+	}
+	return 0;
+}
+
+static int send_message(void *transport, const struct ocpp_message *msg) {
+	__atomic_fetch_add(&((struct fake_transport *)transport)->sent, 1,
+			__ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static int recv_message(void *transport, struct ocpp_message *msg) {
+	return -ENOMSG;
+}
+
+static const struct ocpp_gw_transport api = {
+	.get_fd = get_fd,
+	.get_events = get_events,
+	.process = process,
+	.send = send_message,
+	.recv = recv_message,
+};
+
+static void wait_for_steps(int n) {
+	for (int i = 0; i < 2000 &&
+			__atomic_load_n(&fake.steps, __ATOMIC_SEQ_CST) < n; i++) {
+		usleep(1000);
+	}
+}
+
+TEST_GROUP(Pool) {
+	struct ocpp_pool pool;
+	struct ocpp_pool_conn conns[NR_CONNS];
+	struct fake_transport transports[NR_CONNS];
+	int peers[NR_CONNS];
+
+	void setup(void) {
+		memset(&fake, 0, sizeof(fake));
+		memset(transports, 0, sizeof(transports));
+
+		for (int i = 0; i < NR_CONNS; i++) {
+			int sv[2];
+			LONGS_EQUAL(0, socketpair(AF_UNIX,
+					SOCK_SEQPACKET | SOCK_NONBLOCK, 0, sv));
+			transports[i].fd = sv[0];
+			peers[i] = sv[1];
+		}
+
+		LONGS_EQUAL(0, ocpp_pool_init(&pool, 4));
+	}
+	void teardown(void) {
+		ocpp_pool_deinit(&pool);
+
+		for (int i = 0; i < NR_CONNS; i++) {
+			close(transports[i].fd);
+			close(peers[i]);
+		}
+
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	void add(int i) {
+		LONGS_EQUAL(0, ocpp_pool_add(&pool, &conns[i],
+				(struct ocpp_context *)&transports[i],
+				&api, &transports[i]));
+	}
+};
+
+TEST(Pool, init_ShouldReturnEINVAL_WhenWorkersOutOfRange) {
+	struct ocpp_pool other;
+	LONGS_EQUAL(-EINVAL, ocpp_pool_init(&other, 0));
+	LONGS_EQUAL(-EINVAL, ocpp_pool_init(&other, OCPP_POOL_MAX_WORKERS + 1));
+}
+
+TEST(Pool, add_ShouldStepNewConnectionInItsContext) {
+	add(0);
+	LONGS_EQUAL(0, ocpp_pool_start(&pool));
+	wait_for_steps(1);
+	ocpp_pool_stop(&pool);
+
+	LONGS_EQUAL(1, transports[0].steps);
+	LONGS_EQUAL(1, transports[0].sent);
+	LONGS_EQUAL(0, fake.send_rc);
+}
+
+TEST(Pool, run_ShouldStepOnIncomingData) {
+	add(0);
+	LONGS_EQUAL(0, ocpp_pool_start(&pool));
+	wait_for_steps(1);
+
+	LONGS_EQUAL(1, write(peers[0], "x", 1));
+	wait_for_steps(2);
+	ocpp_pool_stop(&pool);
+
+	LONGS_EQUAL(2, transports[0].steps);
+}
+
+TEST(Pool, run_ShouldNeverStepContextOnTwoWorkersAtOnce) {
+	for (int i = 0; i < NR_CONNS; i++) {
+		add(i);
+	}
+	LONGS_EQUAL(0, ocpp_pool_start(&pool));
+
+	for (int n = 0; n < 200; n++) {
+		ocpp_pool_kick(&pool, &conns[n % NR_CONNS]);
+		if (write(peers[n % NR_CONNS], "x", 1) < 0) {
+		}
+	}
+	wait_for_steps(NR_CONNS * 2);
+	ocpp_pool_stop(&pool);
+
+	for (int i = 0; i < NR_CONNS; i++) {
+		LONGS_EQUAL(0, transports[i].overlaps);
+		CHECK(transports[i].steps > 0);
+	}
+}
+
+TEST(Pool, get_stats_ShouldReportStepsOfEachWorker) {
+	struct ocpp_pool_stats stats;
+	unsigned long steps = 0;
+
+	for (int i = 0; i < NR_CONNS; i++) {
+		add(i);
+	}
+	LONGS_EQUAL(0, ocpp_pool_start(&pool));
+	wait_for_steps(NR_CONNS);
+	ocpp_pool_stop(&pool);
+
+	for (int i = 0; i < 4; i++) {
+		LONGS_EQUAL(0, ocpp_pool_get_stats(&pool, i, &stats));
+		CHECK(stats.utilization <= 100);
+		CHECK(stats.busy_ns + stats.idle_ns > 0);
+		steps += stats.steps;
+	}
+	LONGS_EQUAL(NR_CONNS, steps);
+	LONGS_EQUAL(-EINVAL, ocpp_pool_get_stats(&pool, 4, &stats));
+}
+
+TEST(Pool, remove_ShouldStopStepping_WhenQueuedWhileStopped) {
+	add(0);
+	add(1);
+	ocpp_pool_remove(&pool, &conns[0]);
+	LONGS_EQUAL(0, ocpp_pool_start(&pool));
+	wait_for_steps(1);
+	usleep(10000);
+	ocpp_pool_stop(&pool);
+
+	LONGS_EQUAL(0, transports[0].steps);
+	LONGS_EQUAL(1, transports[1].steps);
+}
+
+TEST(Pool, remove_ShouldNotTouchConnection_WhenFreedWhileRescheduled) {
+	for (int i = 1; i < NR_CONNS; i++) {
+		add(i);
+	}
+	LONGS_EQUAL(0, ocpp_pool_start(&pool));
+
+	for (int n = 0; n < 200; n++) {
+		struct ocpp_pool_conn *conn = new struct ocpp_pool_conn;
+		LONGS_EQUAL(0, ocpp_pool_add(&pool, conn,
+				(struct ocpp_context *)&transports[0],
+				&api, &transports[0]));
+		for (int i = 0; i < n % 8; i++) {
+			ocpp_pool_kick(&pool, conn);
+			ocpp_pool_kick(&pool, &conns[1 + i % (NR_CONNS - 1)]);
+			if (write(peers[0], "x", 1) < 0) {
+			}
+		}
+		ocpp_pool_remove(&pool, conn);
+		const int steps = __atomic_load_n(&transports[0].steps,
+				__ATOMIC_SEQ_CST);
+		memset(conn, 0xa5, sizeof(*conn));
+		delete conn;
+		usleep(100);
+		LONGS_EQUAL(steps, __atomic_load_n(&transports[0].steps,
+				__ATOMIC_SEQ_CST));
+	}
+
+	ocpp_pool_stop(&pool);
+	LONGS_EQUAL(0, transports[0].overlaps);
+}
+
+TEST(Pool, send_ShouldReturnENOTCONN_WhenNotInWorker) {
+	struct ocpp_message msg = { 0, };
+	LONGS_EQUAL(-ENOTCONN, ocpp_send(&msg));
+}
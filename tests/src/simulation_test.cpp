@@ -0,0 +1,167 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/ocpp.h"
+#include "simulator.h"
+
+#define START		1000000
+#define HOUR		3600
+#define DAY		(24 * HOUR)
+
+static struct ocpp_BootNotification boot;
+static struct ocpp_StartTransaction start_transaction;
+static struct ocpp_MeterValues metervalues;
+static struct ocpp_StatusNotification status_notification;
+
+static void go_offline(void *ctx) {
+	sim_set_online(false);
+}
+static void go_online(void *ctx) {
+	sim_set_online(true);
+}
+static void push_transaction(void *ctx) {
+	ocpp_push_request(OCPP_MSG_STATUS_NOTIFICATION,
+			&status_notification, sizeof(status_notification), false);
+	ocpp_push_request(OCPP_MSG_START_TRANSACTION,
+			&start_transaction, sizeof(start_transaction), false);
+	for (int i = 0; i < 3; i++) {
+		ocpp_push_request(OCPP_MSG_METER_VALUES,
+				&metervalues, sizeof(metervalues), false);
+	}
+}
+static void push_metervalues(void *ctx) {
+	ocpp_push_request(OCPP_MSG_METER_VALUES,
+			&metervalues, sizeof(metervalues), false);
+}
+static void push_periodically(void *ctx) {
+	static const ocpp_message_t types[] = {
+		OCPP_MSG_METER_VALUES,
+		OCPP_MSG_STATUS_NOTIFICATION,
+		OCPP_MSG_START_TRANSACTION,
+		OCPP_MSG_DATA_TRANSFER,
+	};
+	uint32_t *n = (uint32_t *)ctx;
+	ocpp_push_request(types[*n % 4], &metervalues, sizeof(metervalues), false);
+	(*n)++;
+	sim_schedule(sim_now() + 7 * 60, push_periodically, ctx);
+}
+static void flap_daily(void *ctx) {
+	sim_set_online(false);
+	sim_schedule(sim_now() + HOUR, go_online, NULL);
+	sim_schedule(sim_now() + DAY, flap_daily, NULL);
+}
+
+TEST_GROUP(Simulation) {
+	void setup(void) {
+		sim_init(START, 1);
+	}
+	void teardown(void) {
+		if (sim_get_violation()) {
+			FAIL(sim_get_violation());
+		}
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	void set_config(const char *key, uint32_t value) {
+		ocpp_set_configuration(key, &value, sizeof(value));
+	}
+	void go_boot(void) {
+		ocpp_push_request(OCPP_MSG_BOOTNOTIFICATION,
+				&boot, sizeof(boot), false);
+		LONGS_EQUAL(0, sim_run_for(0));
+	}
+};
+
+TEST(Simulation, ShouldSendHeartbeatsAtInterval_WhenIdleForADay) {
+	set_config("HeartbeatInterval", 60);
+	go_boot();
+
+	LONGS_EQUAL(0, sim_run_until(START + DAY));
+
+	const struct sim_stats *stats = sim_get_stats();
+	LONGS_EQUAL(DAY / 60, stats->sent[OCPP_MSG_HEARTBEAT]);
+	LONGS_EQUAL(DAY / 60, stats->answered[OCPP_MSG_HEARTBEAT]);
+	LONGS_EQUAL(0, stats->stalls);
+	CHECK(stats->steps <= DAY / 60 * 2 + 2);
+
+	for (uint32_t i = 1; i < sim_count_logged(); i++) {
+		LONGS_EQUAL(60, sim_get_sent(i)->time - sim_get_sent(i - 1)->time);
+	}
+}
+
+TEST(Simulation, ShouldKeepTransactionMessages_WhenOfflineForAWeek) {
+	go_boot();
+	sim_schedule(START + HOUR, go_offline, NULL);
+	sim_schedule(START + HOUR + 100, push_transaction, NULL);
+	sim_schedule(START + HOUR + 7 * DAY, go_online, NULL);
+
+	LONGS_EQUAL(0, sim_run_until(START + 8 * DAY + HOUR));
+
+	const struct sim_stats *stats = sim_get_stats();
+	LONGS_EQUAL(1, stats->sent[OCPP_MSG_START_TRANSACTION]);
+	LONGS_EQUAL(3, stats->sent[OCPP_MSG_METER_VALUES]);
+	LONGS_EQUAL(0, stats->sent[OCPP_MSG_STATUS_NOTIFICATION]);
+	LONGS_EQUAL(1, stats->freed[OCPP_MSG_STATUS_NOTIFICATION]);
+	CHECK(stats->failed[OCPP_MSG_START_TRANSACTION] > 1000);
+	LONGS_EQUAL(0, stats->unmatched);
+	LONGS_EQUAL(0, stats->stalls);
+	LONGS_EQUAL(0, ocpp_count_pending_requests());
+
+	struct ocpp_stats engine;
+	ocpp_get_stats(&engine);
+	LONGS_EQUAL(0, engine.msg[OCPP_MSG_START_TRANSACTION].dropped);
+	LONGS_EQUAL(0, engine.msg[OCPP_MSG_METER_VALUES].dropped);
+	LONGS_EQUAL(1, engine.msg[OCPP_MSG_STATUS_NOTIFICATION].dropped);
+}
+
+TEST(Simulation, ShouldBackOffTransactionMessage_WhenCallErrorReceived) {
+	set_config("TransactionMessageAttempts", 3);
+	set_config("TransactionMessageRetryInterval", 30);
+	sim_set_reply(OCPP_MSG_METER_VALUES, SIM_REPLY_ERROR);
+	go_boot();
+	sim_schedule(START + 100, push_metervalues, NULL);
+
+	LONGS_EQUAL(0, sim_run_until(START + 1000));
+
+	LONGS_EQUAL(4, sim_count_logged());
+	LONGS_EQUAL(START + 100, sim_get_sent(1)->time);
+	LONGS_EQUAL(START + 130, sim_get_sent(2)->time);
+	LONGS_EQUAL(START + 190, sim_get_sent(3)->time);
+	LONGS_EQUAL(3, sim_get_stats()->answered[OCPP_MSG_METER_VALUES]);
+	LONGS_EQUAL(1, sim_get_stats()->freed[OCPP_MSG_METER_VALUES]);
+
+	struct ocpp_stats engine;
+	ocpp_get_stats(&engine);
+	LONGS_EQUAL(1, engine.msg[OCPP_MSG_METER_VALUES].dropped);
+}
+
+TEST(Simulation, ShouldHoldInvariants_WhenRunningAMonthWithFailures) {
+	uint32_t pushes = 0;
+
+	set_config("HeartbeatInterval", 300);
+	sim_set_latency(2);
+	sim_set_failure_rate(200);
+	go_boot();
+	sim_schedule(START + 60, push_periodically, &pushes);
+	sim_schedule(START + HOUR, flap_daily, NULL);
+
+	LONGS_EQUAL(0, sim_run_until(START + 30 * DAY));
+
+	const struct sim_stats *stats = sim_get_stats();
+	struct ocpp_stats engine;
+	uint32_t pushed = 0;
+	uint32_t freed = 0;
+
+	ocpp_get_stats(&engine);
+	for (int i = 0; i < OCPP_MSG_MAX; i++) {
+		pushed += engine.msg[i].pushed;
+		freed += stats->freed[i];
+	}
+
+	CHECK(pushes > 30 * DAY / (7 * 60) - 2);
+	LONGS_EQUAL(pushed, freed + ocpp_count_pending_requests());
+	LONGS_EQUAL(0, stats->unmatched);
+	LONGS_EQUAL(0, stats->stalls);
+	CHECK(stats->sent[OCPP_MSG_HEARTBEAT] > 0);
+}
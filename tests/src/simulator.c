@@ -0,0 +1,433 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "simulator.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(OCPP_TX_POOL_LEN)
+#define OCPP_TX_POOL_LEN			8
+#endif
+
+struct event {
+	time_t at;
+	uint32_t seq;
+	sim_event_func_t fn;
+	void *ctx;
+	bool used;
+};
+
+struct inflight {
+	time_t due;
+	char id[OCPP_MESSAGE_ID_MAXLEN];
+	ocpp_message_role_t role;
+	ocpp_message_t type;
+	bool used;
+};
+
+static struct {
+	time_t now;
+
+	sim_reply_t reply[OCPP_MSG_MAX];
+	uint32_t latency;
+	uint32_t failure_permille;
+	bool online;
+	struct ocpp_BootNotification_conf boot;
+	uint8_t conf[128]; /* zeroed response for the rest of types */
+
+	struct event events[SIM_EVENTS_MAX];
+	uint32_t event_seq;
+	struct inflight inflight[SIM_INFLIGHT_MAX];
+
+	struct sim_record log[SIM_LOG_LEN];
+	uint32_t log_count;
+
+	struct sim_stats stats;
+	char violation[128];
+
+	uint32_t rng;
+	unsigned long msgid;
+} m;
+
+static uint32_t get_random(void)
+{
+	uint32_t x = m.rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	m.rng = x;
+	return x;
+}
+
+static void violate(const char *reason)
+{
+	if (m.violation[0] == '\0') {
+		snprintf(m.violation, sizeof(m.violation), "%ld: %s",
+				(long)m.now, reason);
+	}
+}
+
+static void check_invariants(void)
+{
+	struct ocpp_stats stats;
+	uint32_t len = 0;
+
+	ocpp_get_stats(&stats);
+
+	for (int i = 0; i < OCPP_QUEUE_MAX; i++) {
+		len += stats.queue[i].len;
+	}
+
+	if (len != ocpp_count_pending_requests()) {
+		violate("queue lengths do not add up to the pending requests");
+	}
+	if (len > OCPP_TX_POOL_LEN) {
+		violate("more messages queued than the pool holds");
+	}
+	if (stats.queue[OCPP_QUEUE_WAIT].len > 1) {
+		violate("more than one message in flight");
+	}
+	if (stats.msg[OCPP_MSG_BOOTNOTIFICATION].dropped) {
+		violate("BootNotification dropped");
+	}
+}
+
+static void log_sent(const struct ocpp_message *msg)
+{
+	struct sim_record *rec = &m.log[m.log_count++ % SIM_LOG_LEN];
+
+	rec->time = m.now;
+	rec->role = msg->role;
+	rec->type = msg->type;
+}
+
+static struct inflight *get_due_inflight(void)
+{
+	struct inflight *next = NULL;
+
+	for (int i = 0; i < SIM_INFLIGHT_MAX; i++) {
+		struct inflight *p = &m.inflight[i];
+		if (p->used && p->due <= m.now &&
+				(next == NULL || p->due < next->due)) {
+			next = p;
+		}
+	}
+
+	return next;
+}
+
+static struct event *get_due_event(void)
+{
+	struct event *next = NULL;
+
+	for (int i = 0; i < SIM_EVENTS_MAX; i++) {
+		struct event *p = &m.events[i];
+		if (p->used && p->at <= m.now && (next == NULL ||
+				p->at < next->at ||
+				(p->at == next->at && p->seq < next->seq))) {
+			next = p;
+		}
+	}
+
+	return next;
+}
+
+static void run_due_events(void)
+{
+	struct event *e;
+
+	while ((e = get_due_event()) != NULL) {
+		e->used = false;
+		(*e->fn)(e->ctx);
+	}
+}
+
+static bool get_next_time(time_t *next)
+{
+	bool found = ocpp_get_next_deadline(next) == 0;
+
+	for (int i = 0; i < SIM_INFLIGHT_MAX; i++) {
+		if (m.inflight[i].used && (!found || m.inflight[i].due < *next)) {
+			*next = m.inflight[i].due;
+			found = true;
+		}
+	}
+	for (int i = 0; i < SIM_EVENTS_MAX; i++) {
+		if (m.events[i].used && (!found || m.events[i].at < *next)) {
+			*next = m.events[i].at;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+static void step(void)
+{
+	for (int i = 0; i < SIM_MAX_STEPS_PER_SEC; i++) {
+		time_t next;
+
+		ocpp_step();
+		m.stats.steps++;
+		check_invariants();
+
+		if (!get_next_time(&next) || next > m.now) {
+			return;
+		}
+
+		run_due_events();
+	}
+
+	m.stats.stalls++;
+}
+
+static void on_ocpp_event(ocpp_event_t event_type,
+		const struct ocpp_message *msg, void *ctx)
+{
+	(void)ctx;
+
+	if (msg->type >= OCPP_MSG_MAX) {
+		return;
+	}
+
+	if (event_type == OCPP_EVENT_MESSAGE_INCOMING) {
+		if (msg->role == OCPP_MSG_ROLE_CALLRESULT ||
+				msg->role == OCPP_MSG_ROLE_CALLERROR) {
+			m.stats.answered[msg->type]++;
+		}
+	} else if (event_type == OCPP_EVENT_MESSAGE_FREE) {
+		m.stats.freed[msg->type]++;
+	} else if (event_type == -ENOLINK) {
+		m.stats.unmatched++;
+	}
+}
+
+time_t time(time_t *second)
+{
+	if (second) {
+		*second = m.now;
+	}
+	return m.now;
+}
+
+int ocpp_send(const struct ocpp_message *msg)
+{
+	const sim_reply_t reply = m.reply[msg->type];
+
+	if (!m.online || reply == SIM_SEND_FAIL ||
+			(m.failure_permille &&
+			 get_random() % 1000 < m.failure_permille)) {
+		m.stats.failed[msg->type]++;
+		return -ENOTCONN;
+	}
+
+	m.stats.sent[msg->type]++;
+	log_sent(msg);
+
+	if (msg->role != OCPP_MSG_ROLE_CALL || reply == SIM_REPLY_NONE) {
+		return 0;
+	}
+
+	for (int i = 0; i < SIM_INFLIGHT_MAX; i++) {
+		struct inflight *p = &m.inflight[i];
+
+		if (p->used) {
+			continue;
+		}
+
+		p->used = true;
+		p->due = m.now + (time_t)m.latency;
+		p->type = msg->type;
+		p->role = reply == SIM_REPLY_ERROR?
+			OCPP_MSG_ROLE_CALLERROR : OCPP_MSG_ROLE_CALLRESULT;
+		memcpy(p->id, msg->id, sizeof(p->id));
+		break;
+	}
+
+	return 0;
+}
+
+int ocpp_recv(struct ocpp_message *msg)
+{
+	struct inflight *p = get_due_inflight();
+
+	if (p == NULL) {
+		return -ENOMSG;
+	}
+
+	memcpy(msg->id, p->id, sizeof(msg->id));
+	msg->role = p->role;
+	msg->type = p->type;
+	msg->payload.fmt.response = m.conf;
+	msg->payload.size = sizeof(m.conf);
+
+	if (p->type == OCPP_MSG_BOOTNOTIFICATION) {
+		m.boot.currentTime = m.now;
+		msg->payload.fmt.response = &m.boot;
+		msg->payload.size = sizeof(m.boot);
+	}
+
+	p->used = false;
+
+	return 0;
+}
+
+int ocpp_lock(void)
+{
+	return 0;
+}
+
+int ocpp_unlock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_lock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_unlock(void)
+{
+	return 0;
+}
+
+void ocpp_generate_message_id(void *buf, size_t bufsize)
+{
+	snprintf((char *)buf, bufsize, "%lu", ++m.msgid);
+}
+
+void sim_init(time_t start, uint32_t seed)
+{
+	memset(&m, 0, sizeof(m));
+
+	m.now = start;
+	m.rng = seed? seed : 1;
+	m.online = true;
+	m.boot.status = OCPP_BOOT_STATUS_ACCEPTED;
+
+	ocpp_init(on_ocpp_event, NULL);
+}
+
+time_t sim_now(void)
+{
+	return m.now;
+}
+
+void sim_set_reply(ocpp_message_t type, sim_reply_t reply)
+{
+	if (type < OCPP_MSG_MAX) {
+		m.reply[type] = reply;
+		return;
+	}
+
+	for (int i = 0; i < OCPP_MSG_MAX; i++) {
+		m.reply[i] = reply;
+	}
+}
+
+void sim_set_latency(uint32_t sec)
+{
+	m.latency = sec;
+}
+
+void sim_set_failure_rate(uint32_t permille)
+{
+	m.failure_permille = permille;
+}
+
+void sim_set_online(bool online)
+{
+	m.online = online;
+
+	if (!online) {
+		memset(m.inflight, 0, sizeof(m.inflight));
+	}
+}
+
+void sim_set_boot_status(ocpp_boot_status_t status)
+{
+	m.boot.status = status;
+}
+
+int sim_schedule(time_t at, sim_event_func_t fn, void *ctx)
+{
+	for (int i = 0; i < SIM_EVENTS_MAX; i++) {
+		struct event *e = &m.events[i];
+
+		if (e->used) {
+			continue;
+		}
+
+		*e = (struct event) {
+			.at = at,
+			.seq = m.event_seq++,
+			.fn = fn,
+			.ctx = ctx,
+			.used = true,
+		};
+
+		return 0;
+	}
+
+	return -ENOSPC;
+}
+
+int sim_run_until(time_t end)
+{
+	while (m.violation[0] == '\0') {
+		time_t next;
+
+		run_due_events();
+		step();
+
+		if (!get_next_time(&next) || next <= m.now) {
+			next = m.now + 1;
+		}
+		if (next > end) {
+			m.now = end > m.now? end : m.now;
+			break;
+		}
+
+		m.now = next;
+	}
+
+	return m.violation[0] == '\0'? 0 : -EFAULT;
+}
+
+int sim_run_for(uint32_t sec)
+{
+	return sim_run_until(m.now + (time_t)sec);
+}
+
+const struct sim_stats *sim_get_stats(void)
+{
+	return &m.stats;
+}
+
+const char *sim_get_violation(void)
+{
+	return m.violation[0] == '\0'? NULL : m.violation;
+}
+
+const struct sim_record *sim_get_sent(uint32_t index)
+{
+	const uint32_t kept = m.log_count < SIM_LOG_LEN?
+		m.log_count : SIM_LOG_LEN;
+
+	if (index >= kept) {
+		return NULL;
+	}
+
+	return &m.log[(m.log_count - kept + index) % SIM_LOG_LEN];
+}
+
+uint32_t sim_count_logged(void)
+{
+	return m.log_count < SIM_LOG_LEN? m.log_count : SIM_LOG_LEN;
+}
@@ -0,0 +1,140 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Discrete-event harness running the engine on a virtual clock.
+ *
+ * The harness provides `time()` and the transport overrides. Instead of
+ * ticking every second, the clock jumps to whichever comes first of the
+ * engine's next deadline, the next response from the scripted server and the
+ * next scheduled event, so days of operation take milliseconds. Invariants on
+ * the queues are checked after every step. */
+
+#ifndef OCPP_TESTS_SIMULATOR_H
+#define OCPP_TESTS_SIMULATOR_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "ocpp/ocpp.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#if !defined(SIM_EVENTS_MAX)
+#define SIM_EVENTS_MAX				32
+#endif
+#if !defined(SIM_INFLIGHT_MAX)
+#define SIM_INFLIGHT_MAX			8
+#endif
+#if !defined(SIM_LOG_LEN)
+#define SIM_LOG_LEN				256
+#endif
+#if !defined(SIM_MAX_STEPS_PER_SEC)
+#define SIM_MAX_STEPS_PER_SEC			64
+#endif
+
+typedef enum {
+	SIM_REPLY_RESULT,	/**< answered with CALLRESULT */
+	SIM_REPLY_ERROR,	/**< answered with CALLERROR */
+	SIM_REPLY_NONE,		/**< sent but never answered */
+	SIM_SEND_FAIL,		/**< `ocpp_send()` fails */
+} sim_reply_t;
+
+typedef void (*sim_event_func_t)(void *ctx);
+
+struct sim_record {
+	time_t time;
+	ocpp_message_role_t role;
+	ocpp_message_t type;
+};
+
+struct sim_stats {
+	uint32_t steps;
+	uint32_t stalls;	/**< seconds the engine kept having work */
+	uint32_t sent[OCPP_MSG_MAX];	/**< accepted by the transport */
+	uint32_t failed[OCPP_MSG_MAX];	/**< rejected by the transport */
+	uint32_t answered[OCPP_MSG_MAX];
+	uint32_t freed[OCPP_MSG_MAX];
+	uint32_t unmatched;	/**< responses to no request in the engine */
+};
+
+/**
+ * @brief Reset the harness and initialize the engine.
+ *
+ * Every message type is answered with CALLRESULT right away and the link is
+ * online.
+ *
+ * @param[in] start time of the virtual clock to start from
+ * @param[in] seed seed for failures injected at random
+ */
+void sim_init(time_t start, uint32_t seed);
+time_t sim_now(void);
+
+/**
+ * @brief Set how the server treats a type of message.
+ *
+ * @param[in] type message type. `OCPP_MSG_MAX` for all types
+ * @param[in] reply behavior
+ */
+void sim_set_reply(ocpp_message_t type, sim_reply_t reply);
+void sim_set_latency(uint32_t sec);
+/**
+ * @brief Set the permille of messages that fail to be sent at random, on top
+ *        of the reply set by @ref sim_set_reply.
+ */
+void sim_set_failure_rate(uint32_t permille);
+/**
+ * @brief Take the link up or down.
+ *
+ * While offline, `ocpp_send()` fails and responses on the way are lost.
+ */
+void sim_set_online(bool online);
+void sim_set_boot_status(ocpp_boot_status_t status);
+
+/**
+ * @brief Schedule a function to be called at the given time.
+ *
+ * Events at the same time are called in the order scheduled, before the
+ * engine steps at that time.
+ *
+ * @return 0 for success, -ENOSPC if too many events are scheduled.
+ */
+int sim_schedule(time_t at, sim_event_func_t fn, void *ctx);
+
+/**
+ * @brief Run the simulation until the virtual clock passes @p end.
+ *
+ * @return 0 for success, -EFAULT if an invariant is broken. See
+ *         @ref sim_get_violation for the reason.
+ */
+int sim_run_until(time_t end);
+int sim_run_for(uint32_t sec);
+
+const struct sim_stats *sim_get_stats(void);
+/**
+ * @brief Get the reason of the first broken invariant.
+ *
+ * @return NULL if none is broken.
+ */
+const char *sim_get_violation(void);
+/**
+ * @brief Get a message accepted by the transport.
+ *
+ * The log keeps the latest @ref SIM_LOG_LEN messages.
+ *
+ * @param[in] index 0 for the oldest one kept
+ *
+ * @return NULL if no message at the index.
+ */
+const struct sim_record *sim_get_sent(uint32_t index);
+uint32_t sim_count_logged(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* OCPP_TESTS_SIMULATOR_H */
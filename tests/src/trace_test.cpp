@@ -0,0 +1,91 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/trace.h"
+
+#include <string.h>
+
+uint32_t ocpp_trace_get_timestamp(void) {
+	return (uint32_t)mock().actualCall(__func__).returnUnsignedIntValueOrDefault(0);
+}
+
+TEST_GROUP(Trace) {
+	uint8_t buf[sizeof(struct ocpp_trace_header) +
+		sizeof(struct ocpp_trace_record) * 8];
+	struct ocpp_trace_header hdr;
+
+	void setup(void) {
+		ocpp_trace_clear();
+		mock().ignoreOtherCalls();
+	}
+	void teardown(void) {
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	struct ocpp_trace_record get_record(int index) {
+		struct ocpp_trace_record rec;
+		memcpy(&rec, &buf[sizeof(hdr) + sizeof(rec) * (size_t)index],
+				sizeof(rec));
+		return rec;
+	}
+	size_t dump(size_t bufsize) {
+		size_t n = ocpp_trace_dump(buf, bufsize);
+		memcpy(&hdr, buf, sizeof(hdr));
+		return n;
+	}
+};
+
+TEST(Trace, dump_ShouldReturnHeaderOnly_WhenNothingWritten) {
+	LONGS_EQUAL(sizeof(hdr), dump(sizeof(buf)));
+	LONGS_EQUAL(OCPP_TRACE_MAGIC, hdr.magic);
+	LONGS_EQUAL(OCPP_TRACE_VERSION, hdr.version);
+	LONGS_EQUAL(sizeof(struct ocpp_trace_record), hdr.record_size);
+	LONGS_EQUAL(0, hdr.count);
+}
+
+TEST(Trace, dump_ShouldReturnZero_WhenBufferTooSmallForHeader) {
+	LONGS_EQUAL(0, ocpp_trace_dump(buf, sizeof(hdr) - 1));
+	LONGS_EQUAL(0, ocpp_trace_dump(NULL, sizeof(buf)));
+}
+
+TEST(Trace, write_ShouldRecordAllFields) {
+	mock().expectOneCall("ocpp_trace_get_timestamp").andReturnValue(123);
+	ocpp_trace_write(OCPP_TRACE_SEND, OCPP_MSG_HEARTBEAT, 3, 1000);
+
+	LONGS_EQUAL(sizeof(hdr) + sizeof(struct ocpp_trace_record),
+			dump(sizeof(buf)));
+	LONGS_EQUAL(1, hdr.count);
+
+	struct ocpp_trace_record rec = get_record(0);
+	LONGS_EQUAL(123, rec.timestamp);
+	LONGS_EQUAL(OCPP_TRACE_SEND, rec.event);
+	LONGS_EQUAL(OCPP_MSG_HEARTBEAT, rec.type);
+	LONGS_EQUAL(3, rec.slot);
+	LONGS_EQUAL(255, rec.attempts);
+}
+
+TEST(Trace, dump_ShouldKeepNewestRecordsInOrder_WhenWrappedAround) {
+	for (uint16_t i = 0; i < 6; i++) {
+		ocpp_trace_write(OCPP_TRACE_PUT_READY, OCPP_MSG_AUTHORIZE, i, 0);
+	}
+
+	dump(sizeof(buf));
+	LONGS_EQUAL(4, hdr.count);
+	LONGS_EQUAL(2, hdr.overwritten);
+	for (int i = 0; i < 4; i++) {
+		LONGS_EQUAL(i + 2, get_record(i).slot);
+	}
+}
+
+TEST(Trace, dump_ShouldKeepNewestRecords_WhenBufferNotEnough) {
+	for (uint16_t i = 0; i < 3; i++) {
+		ocpp_trace_write(OCPP_TRACE_PUT_WAIT, OCPP_MSG_AUTHORIZE, i, 0);
+	}
+
+	dump(sizeof(hdr) + sizeof(struct ocpp_trace_record) * 2);
+	LONGS_EQUAL(2, hdr.count);
+	LONGS_EQUAL(0, hdr.overwritten);
+	LONGS_EQUAL(1, get_record(0).slot);
+	LONGS_EQUAL(2, get_record(1).slot);
+}
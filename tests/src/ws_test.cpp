@@ -0,0 +1,380 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include "ocpp/transport/ws.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* accept key for "AAAAAAAAAAAAAAAAAAAAAA==", the key of all-zero nonce */
+#define ACCEPT_KEY		"ICX+Yqv66kxgM0FcWaLWlFLwTAI="
+
+static uint32_t random_value;
+static int locks;
+static int unlocks;
+
+void ocpp_ws_lock(struct ocpp_ws *ws) {
+	locks++;
+}
+
+void ocpp_ws_unlock(struct ocpp_ws *ws) {
+	unlocks++;
+}
+
+uint32_t ocpp_ws_get_random(void) {
+	return random_value;
+}
+
+int ocpp_get_next_deadline(time_t *deadline) {
+	return mock().actualCall(__func__)
+		.withOutputParameter("deadline", deadline)
+		.returnIntValueOrDefault(-ENOENT);
+}
+
+static int encode(const struct ocpp_message *msg,
+		char *buf, size_t bufsize, void *ctx) {
+	return snprintf(buf, bufsize, "[2,\"%s\",%d,{}]", msg->id, msg->type);
+}
+
+static int decode(const char *text, size_t len,
+		struct ocpp_message *msg, void *ctx) {
+	int role;
+	if (sscanf(text, "[%d,\"%36[^\"]\"", &role, msg->id) != 2) {
+		return -EBADMSG;
+	}
+	msg->role = role == 2? OCPP_MSG_ROLE_CALL :
+		role == 3? OCPP_MSG_ROLE_CALLRESULT : OCPP_MSG_ROLE_CALLERROR;
+	return 0;
+}
+
+TEST_GROUP(WebSocket) {
+	struct ocpp_ws ws;
+	int listener;
+	int server;
+	uint16_t port;
+
+	void setup(void) {
+		struct sockaddr_in addr = { 0, };
+		socklen_t len = sizeof(addr);
+
+		random_value = 0;
+		locks = unlocks = 0;
+		server = -1;
+		mock().ignoreOtherCalls();
+
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		LONGS_EQUAL(0, bind(listener, (struct sockaddr *)&addr, sizeof(addr)));
+		LONGS_EQUAL(0, listen(listener, 1));
+		getsockname(listener, (struct sockaddr *)&addr, &len);
+		port = ntohs(addr.sin_port);
+
+		const struct ocpp_ws_param param = {
+			.host = "127.0.0.1",
+			.port = port,
+			.path = "/ocpp/CP001",
+			.authorization = "Basic Q1AwMDE6cGFzcw==",
+		};
+		const struct ocpp_ws_codec codec = {
+			.encode = encode,
+			.decode = decode,
+		};
+		LONGS_EQUAL(0, ocpp_ws_init(&ws, &param, &codec, NULL));
+	}
+	void teardown(void) {
+		ocpp_ws_close(&ws);
+		if (server >= 0) {
+			close(server);
+		}
+		close(listener);
+		mock().checkExpectations();
+		mock().clear();
+	}
+
+	void pump(ocpp_ws_state_t until) {
+		for (int i = 0; i < 100 && ocpp_ws_get_state(&ws) != until; i++) {
+			if (ocpp_ws_poll(&ws, 10) != 0) {
+				break;
+			}
+		}
+	}
+	void wait_readable(void) {
+		struct pollfd pfd = { .fd = ocpp_ws_get_fd(&ws), .events = POLLIN, };
+		poll(&pfd, 1, 1000);
+	}
+	void connect_client(void) {
+		LONGS_EQUAL(0, ocpp_ws_connect(&ws));
+		server = accept(listener, NULL, NULL);
+		CHECK(server >= 0);
+		pump(OCPP_WS_STATE_HANDSHAKE);
+		LONGS_EQUAL(OCPP_WS_STATE_HANDSHAKE, ocpp_ws_get_state(&ws));
+	}
+	void read_request(char *buf, size_t bufsize) {
+		size_t len = 0;
+		buf[0] = '\0';
+		while (len < bufsize - 1 && strstr(buf, "\r\n\r\n") == NULL) {
+			ssize_t n = recv(server, &buf[len], 1, 0);
+			if (n <= 0) {
+				break;
+			}
+			len += (size_t)n;
+			buf[len] = '\0';
+		}
+	}
+	void respond(const char *accept) {
+		char buf[256];
+		int len = snprintf(buf, sizeof(buf),
+				"HTTP/1.1 101 Switching Protocols\r\n"
+				"Upgrade: websocket\r\n"
+				"Connection: Upgrade\r\n"
+				"sec-websocket-accept: %s\r\n"
+				"Sec-WebSocket-Protocol: ocpp1.6\r\n\r\n", accept);
+		send(server, buf, (size_t)len, 0);
+	}
+	void open(void) {
+		char req[512];
+		connect_client();
+		read_request(req, sizeof(req));
+		respond(ACCEPT_KEY);
+		pump(OCPP_WS_STATE_OPEN);
+		CHECK(ocpp_ws_is_connected(&ws));
+	}
+	void server_send(uint8_t opcode, const void *payload, size_t len) {
+		uint8_t buf[256] = { (uint8_t)(0x80 | opcode), (uint8_t)len, };
+		memcpy(&buf[2], payload, len);
+		send(server, buf, len + 2, 0);
+	}
+	size_t server_recv(uint8_t *opcode, uint8_t *payload) {
+		uint8_t hdr[2];
+		uint8_t mask[4];
+		recv(server, hdr, sizeof(hdr), MSG_WAITALL);
+		*opcode = hdr[0];
+		CHECK(hdr[1] & 0x80);
+		const size_t len = hdr[1] & 0x7f;
+		recv(server, mask, sizeof(mask), MSG_WAITALL);
+		if (len) {
+			recv(server, payload, len, MSG_WAITALL);
+		}
+		for (size_t i = 0; i < len; i++) {
+			payload[i] ^= mask[i & 3];
+		}
+		return len;
+	}
+};
+
+TEST(WebSocket, connect_ShouldSendUpgradeRequest) {
+	char req[512];
+
+	connect_client();
+	read_request(req, sizeof(req));
+
+	CHECK(strstr(req, "GET /ocpp/CP001 HTTP/1.1\r\n") == req);
+	CHECK(strstr(req, "\r\nUpgrade: websocket\r\n"));
+	CHECK(strstr(req, "\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n"));
+	CHECK(strstr(req, "\r\nSec-WebSocket-Version: 13\r\n"));
+	CHECK(strstr(req, "\r\nSec-WebSocket-Protocol: ocpp1.6\r\n"));
+	CHECK(strstr(req, "\r\nAuthorization: Basic Q1AwMDE6cGFzcw==\r\n"));
+}
+
+TEST(WebSocket, ShouldBeOpen_WhenHandshakeAccepted) {
+	open();
+	LONGS_EQUAL(POLLIN, ocpp_ws_get_events(&ws));
+}
+
+TEST(WebSocket, ShouldClose_WhenAcceptKeyMismatches) {
+	char req[512];
+
+	connect_client();
+	read_request(req, sizeof(req));
+	respond("dGhlIHNhbXBsZSBub25jZQ==");
+	wait_readable();
+
+	LONGS_EQUAL(-EPROTO, ocpp_ws_process(&ws, POLLIN));
+	LONGS_EQUAL(OCPP_WS_STATE_CLOSED, ocpp_ws_get_state(&ws));
+}
+
+TEST(WebSocket, send_ShouldReturnENOTCONN_WhenNotOpen) {
+	struct ocpp_message msg = { .id = "1", };
+	LONGS_EQUAL(-ENOTCONN, ocpp_ws_send(&ws, &msg));
+}
+
+TEST(WebSocket, ShouldLockInstance_WhenCalled) {
+	struct ocpp_message msg = { .id = "1", };
+
+	LONGS_EQUAL(-ENOTCONN, ocpp_ws_send(&ws, &msg));
+	LONGS_EQUAL(-ENOTCONN, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(-ENOTCONN, ocpp_ws_process(&ws, 0));
+
+	LONGS_EQUAL(3, locks);
+	LONGS_EQUAL(3, unlocks);
+}
+
+TEST(WebSocket, send_ShouldWriteMaskedTextFrame) {
+	struct ocpp_message msg = {
+		.id = "123",
+		.role = OCPP_MSG_ROLE_CALL,
+		.type = OCPP_MSG_HEARTBEAT,
+	};
+	char expected[64];
+	uint8_t payload[128];
+	uint8_t opcode;
+
+	open();
+	random_value = 0x5a6b7c8d;
+
+	LONGS_EQUAL(0, ocpp_ws_send(&ws, &msg));
+
+	const size_t len = server_recv(&opcode, payload);
+	LONGS_EQUAL(0x81, opcode);
+	LONGS_EQUAL(encode(&msg, expected, sizeof(expected), NULL), len);
+	MEMCMP_EQUAL(expected, payload, len);
+}
+
+TEST(WebSocket, recv_ShouldDecodeTextFrame) {
+	const char text[] = "[3,\"42\",{}]";
+	struct ocpp_message msg = { 0, };
+
+	open();
+	LONGS_EQUAL(-ENOMSG, ocpp_ws_recv(&ws, &msg));
+
+	server_send(0x1, text, strlen(text));
+	wait_readable();
+
+	LONGS_EQUAL(0, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(OCPP_MSG_ROLE_CALLRESULT, msg.role);
+	STRCMP_EQUAL("42", msg.id);
+	LONGS_EQUAL(-ENOMSG, ocpp_ws_recv(&ws, &msg));
+}
+
+TEST(WebSocket, recv_ShouldWaitForTheRest_WhenFrameIsPartial) {
+	const char text[] = "[2,\"7\",\"Reset\",{}]";
+	uint8_t frame[64] = { 0x81, (uint8_t)strlen(text), };
+	struct ocpp_message msg = { 0, };
+
+	open();
+	memcpy(&frame[2], text, strlen(text));
+
+	send(server, frame, 5, 0);
+	wait_readable();
+	LONGS_EQUAL(-ENOMSG, ocpp_ws_recv(&ws, &msg));
+
+	send(server, &frame[5], strlen(text) + 2 - 5, 0);
+	wait_readable();
+	LONGS_EQUAL(0, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(OCPP_MSG_ROLE_CALL, msg.role);
+	STRCMP_EQUAL("7", msg.id);
+}
+
+TEST(WebSocket, recv_ShouldPutFragmentsTogether_WhenMessageFragmented) {
+	/* the first fragment followed by a ping in between */
+	const uint8_t first[] = { 0x01, 5, '[', '3', ',', '"', '4', 0x89, 0, };
+	const uint8_t last[] = { 0x80, 6, '2', '"', ',', '{', '}', ']', };
+	struct ocpp_message msg = { 0, };
+	uint8_t payload[16];
+	uint8_t opcode;
+
+	open();
+	send(server, first, sizeof(first), 0);
+	wait_readable();
+	LONGS_EQUAL(-ENOMSG, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(0, server_recv(&opcode, payload));
+	LONGS_EQUAL(0x8a, opcode);
+
+	send(server, last, sizeof(last), 0);
+	wait_readable();
+	LONGS_EQUAL(0, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(OCPP_MSG_ROLE_CALLRESULT, msg.role);
+	STRCMP_EQUAL("42", msg.id);
+	LONGS_EQUAL(-ENOMSG, ocpp_ws_recv(&ws, &msg));
+	CHECK(ocpp_ws_is_connected(&ws));
+}
+
+TEST(WebSocket, recv_ShouldFailWithProtocolError_WhenContinuationWithoutStart) {
+	struct ocpp_message msg = { 0, };
+	uint8_t payload[16];
+	uint8_t opcode;
+
+	open();
+	server_send(0x0, "x", 1);
+	wait_readable();
+
+	LONGS_EQUAL(-EPROTO, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(2, server_recv(&opcode, payload));
+	LONGS_EQUAL(0x88, opcode);
+	LONGS_EQUAL(0x03, payload[0]);
+	LONGS_EQUAL(0xea, payload[1]);
+}
+
+TEST(WebSocket, recv_ShouldAnswerPingWithPong) {
+	struct ocpp_message msg;
+	uint8_t payload[16];
+	uint8_t opcode;
+
+	open();
+	server_send(0x9, "hi", 2);
+	wait_readable();
+
+	LONGS_EQUAL(-ENOMSG, ocpp_ws_recv(&ws, &msg));
+
+	LONGS_EQUAL(2, server_recv(&opcode, payload));
+	LONGS_EQUAL(0x8a, opcode);
+	MEMCMP_EQUAL("hi", payload, 2);
+}
+
+TEST(WebSocket, recv_ShouldReturnECONNRESET_WhenServerClosed) {
+	const uint8_t code[2] = { 0x03, 0xe8 };
+	struct ocpp_message msg;
+	uint8_t payload[16];
+	uint8_t opcode;
+
+	open();
+	server_send(0x8, code, sizeof(code));
+	wait_readable();
+
+	LONGS_EQUAL(-ECONNRESET, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(OCPP_WS_STATE_CLOSED, ocpp_ws_get_state(&ws));
+	LONGS_EQUAL(2, server_recv(&opcode, payload));
+	LONGS_EQUAL(0x88, opcode);
+	MEMCMP_EQUAL(code, payload, 2);
+}
+
+TEST(WebSocket, recv_ShouldDecodeFramesBuffered_WhenServerClosedRightAfter) {
+	const char text[] = "[3,\"42\",{}]";
+	struct ocpp_message msg = { 0, };
+
+	open();
+	server_send(0x1, text, strlen(text));
+	close(server);
+	server = -1;
+	wait_readable();
+
+	LONGS_EQUAL(0, ocpp_ws_process(&ws, POLLIN));
+	LONGS_EQUAL(0, ocpp_ws_recv(&ws, &msg));
+	STRCMP_EQUAL("42", msg.id);
+	LONGS_EQUAL(-ECONNRESET, ocpp_ws_recv(&ws, &msg));
+	LONGS_EQUAL(OCPP_WS_STATE_CLOSED, ocpp_ws_get_state(&ws));
+}
+
+TEST(WebSocket, poll_ShouldReturnByNextDeadline) {
+	time_t deadline = time(NULL);
+	struct timespec t0, t1;
+
+	open();
+	mock().expectOneCall("ocpp_get_next_deadline")
+		.withOutputParameterReturning("deadline", &deadline, sizeof(deadline))
+		.andReturnValue(0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	LONGS_EQUAL(0, ocpp_ws_poll(&ws, 5000));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	CHECK(t1.tv_sec - t0.tv_sec < 2);
+}
@@ -0,0 +1,235 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "csms.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t get_random(struct csms *csms)
+{
+	/* xorshift32 to be reproducible across platforms */
+	uint32_t x = csms->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	csms->rng = x;
+	return x;
+}
+
+static bool roll(struct csms *csms, uint32_t permille)
+{
+	return permille && get_random(csms) % 1000 < permille;
+}
+
+static void set_param(struct csms *csms, const char *key, uint32_t value)
+{
+	if (strcmp(key, "latency") == 0) {
+		csms->params.latency_ms = value;
+	} else if (strcmp(key, "jitter") == 0) {
+		csms->params.jitter_ms = value;
+	} else if (strcmp(key, "error") == 0) {
+		csms->params.error_permille = value;
+	} else if (strcmp(key, "drop") == 0) {
+		csms->params.drop_permille = value;
+	} else if (strcmp(key, "pending") == 0) {
+		csms->params.boot_pending = value;
+	}
+}
+
+static void run_script(struct csms *csms, uint64_t now_ms)
+{
+	while (csms->script_next < csms->script_len &&
+			(uint64_t)csms->script[csms->script_next].at_sec * 1000
+			<= now_ms) {
+		set_param(csms, csms->script[csms->script_next].key,
+				csms->script[csms->script_next].value);
+		csms->script_next++;
+	}
+}
+
+static struct csms_pending *alloc_pending(struct csms *csms)
+{
+	for (int i = 0; i < CSMS_PENDING_MAX; i++) {
+		if (!csms->pending[i].used) {
+			memset(&csms->pending[i], 0, sizeof(csms->pending[i]));
+			csms->pending[i].used = true;
+			return &csms->pending[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void make_conf(struct csms *csms, struct csms_pending *p,
+		uint64_t now_ms)
+{
+	const time_t now = (time_t)(now_ms / 1000);
+
+	switch (p->type) {
+	case OCPP_MSG_BOOTNOTIFICATION:
+		p->conf.bootnotification.currentTime = now;
+		p->conf.bootnotification.interval =
+			csms->params.heartbeat_interval;
+		p->conf.bootnotification.status = OCPP_BOOT_STATUS_ACCEPTED;
+		if (csms->boot_count++ < csms->params.boot_pending) {
+			p->conf.bootnotification.status =
+				OCPP_BOOT_STATUS_PENDING;
+		}
+		break;
+	case OCPP_MSG_HEARTBEAT:
+		p->conf.heartbeat.currentTime = now;
+		break;
+	case OCPP_MSG_AUTHORIZE:
+		p->conf.authorize.idTagInfo.status = OCPP_AUTH_STATUS_ACCEPTED;
+		break;
+	case OCPP_MSG_START_TRANSACTION:
+		p->conf.start_transaction.idTagInfo.status =
+			OCPP_AUTH_STATUS_ACCEPTED;
+		p->conf.start_transaction.transactionId =
+			++csms->transaction_id;
+		break;
+	case OCPP_MSG_STOP_TRANSACTION:
+		p->conf.stop_transaction.idTagInfo.status =
+			OCPP_AUTH_STATUS_ACCEPTED;
+		break;
+	case OCPP_MSG_DATA_TRANSFER:
+		p->conf.datatransfer.status = OCPP_DATA_STATUS_ACCEPTED;
+		break;
+	default: /* zeroed conf for the rest */
+		break;
+	}
+}
+
+void csms_init(struct csms *csms, const struct csms_params *params,
+		uint32_t seed)
+{
+	memset(csms, 0, sizeof(*csms));
+	csms->params = *params;
+	csms->rng = seed? seed : 0x2545f491u;
+}
+
+int csms_load_script(struct csms *csms, const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	char line[128];
+
+	if (fp == NULL) {
+		return -errno;
+	}
+
+	csms->script_len = 0;
+	csms->script_next = 0;
+
+	while (fgets(line, sizeof(line), fp) &&
+			csms->script_len < CSMS_SCRIPT_MAX) {
+		unsigned int at;
+		unsigned int value;
+		char key[sizeof(csms->script[0].key)];
+
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		if (sscanf(line, "%u %15s %u", &at, key, &value) != 3) {
+			fclose(fp);
+			return -EINVAL;
+		}
+
+		csms->script[csms->script_len].at_sec = at;
+		strcpy(csms->script[csms->script_len].key, key);
+		csms->script[csms->script_len].value = value;
+		csms->script_len++;
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+void csms_receive(struct csms *csms, const struct ocpp_message *msg,
+		uint64_t now_ms)
+{
+	run_script(csms, now_ms);
+
+	if (msg->role != OCPP_MSG_ROLE_CALL) {
+		return; /* responses to the central system's own requests */
+	}
+
+	csms->stats.received++;
+
+	if (roll(csms, csms->params.drop_permille)) {
+		csms->stats.dropped++;
+		return;
+	}
+
+	struct csms_pending *p = alloc_pending(csms);
+
+	if (p == NULL) {
+		csms->stats.overflowed++;
+		return;
+	}
+
+	uint32_t delay = csms->params.latency_ms;
+	if (csms->params.jitter_ms) {
+		delay += get_random(csms) % (csms->params.jitter_ms + 1);
+	}
+
+	p->due_ms = now_ms + delay;
+	p->type = msg->type;
+	p->request = msg->payload.fmt.request;
+	memcpy(p->id, msg->id, sizeof(p->id));
+
+	if (roll(csms, csms->params.error_permille)) {
+		p->role = OCPP_MSG_ROLE_CALLERROR;
+	} else {
+		p->role = OCPP_MSG_ROLE_CALLRESULT;
+		make_conf(csms, p, now_ms);
+	}
+}
+
+int csms_deliver(struct csms *csms, struct ocpp_message *msg,
+		const void **request, uint64_t now_ms)
+{
+	struct csms_pending *next = NULL;
+
+	run_script(csms, now_ms);
+
+	for (int i = 0; i < CSMS_PENDING_MAX; i++) {
+		struct csms_pending *p = &csms->pending[i];
+		if (p->used && p->due_ms <= now_ms &&
+				(next == NULL || p->due_ms < next->due_ms)) {
+			next = p;
+		}
+	}
+
+	if (next == NULL) {
+		return -ENOMSG;
+	}
+
+	csms->delivered = next->conf;
+
+	memset(msg, 0, sizeof(*msg));
+	memcpy(msg->id, next->id, sizeof(msg->id));
+	msg->role = next->role;
+	msg->type = next->type;
+	msg->payload.fmt.response = &csms->delivered;
+	msg->payload.size = sizeof(csms->delivered);
+
+	if (request) {
+		*request = next->request;
+	}
+
+	if (next->role == OCPP_MSG_ROLE_CALLERROR) {
+		csms->stats.errored++;
+	} else {
+		csms->stats.answered++;
+	}
+
+	next->used = false;
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef OCPP_TOOLS_CSMS_H
+#define OCPP_TOOLS_CSMS_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "ocpp/ocpp.h"
+
+#include <stdint.h>
+
+#if !defined(CSMS_PENDING_MAX)
+#define CSMS_PENDING_MAX			16
+#endif
+#if !defined(CSMS_SCRIPT_MAX)
+#define CSMS_SCRIPT_MAX				64
+#endif
+
+/* How the central system behaves. Rates are in permille. */
+struct csms_params {
+	uint32_t latency_ms;
+	uint32_t jitter_ms;
+	uint32_t error_permille;	/**< answered with CALLERROR */
+	uint32_t drop_permille;		/**< never answered */
+	uint32_t boot_pending;		/**< BootNotifications to be Pending */
+	int heartbeat_interval;		/**< for BootNotification.conf */
+};
+
+union csms_conf {
+	struct ocpp_Authorize_conf authorize;
+	struct ocpp_BootNotification_conf bootnotification;
+	struct ocpp_DataTransfer_conf datatransfer;
+	struct ocpp_Heartbeat_conf heartbeat;
+	struct ocpp_MeterValues_conf metervalues;
+	struct ocpp_StartTransaction_conf start_transaction;
+	struct ocpp_StatusNotification_conf status_notification;
+	struct ocpp_StopTransaction_conf stop_transaction;
+	uint8_t raw[64];
+};
+
+struct csms_pending {
+	uint64_t due_ms;
+	char id[OCPP_MESSAGE_ID_MAXLEN];
+	ocpp_message_role_t role;
+	ocpp_message_t type;
+	const void *request; /**< payload of the request being answered */
+	union csms_conf conf;
+	bool used;
+};
+
+struct csms_stats {
+	uint32_t received;
+	uint32_t answered;
+	uint32_t errored;
+	uint32_t dropped;
+	uint32_t overflowed; /**< requests lost as too many were pending */
+};
+
+struct csms {
+	struct csms_params params;
+
+	struct {
+		uint32_t at_sec;
+		char key[16];
+		uint32_t value;
+	} script[CSMS_SCRIPT_MAX];
+	int script_len;
+	int script_next;
+
+	struct csms_pending pending[CSMS_PENDING_MAX];
+	union csms_conf delivered; /**< valid until the next delivery */
+
+	uint32_t rng;
+	uint32_t boot_count;
+	int transaction_id;
+
+	struct csms_stats stats;
+};
+
+void csms_init(struct csms *csms, const struct csms_params *params,
+		uint32_t seed);
+/**
+ * @brief Load a script of parameter changes over time.
+ *
+ * Each line is `<second> <key> <value>` where the key is one of `latency`,
+ * `jitter`, `error`, `drop` and `pending`, matching @ref csms_params. Blank
+ * lines and lines starting with `#` are ignored. Entries should be in time
+ * order.
+ *
+ * @return 0 for success, otherwise an error.
+ */
+int csms_load_script(struct csms *csms, const char *path);
+/**
+ * @brief Pass a message from the charge point to the central system.
+ *
+ * @param[in] now_ms milliseconds elapsed since the start of the simulation
+ */
+void csms_receive(struct csms *csms, const struct ocpp_message *msg,
+		uint64_t now_ms);
+/**
+ * @brief Take the next message that is due from the central system.
+ *
+ * @param[out] msg the message. Its payload stays valid until the next call.
+ * @param[out] request payload of the request being answered. NULL if not
+ *             needed
+ * @param[in] now_ms milliseconds elapsed since the start of the simulation
+ *
+ * @return 0 when a message is taken, -ENOMSG when nothing is due.
+ */
+int csms_deliver(struct csms *csms, struct ocpp_message *msg,
+		const void **request, uint64_t now_ms);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* OCPP_TOOLS_CSMS_H */
@@ -0,0 +1,500 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Fleet load generator running simulated charge points against the local
+ * central system in csms.c.
+ *
+ * The engine keeps its state in a single instance, so each charge point runs
+ * in its own process with its own central system. Every charge point boots,
+ * retries while BootNotification is Pending, then pushes MeterValues,
+ * StatusNotification and DataTransfer at the given rate. Latency is measured
+ * from the push to the delivery of the response, in milliseconds.
+ *
+ * Usage: ocpp_fleet [-n charge points] [-t seconds] [-r requests/sec]
+ *                   [-l latency ms] [-j jitter ms] [-e error permille]
+ *                   [-d drop permille] [-p pending boots] [-s script]
+ *                   [-c capture file prefix] [-o output file to append]
+ *
+ * The summary is printed in text and appended in JSON to the output file if
+ * given. With `-c`, the traffic of each charge point is captured into
+ * `<prefix>.<index>` to be fed to ocpp_replay.
+ */
+
+#include "csms.h"
+#include "ocpp/capture.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !defined(OCPP_TX_POOL_LEN)
+#define OCPP_TX_POOL_LEN			8
+#endif
+
+#define LATENCY_BUCKETS				10001 /* 1ms each, the last overflows */
+#define MAX_INFLIGHT				(OCPP_TX_POOL_LEN * 2)
+#define STEP_INTERVAL_US			500
+
+struct request {
+	union {
+		struct ocpp_BootNotification bootnotification;
+		struct ocpp_DataTransfer datatransfer;
+		struct ocpp_MeterValues metervalues;
+		struct ocpp_StatusNotification status_notification;
+	} payload;
+	uint64_t pushed_ms;
+	bool answered;
+	bool used;
+};
+
+struct result {
+	uint32_t pushed;
+	uint32_t completed;
+	uint32_t errored;
+	uint32_t dropped;	/**< freed without any response */
+	uint32_t rejected;	/**< failed to push as the queue was full */
+	uint32_t latency[LATENCY_BUCKETS];
+};
+
+struct options {
+	int charge_points;
+	int duration_sec;
+	int rate;
+	const char *script;
+	const char *capture;
+	const char *output;
+	struct csms_params params;
+};
+
+static struct {
+	struct csms csms;
+	struct request requests[MAX_INFLIGHT];
+	struct result result;
+	uint64_t start_ms;
+	unsigned long msgid;
+	bool booted;
+} m;
+
+static int write_capture(const void *data, size_t datasize, void *ctx)
+{
+	return fwrite(data, datasize, 1, (FILE *)ctx) == 1? 0 : -EIO;
+}
+
+static uint64_t get_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static uint64_t get_elapsed_ms(void)
+{
+	return get_ms() - m.start_ms;
+}
+
+int ocpp_send(const struct ocpp_message *msg)
+{
+	csms_receive(&m.csms, msg, get_elapsed_ms());
+	return 0;
+}
+
+int ocpp_recv(struct ocpp_message *msg)
+{
+	const void *req;
+	int err = csms_deliver(&m.csms, msg, &req, get_elapsed_ms());
+
+	if (err == 0 && req) {
+		struct request *p = (struct request *)(uintptr_t)req;
+		uint64_t latency = get_elapsed_ms() - p->pushed_ms;
+
+		p->answered = true;
+		m.result.latency[latency < LATENCY_BUCKETS - 1?
+				latency : LATENCY_BUCKETS - 1]++;
+
+		if (msg->role == OCPP_MSG_ROLE_CALLERROR) {
+			m.result.errored++;
+		} else {
+			m.result.completed++;
+		}
+	}
+
+	return err;
+}
+
+int ocpp_lock(void)
+{
+	return 0;
+}
+
+int ocpp_unlock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_lock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_unlock(void)
+{
+	return 0;
+}
+
+void ocpp_generate_message_id(void *buf, size_t bufsize)
+{
+	snprintf((char *)buf, bufsize, "%lu", ++m.msgid);
+}
+
+static struct request *alloc_request(void)
+{
+	for (int i = 0; i < MAX_INFLIGHT; i++) {
+		if (!m.requests[i].used) {
+			memset(&m.requests[i], 0, sizeof(m.requests[i]));
+			m.requests[i].used = true;
+			m.requests[i].pushed_ms = get_elapsed_ms();
+			return &m.requests[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int push(ocpp_message_t type, uint32_t defer_sec)
+{
+	struct request *req = alloc_request();
+	int err;
+
+	if (req == NULL) {
+		m.result.rejected++;
+		return -ENOMEM;
+	}
+
+	if (defer_sec) {
+		err = ocpp_push_request_defer(type, req, sizeof(req->payload),
+				defer_sec);
+	} else {
+		err = ocpp_push_request(type, req, sizeof(req->payload), false);
+	}
+
+	if (err) {
+		req->used = false;
+		m.result.rejected++;
+	} else {
+		m.result.pushed++;
+	}
+
+	return err;
+}
+
+static void on_ocpp_event(ocpp_event_t event_type,
+		const struct ocpp_message *msg, void *ctx)
+{
+	(void)ctx;
+
+	if (event_type == OCPP_EVENT_MESSAGE_INCOMING &&
+			msg->type == OCPP_MSG_BOOTNOTIFICATION &&
+			msg->role == OCPP_MSG_ROLE_CALLRESULT) {
+		const struct ocpp_BootNotification_conf *conf =
+			(const struct ocpp_BootNotification_conf *)
+			msg->payload.fmt.response;
+
+		if (conf->status == OCPP_BOOT_STATUS_ACCEPTED) {
+			m.booted = true;
+		} else {
+			push(OCPP_MSG_BOOTNOTIFICATION, 1);
+		}
+	} else if (event_type == OCPP_EVENT_MESSAGE_FREE &&
+			msg->role == OCPP_MSG_ROLE_CALL) {
+		struct request *req = (struct request *)(uintptr_t)
+			msg->payload.fmt.request;
+
+		if (req == NULL) {
+			return; /* heartbeats carry no payload */
+		}
+		if (!req->answered) {
+			m.result.dropped++;
+		}
+
+		req->used = false;
+	}
+}
+
+static void run_charge_point(const struct options *opt, int index, int fd)
+{
+	const ocpp_message_t workload[] = {
+		OCPP_MSG_METER_VALUES,
+		OCPP_MSG_STATUS_NOTIFICATION,
+		OCPP_MSG_DATA_TRANSFER,
+	};
+	const uint64_t interval_us = opt->rate > 0?
+		1000000u / (uint64_t)opt->rate : 0;
+	uint64_t next_us = 0;
+	unsigned int n = 0;
+
+	m.start_ms = get_ms();
+	csms_init(&m.csms, &opt->params, (uint32_t)index + 1);
+	if (opt->script && csms_load_script(&m.csms, opt->script) != 0) {
+		fprintf(stderr, "cannot load script %s\n", opt->script);
+		exit(EXIT_FAILURE);
+	}
+
+	FILE *capture = NULL;
+	if (opt->capture) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s.%d", opt->capture, index);
+		if ((capture = fopen(path, "wb")) == NULL ||
+				ocpp_capture_start(write_capture, capture)) {
+			fprintf(stderr, "cannot capture into %s\n", path);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	ocpp_init(on_ocpp_event, NULL);
+	push(OCPP_MSG_BOOTNOTIFICATION, 0);
+
+	for (uint64_t now = 0; now < (uint64_t)opt->duration_sec * 1000;
+			now = get_elapsed_ms()) {
+		if (m.booted && interval_us && now * 1000 >= next_us) {
+			push(workload[n++ %
+				(sizeof(workload) / sizeof(*workload))], 0);
+			next_us += interval_us;
+		}
+
+		ocpp_step();
+		usleep(STEP_INTERVAL_US);
+	}
+
+	if (capture) {
+		ocpp_capture_stop();
+		fclose(capture);
+	}
+
+	if (write(fd, &m.result, sizeof(m.result)) != sizeof(m.result)) {
+		exit(EXIT_FAILURE);
+	}
+
+	exit(EXIT_SUCCESS);
+}
+
+static int read_result(int fd, struct result *result)
+{
+	uint8_t *p = (uint8_t *)result;
+	size_t len = 0;
+
+	while (len < sizeof(*result)) {
+		ssize_t n = read(fd, &p[len], sizeof(*result) - len);
+		if (n <= 0) {
+			return -EIO;
+		}
+		len += (size_t)n;
+	}
+
+	return 0;
+}
+
+static void accumulate(struct result *total, const struct result *result)
+{
+	total->pushed += result->pushed;
+	total->completed += result->completed;
+	total->errored += result->errored;
+	total->dropped += result->dropped;
+	total->rejected += result->rejected;
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		total->latency[i] += result->latency[i];
+	}
+}
+
+static uint32_t get_percentile(const struct result *result, uint32_t permille)
+{
+	uint64_t total = 0;
+	uint64_t sum = 0;
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		total += result->latency[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	const uint64_t target = (total * permille + 999) / 1000;
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		sum += result->latency[i];
+		if (sum >= target) {
+			return (uint32_t)i;
+		}
+	}
+
+	return LATENCY_BUCKETS - 1;
+}
+
+static void report(const struct options *opt, const struct result *total,
+		FILE *out)
+{
+	const double rps = (double)(total->completed + total->errored) /
+		opt->duration_sec;
+	const uint32_t p50 = get_percentile(total, 500);
+	const uint32_t p90 = get_percentile(total, 900);
+	const uint32_t p99 = get_percentile(total, 990);
+	const uint32_t p999 = get_percentile(total, 999);
+	const uint32_t max = get_percentile(total, 1000);
+
+	printf("charge points: %d, duration: %ds\n",
+			opt->charge_points, opt->duration_sec);
+	printf("pushed %u, completed %u, errored %u, dropped %u, "
+			"rejected %u\n", total->pushed, total->completed,
+			total->errored, total->dropped, total->rejected);
+	printf("throughput: %.1f responses/s\n", rps);
+	printf("latency ms: p50 %u, p90 %u, p99 %u, p99.9 %u, max %u\n",
+			p50, p90, p99, p999, max);
+
+	if (out) {
+		fprintf(out, "{\"charge_points\":%d,\"duration_s\":%d,"
+				"\"pushed\":%u,\"completed\":%u,"
+				"\"errored\":%u,\"dropped\":%u,"
+				"\"rejected\":%u,\"throughput_rps\":%.1f,"
+				"\"p50_ms\":%u,\"p90_ms\":%u,\"p99_ms\":%u,"
+				"\"p999_ms\":%u,\"max_ms\":%u}\n",
+				opt->charge_points, opt->duration_sec,
+				total->pushed, total->completed,
+				total->errored, total->dropped,
+				total->rejected, rps,
+				p50, p90, p99, p999, max);
+	}
+}
+
+static void parse_options(int argc, char *argv[], struct options *opt)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:t:r:l:j:e:d:p:s:c:o:")) != -1) {
+		switch (c) {
+		case 'n':
+			opt->charge_points = atoi(optarg);
+			break;
+		case 't':
+			opt->duration_sec = atoi(optarg);
+			break;
+		case 'r':
+			opt->rate = atoi(optarg);
+			break;
+		case 'l':
+			opt->params.latency_ms = (uint32_t)atoi(optarg);
+			break;
+		case 'j':
+			opt->params.jitter_ms = (uint32_t)atoi(optarg);
+			break;
+		case 'e':
+			opt->params.error_permille = (uint32_t)atoi(optarg);
+			break;
+		case 'd':
+			opt->params.drop_permille = (uint32_t)atoi(optarg);
+			break;
+		case 'p':
+			opt->params.boot_pending = (uint32_t)atoi(optarg);
+			break;
+		case 's':
+			opt->script = optarg;
+			break;
+		case 'c':
+			opt->capture = optarg;
+			break;
+		case 'o':
+			opt->output = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n charge points] "
+					"[-t seconds] [-r requests/sec] "
+					"[-l latency ms] [-j jitter ms] "
+					"[-e error permille] [-d drop permille] "
+					"[-p pending boots] [-s script] "
+					"[-c capture] [-o output]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (opt->charge_points <= 0 || opt->duration_sec <= 0) {
+		fprintf(stderr, "charge points and duration must be positive\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct options opt = {
+		.charge_points = 10,
+		.duration_sec = 10,
+		.rate = 10,
+		.params = {
+			.latency_ms = 50,
+			.heartbeat_interval = 60,
+		},
+	};
+	static struct result total;
+	static struct result result;
+	int rc = EXIT_SUCCESS;
+
+	parse_options(argc, argv, &opt);
+
+	/* a pipe per charge point as a result is larger than PIPE_BUF */
+	int *fds = (int *)calloc((size_t)opt.charge_points, sizeof(*fds));
+	if (fds == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < opt.charge_points; i++) {
+		int p[2];
+
+		if (pipe(p) != 0) {
+			perror("pipe");
+			return EXIT_FAILURE;
+		}
+
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return EXIT_FAILURE;
+		} else if (pid == 0) {
+			close(p[0]);
+			run_charge_point(&opt, i, p[1]);
+		}
+
+		close(p[1]);
+		fds[i] = p[0];
+	}
+
+	for (int i = 0; i < opt.charge_points; i++) {
+		if (read_result(fds[i], &result) != 0) {
+			fprintf(stderr, "lost the result of charge point %d\n",
+					i);
+			rc = EXIT_FAILURE;
+		} else {
+			accumulate(&total, &result);
+		}
+		close(fds[i]);
+	}
+
+	free(fds);
+
+	while (wait(NULL) > 0) {
+		/* reap all */
+	}
+
+	FILE *out = opt.output? fopen(opt.output, "a") : NULL;
+	report(&opt, &total, out);
+	if (out) {
+		fclose(out);
+	}
+
+	return rc;
+}
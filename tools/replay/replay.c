@@ -0,0 +1,490 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Replays a capture of `ocpp_capture_start()` through the engine.
+ *
+ * Pushes, configuration changes and steps are called in the captured order,
+ * `time()` gives the captured time and `ocpp_send()`/`ocpp_recv()` give the
+ * captured results. Message ids are generated anew, so responses are mapped
+ * to the ids the engine sent. Anything the engine does differently from the
+ * capture is counted as a divergence.
+ *
+ * Usage: ocpp_replay [-p] [-v] <capture file>
+ *
+ *   -p  keep the original pacing instead of running at full speed
+ *   -v  print every divergence
+ */
+
+#include "ocpp/ocpp.h"
+#include "ocpp/capture.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ID_MAP_LEN				64
+#define MAX_PAYLOAD_SIZE			UINT16_MAX
+
+struct record {
+	struct ocpp_capture_record hdr;
+	const char *id;
+	const void *payload;
+};
+
+struct id_map {
+	char captured[OCPP_MESSAGE_ID_MAXLEN];
+	char replayed[OCPP_MESSAGE_ID_MAXLEN];
+};
+
+static struct {
+	uint8_t *buf;
+	size_t len;
+	size_t pos;
+
+	time_t now;
+	unsigned long msgid;
+	struct id_map ids[ID_MAP_LEN];
+	uint32_t ids_next;
+	void *payload; /* the latest payload given by ocpp_recv() */
+
+	bool pacing;
+	bool verbose;
+	uint64_t started_ns;
+	uint64_t elapsed_us; /* since the first record, in capture time */
+	uint32_t last_timestamp;
+	bool has_timestamp;
+
+	struct {
+		uint32_t records;
+		uint32_t steps;
+		uint32_t pushes;
+		uint32_t sends;
+		uint32_t recvs;
+		uint32_t divergences;
+		uint64_t step_ns_total;
+		uint64_t step_ns_max;
+	} stats;
+} m;
+
+static uint64_t get_ns(clockid_t clk)
+{
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void diverge(const char *what, const struct record *rec)
+{
+	m.stats.divergences++;
+
+	if (m.verbose) {
+		fprintf(stderr, "divergence at %zu: %s (%s)\n", m.pos, what,
+				rec? ocpp_stringify_type(rec->hdr.type) : "-");
+	}
+}
+
+static bool peek(struct record *rec)
+{
+	if (m.pos + sizeof(rec->hdr) > m.len) {
+		return false;
+	}
+
+	memcpy(&rec->hdr, &m.buf[m.pos], sizeof(rec->hdr));
+
+	const size_t total = sizeof(rec->hdr) + rec->hdr.idlen + rec->hdr.size;
+
+	if (m.pos + total > m.len) {
+		return false;
+	}
+
+	rec->id = (const char *)&m.buf[m.pos + sizeof(rec->hdr)];
+	rec->payload = &m.buf[m.pos + sizeof(rec->hdr) + rec->hdr.idlen];
+
+	return true;
+}
+
+static void consume(const struct record *rec)
+{
+	m.pos += sizeof(rec->hdr) + rec->hdr.idlen + rec->hdr.size;
+	m.stats.records++;
+}
+
+static void copy_id(char *dst, const struct record *rec)
+{
+	const size_t len = rec->hdr.idlen < OCPP_MESSAGE_ID_MAXLEN?
+		rec->hdr.idlen : OCPP_MESSAGE_ID_MAXLEN - 1;
+
+	memset(dst, 0, OCPP_MESSAGE_ID_MAXLEN);
+	memcpy(dst, rec->id, len);
+}
+
+static void *copy_payload(const struct record *rec)
+{
+	if (rec->hdr.size == 0) {
+		return NULL;
+	}
+
+	void *p = malloc(rec->hdr.size);
+
+	if (p) {
+		memcpy(p, rec->payload, rec->hdr.size);
+	}
+
+	return p;
+}
+
+static void map_id(const char *captured, const char *replayed)
+{
+	struct id_map *p = &m.ids[m.ids_next++ % ID_MAP_LEN];
+
+	memcpy(p->captured, captured, sizeof(p->captured));
+	memcpy(p->replayed, replayed, sizeof(p->replayed));
+}
+
+static const char *lookup_id(const char *captured)
+{
+	for (int i = 0; i < ID_MAP_LEN; i++) {
+		if (strcmp(m.ids[i].captured, captured) == 0) {
+			return m.ids[i].replayed;
+		}
+	}
+
+	return NULL;
+}
+
+static void wait_for(const struct record *rec)
+{
+	if (m.has_timestamp) {
+		m.elapsed_us += (uint32_t)(rec->hdr.timestamp - m.last_timestamp);
+	}
+	m.last_timestamp = rec->hdr.timestamp;
+	m.has_timestamp = true;
+
+	if (!m.pacing) {
+		return;
+	}
+
+	const uint64_t due = m.started_ns + m.elapsed_us * 1000u;
+	const uint64_t now = get_ns(CLOCK_MONOTONIC);
+
+	if (due > now) {
+		usleep((useconds_t)((due - now) / 1000u));
+	}
+}
+
+time_t time(time_t *second)
+{
+	if (second) {
+		*second = m.now;
+	}
+	return m.now;
+}
+
+int ocpp_send(const struct ocpp_message *msg)
+{
+	struct record rec;
+
+	m.stats.sends++;
+
+	if (!peek(&rec) || rec.hdr.kind != OCPP_CAPTURE_SEND ||
+			rec.hdr.type != msg->type) {
+		diverge("unexpected send", NULL);
+		return 0;
+	}
+
+	consume(&rec);
+
+	if (msg->role == OCPP_MSG_ROLE_CALL) {
+		char id[OCPP_MESSAGE_ID_MAXLEN];
+		copy_id(id, &rec);
+		map_id(id, msg->id);
+	}
+
+	return rec.hdr.rc;
+}
+
+int ocpp_recv(struct ocpp_message *msg)
+{
+	struct record rec;
+
+	if (!peek(&rec) || rec.hdr.kind != OCPP_CAPTURE_RECV) {
+		return -ENOMSG;
+	}
+
+	consume(&rec);
+	m.stats.recvs++;
+
+	if (rec.hdr.idlen == 0) { /* transport error */
+		return rec.hdr.rc;
+	}
+
+	copy_id(msg->id, &rec);
+	msg->role = (ocpp_message_role_t)rec.hdr.role;
+	msg->type = (ocpp_message_t)rec.hdr.type;
+
+	/* the payload of a result is dereferenced by the engine, so it is
+	 * skipped when missing as of a corrupted capture */
+	if (msg->role == OCPP_MSG_ROLE_CALLRESULT && rec.hdr.size == 0) {
+		diverge("result without payload", &rec);
+		return -ENOMSG;
+	}
+
+	if (msg->role != OCPP_MSG_ROLE_CALL) {
+		const char *id = lookup_id(msg->id);
+		if (id == NULL) {
+			diverge("response to unknown request", &rec);
+		} else {
+			memcpy(msg->id, id, sizeof(msg->id));
+		}
+	}
+
+	/* aligned copy, valid until the next call */
+	free(m.payload);
+	m.payload = copy_payload(&rec);
+	msg->payload.fmt.data = m.payload;
+	msg->payload.size = rec.hdr.size;
+
+	return rec.hdr.rc;
+}
+
+int ocpp_lock(void)
+{
+	return 0;
+}
+
+int ocpp_unlock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_lock(void)
+{
+	return 0;
+}
+
+int ocpp_configuration_unlock(void)
+{
+	return 0;
+}
+
+void ocpp_generate_message_id(void *buf, size_t bufsize)
+{
+	snprintf((char *)buf, bufsize, "%lu", ++m.msgid);
+}
+
+static void on_ocpp_event(ocpp_event_t event_type,
+		const struct ocpp_message *msg, void *ctx)
+{
+	(void)ctx;
+
+	if (event_type == OCPP_EVENT_MESSAGE_FREE && msg->payload.fmt.data &&
+			msg->payload.fmt.data != m.payload) {
+		free(msg->payload.fmt.data); /* copied in replay_push() */
+	}
+}
+
+static void replay_push(const struct record *rec)
+{
+	void *data = copy_payload(rec);
+	int rc = 0;
+
+	m.stats.pushes++;
+
+	switch (rec->hdr.kind) {
+	case OCPP_CAPTURE_PUSH_REQUEST:
+		rc = ocpp_push_request((ocpp_message_t)rec->hdr.type,
+				data, rec->hdr.size,
+				rec->hdr.flags & OCPP_CAPTURE_FLAG_FORCE);
+		break;
+	case OCPP_CAPTURE_PUSH_DEFER:
+		rc = ocpp_push_request_defer((ocpp_message_t)rec->hdr.type,
+				data, rec->hdr.size, rec->hdr.arg);
+		break;
+	case OCPP_CAPTURE_PUSH_RESPONSE: {
+		struct ocpp_message req = {
+			.type = (ocpp_message_t)rec->hdr.type,
+		};
+		copy_id(req.id, rec);
+		rc = ocpp_push_response(&req, data, rec->hdr.size,
+				rec->hdr.flags & OCPP_CAPTURE_FLAG_ERR);
+		} break;
+	default:
+		break;
+	}
+
+	if (rc != 0) {
+		free(data);
+	}
+	if (rc != rec->hdr.rc) {
+		diverge("push result differs", rec);
+	}
+}
+
+static void replay_step(ocpp_capture_kind_t kind)
+{
+	const uint64_t t0 = get_ns(CLOCK_THREAD_CPUTIME_ID);
+
+	if (kind == OCPP_CAPTURE_STEP_TX) {
+		ocpp_step_tx();
+	} else if (kind == OCPP_CAPTURE_STEP_RX) {
+		ocpp_step_rx();
+	} else {
+		ocpp_step();
+	}
+
+	const uint64_t elapsed = get_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+
+	m.stats.steps++;
+	m.stats.step_ns_total += elapsed;
+	if (elapsed > m.stats.step_ns_max) {
+		m.stats.step_ns_max = elapsed;
+	}
+}
+
+static void replay(void)
+{
+	struct record rec;
+
+	while (peek(&rec)) {
+		consume(&rec);
+
+		switch (rec.hdr.kind) {
+		case OCPP_CAPTURE_TIME: {
+			int64_t t;
+			memcpy(&t, rec.payload, sizeof(t));
+			m.now = (time_t)t;
+			} break;
+		case OCPP_CAPTURE_INIT:
+			wait_for(&rec);
+			ocpp_init(on_ocpp_event, NULL);
+			break;
+		case OCPP_CAPTURE_STEP: /* fall through */
+		case OCPP_CAPTURE_STEP_TX: /* fall through */
+		case OCPP_CAPTURE_STEP_RX:
+			wait_for(&rec);
+			replay_step((ocpp_capture_kind_t)rec.hdr.kind);
+			break;
+		case OCPP_CAPTURE_PUSH_REQUEST: /* fall through */
+		case OCPP_CAPTURE_PUSH_DEFER: /* fall through */
+		case OCPP_CAPTURE_PUSH_RESPONSE:
+			wait_for(&rec);
+			replay_push(&rec);
+			break;
+		case OCPP_CAPTURE_CONFIG: {
+			char key[UINT8_MAX + 1] = { 0, };
+			memcpy(key, rec.id, rec.hdr.idlen);
+			ocpp_set_configuration(key, rec.payload, rec.hdr.size);
+			} break;
+		default:
+			diverge("send or recv out of any step", &rec);
+			break;
+		}
+	}
+
+	if (m.pos != m.len) {
+		fprintf(stderr, "truncated record at %zu\n", m.pos);
+	}
+}
+
+static int load(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	struct ocpp_capture_header hdr;
+
+	if (fp == NULL) {
+		perror(path);
+		return -errno;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	const long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if (size < (long)sizeof(hdr) ||
+			fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+			hdr.magic != OCPP_CAPTURE_MAGIC ||
+			hdr.version != OCPP_CAPTURE_VERSION ||
+			hdr.record_size != sizeof(struct ocpp_capture_record) ||
+			hdr.id_maxlen != OCPP_MESSAGE_ID_MAXLEN) {
+		fprintf(stderr, "%s: not a capture of this build\n", path);
+		fclose(fp);
+		return -EINVAL;
+	}
+
+	m.len = (size_t)size - sizeof(hdr);
+	m.buf = (uint8_t *)malloc(m.len + 1);
+
+	if (m.buf == NULL || fread(m.buf, 1, m.len, fp) != m.len) {
+		fclose(fp);
+		return -EIO;
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+static void report(uint64_t wall_ns)
+{
+	struct ocpp_stats stats;
+
+	ocpp_get_stats(&stats);
+
+	printf("records %u, steps %u, pushes %u, sends %u, recvs %u\n",
+			m.stats.records, m.stats.steps, m.stats.pushes,
+			m.stats.sends, m.stats.recvs);
+	printf("divergences %u\n", m.stats.divergences);
+	printf("wall %.3f ms, step cpu mean %.3f us, max %.3f us\n",
+			(double)wall_ns / 1e6,
+			m.stats.steps? (double)m.stats.step_ns_total /
+				m.stats.steps / 1e3 : 0,
+			(double)m.stats.step_ns_max / 1e3);
+	printf("queue high watermarks: ready %u, wait %u, timer %u\n",
+			stats.queue[OCPP_QUEUE_READY].high,
+			stats.queue[OCPP_QUEUE_WAIT].high,
+			stats.queue[OCPP_QUEUE_TIMER].high);
+	printf("pending at the end %zu\n", ocpp_count_pending_requests());
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "pv")) != -1) {
+		switch (c) {
+		case 'p':
+			m.pacing = true;
+			break;
+		case 'v':
+			m.verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p] [-v] <capture>\n",
+					argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-p] [-v] <capture>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (load(argv[optind]) != 0) {
+		return EXIT_FAILURE;
+	}
+
+	m.started_ns = get_ns(CLOCK_MONOTONIC);
+	replay();
+	report(get_ns(CLOCK_MONOTONIC) - m.started_ns);
+
+	free(m.buf);
+
+	return m.stats.divergences? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Kyunghwan Kwon <k@libmcu.org>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Decodes a dump of `ocpp_trace_dump()` into a readable timeline or into
+ * Chrome trace event JSON to be loaded in chrome://tracing or Perfetto.
+ *
+ * Usage: ocpp_trace_decode [-c] <dump file>
+ */
+
+#include "ocpp/ocpp.h"
+#include "ocpp/trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *stringify_event(uint8_t event)
+{
+	static const char *tbl[] = {
+		[OCPP_TRACE_PUT_READY] = "put ready",
+		[OCPP_TRACE_PUT_READY_INFRONT] = "put ready in front",
+		[OCPP_TRACE_PUT_WAIT] = "put wait",
+		[OCPP_TRACE_PUT_TIMER] = "put timer",
+		[OCPP_TRACE_DEL_READY] = "del ready",
+		[OCPP_TRACE_DEL_WAIT] = "del wait",
+		[OCPP_TRACE_DEL_TIMER] = "del timer",
+		[OCPP_TRACE_SEND] = "send",
+		[OCPP_TRACE_SEND_FAIL] = "send failed",
+		[OCPP_TRACE_RETRY] = "retry",
+		[OCPP_TRACE_DROP] = "drop",
+		[OCPP_TRACE_EVICT] = "evict",
+		[OCPP_TRACE_FREE] = "free",
+		[OCPP_TRACE_RECV_CALL] = "recv call",
+		[OCPP_TRACE_RECV_RESULT] = "recv result",
+		[OCPP_TRACE_RECV_ERROR] = "recv error",
+	};
+
+	return event >= OCPP_TRACE_EVENT_MAX? "unknown" : tbl[event];
+}
+
+/* the queue a record opens or closes a span of. NULL if instant event. */
+static const char *get_span(uint8_t event, bool *begin)
+{
+	*begin = event <= OCPP_TRACE_PUT_TIMER;
+
+	switch (event) {
+	case OCPP_TRACE_PUT_READY: /* fall through */
+	case OCPP_TRACE_PUT_READY_INFRONT: /* fall through */
+	case OCPP_TRACE_DEL_READY:
+		return "ready";
+	case OCPP_TRACE_PUT_WAIT: /* fall through */
+	case OCPP_TRACE_DEL_WAIT:
+		return "wait";
+	case OCPP_TRACE_PUT_TIMER: /* fall through */
+	case OCPP_TRACE_DEL_TIMER:
+		return "timer";
+	default:
+		return NULL;
+	}
+}
+
+static void print_text(const struct ocpp_trace_record *rec, uint64_t usec)
+{
+	char slot[8] = "-";
+
+	if (rec->slot != OCPP_TRACE_NO_SLOT) {
+		snprintf(slot, sizeof(slot), "%u", rec->slot);
+	}
+
+	printf("%10llu.%06llu  slot %-5s %-20s %-32s attempts %u\n",
+			(unsigned long long)(usec / 1000000),
+			(unsigned long long)(usec % 1000000),
+			slot, stringify_event(rec->event),
+			ocpp_stringify_type((ocpp_message_t)rec->type),
+			rec->attempts);
+}
+
+static void print_chrome(const struct ocpp_trace_record *rec, uint64_t usec,
+		bool first)
+{
+	bool begin;
+	const char *span = get_span(rec->event, &begin);
+	const char *type = ocpp_stringify_type((ocpp_message_t)rec->type);
+	const unsigned tid = rec->slot == OCPP_TRACE_NO_SLOT? 0 :
+		(unsigned)rec->slot + 1;
+
+	printf("%s\n  {\"pid\":0,\"tid\":%u,\"ts\":%llu,", first? "" : ",",
+			tid, (unsigned long long)usec);
+
+	if (span) {
+		printf("\"ph\":\"%s\",\"name\":\"%s\",\"cat\":\"%s\",",
+				begin? "B" : "E", span, type);
+	} else {
+		printf("\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\","
+				"\"cat\":\"%s\",", stringify_event(rec->event),
+				type);
+	}
+
+	printf("\"args\":{\"type\":\"%s\",\"attempts\":%u}}",
+			type, rec->attempts);
+}
+
+static int decode(const uint8_t *dump, size_t dumpsize, bool chrome)
+{
+	struct ocpp_trace_header hdr;
+
+	if (dumpsize < sizeof(hdr)) {
+		fprintf(stderr, "too short for a trace dump\n");
+		return -1;
+	}
+
+	memcpy(&hdr, dump, sizeof(hdr));
+
+	if (hdr.magic != OCPP_TRACE_MAGIC ||
+			hdr.version != OCPP_TRACE_VERSION ||
+			hdr.record_size != sizeof(struct ocpp_trace_record)) {
+		fprintf(stderr, "not a trace dump or version mismatch\n");
+		return -1;
+	}
+
+	if (dumpsize < sizeof(hdr) + (size_t)hdr.count * hdr.record_size) {
+		fprintf(stderr, "truncated: %u records expected\n", hdr.count);
+		return -1;
+	}
+
+	if (chrome) {
+		printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	} else if (hdr.overwritten) {
+		printf("# %u older records overwritten\n", hdr.overwritten);
+	}
+
+	uint64_t usec = 0;
+	uint32_t prev = 0;
+
+	for (uint32_t i = 0; i < hdr.count; i++) {
+		struct ocpp_trace_record rec;
+		memcpy(&rec, &dump[sizeof(hdr) + i * sizeof(rec)], sizeof(rec));
+
+		/* timestamps wrap around every 71 minutes. Relative to the
+		 * first record. */
+		if (i) {
+			usec += (uint32_t)(rec.timestamp - prev);
+		}
+		prev = rec.timestamp;
+
+		if (chrome) {
+			print_chrome(&rec, usec, i == 0);
+		} else {
+			print_text(&rec, usec);
+		}
+	}
+
+	if (chrome) {
+		printf("\n]}\n");
+	}
+
+	return 0;
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+	FILE *fp = fopen(path, "rb");
+	uint8_t *buf = NULL;
+	size_t cap = 0;
+
+	*size = 0;
+
+	if (fp == NULL) {
+		return NULL;
+	}
+
+	for (;;) {
+		if (*size == cap) {
+			cap = cap? cap * 2 : 4096;
+			uint8_t *p = (uint8_t *)realloc(buf, cap);
+			if (p == NULL) {
+				free(buf);
+				buf = NULL;
+				break;
+			}
+			buf = p;
+		}
+
+		const size_t n = fread(&buf[*size], 1, cap - *size, fp);
+		if (n == 0) {
+			break;
+		}
+		*size += n;
+	}
+
+	fclose(fp);
+
+	return buf;
+}
+
+int main(int argc, char *argv[])
+{
+	bool chrome = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ch")) != -1) {
+		switch (opt) {
+		case 'c':
+			chrome = true;
+			break;
+		case 'h': /* fall through */
+		default:
+			fprintf(stderr, "Usage: %s [-c] <dump file>\n"
+					"  -c  print Chrome trace event JSON\n",
+					argv[0]);
+			return opt == 'h'? 0 : 1;
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "no dump file given\n");
+		return 1;
+	}
+
+	size_t size;
+	uint8_t *dump = read_file(argv[optind], &size);
+
+	if (dump == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	const int rc = decode(dump, size, chrome);
+	free(dump);
+
+	return rc == 0? 0 : 1;
+}